@@ -0,0 +1,292 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "common/socket.hpp"
+
+#include "rtcore/renderer.hpp"
+
+
+// Distributed rendering: a coordinator splits the image into tiles and hands them out over TCP,
+// one at a time, to worker processes. A worker loads the scene the coordinator names (mapping
+// the scene cache the coordinator wrote), renders a tile with the normal sample loop and sends
+// back its linear color as floats, which the coordinator copies into the frame. Handing out
+// tiles on demand balances the load; the tile of a worker that drops out goes back to the queue.
+//
+// Messages are a header { type, size } followed by `size` bytes, in host byte order: both ends
+// run the same binary on one host.
+namespace rt
+{
+
+namespace detail
+{
+
+inline constexpr uint32_t render_protocol_magic = 0x57445452;    // "RTDW"
+inline constexpr uint32_t render_protocol_version = 1;
+
+enum class render_message : uint32_t { hello, scene, tile, result, done };
+
+struct render_message_header
+{
+    render_message type;
+    uint32_t size;
+};
+
+struct render_hello
+{
+    uint32_t magic;
+    uint32_t version;
+};
+
+inline bool send_message(socket_stream& stream, render_message type, const void* data, size_t size,
+                         const void* payload = nullptr, size_t payload_size = 0)
+{
+    const render_message_header header{ type, static_cast<uint32_t>(size + payload_size) };
+    return stream.send_all(&header, sizeof(header))
+        && (size == 0 || stream.send_all(data, size))
+        && (payload_size == 0 || stream.send_all(payload, payload_size));
+}
+
+inline bool receive_header(socket_stream& stream, render_message expected, render_message_header& header)
+{
+    return stream.receive_all(&header, sizeof(header)) && header.type == expected;
+}
+
+} // namespace detail
+
+
+// Worker side: connects, loads the scene with load_scene(path, key, error), then renders tiles
+// with render(tile, pixels) until the coordinator is done. `pixels` is sized to the tile, three
+// floats per pixel. Returns false with a reason in `error` if the session broke off.
+template<typename LoadFunc, typename RenderFunc>
+bool run_render_worker(const char* address, uint16_t port, LoadFunc&& load_scene, RenderFunc&& render, std::string& error)
+{
+    socket_stream stream;
+    if (stream.connect(address, port) == false) {
+        error = "can't connect to the coordinator";
+        return false;
+    }
+
+    const detail::render_hello hello{ detail::render_protocol_magic, detail::render_protocol_version };
+    detail::render_message_header header;
+    uint64_t scene_key;
+
+    if (detail::send_message(stream, detail::render_message::hello, &hello, sizeof(hello)) == false
+        || detail::receive_header(stream, detail::render_message::scene, header) == false
+        || header.size < sizeof(scene_key) || stream.receive_all(&scene_key, sizeof(scene_key)) == false) {
+        error = "coordinator hung up";
+        return false;
+    }
+
+    std::string scene_path(header.size - sizeof(scene_key), '\0');
+    if (stream.receive_all(scene_path.data(), scene_path.size()) == false) {
+        error = "coordinator hung up";
+        return false;
+    }
+    if (load_scene(scene_path, scene_key, error) == false)
+        return false;
+
+    std::vector<float> pixels;
+    while (true) {
+        if (stream.receive_all(&header, sizeof(header)) == false) {
+            error = "coordinator hung up";
+            return false;
+        }
+        if (header.type == detail::render_message::done)
+            return true;
+
+        render_tile tile;
+        if (header.type != detail::render_message::tile || header.size != sizeof(tile)
+            || stream.receive_all(&tile, sizeof(tile)) == false) {
+            error = "unexpected message from the coordinator";
+            return false;
+        }
+
+        pixels.assign(size_t(tile.width) * tile.height * 3, 0.0f);
+        render(tile, pixels);
+
+        if (detail::send_message(stream, detail::render_message::result, &tile, sizeof(tile),
+                                 pixels.data(), pixels.size() * sizeof(float)) == false) {
+            error = "coordinator hung up";
+            return false;
+        }
+    }
+}
+
+
+// Coordinator side: accepts up to `worker_count` workers on `listener` and renders the
+// width x height frame into `pixels` (three floats per pixel, rows from the bottom) in tiles of
+// tile_size. `scene_path` must be valid for the workers, empty means the built-in scene.
+// Fails if no worker connected in time or all of them dropped out before the frame was done.
+// Tiles done are added to progress->counter(worker) if given.
+class render_coordinator
+{
+public:
+    render_coordinator(int width, int height, int tile_size)
+        : m_width(width)
+        , m_height(height)
+    {
+        tile_size = std::max(tile_size, 1);
+        for (int y = 0; y < height; y += tile_size) {
+            for (int x = 0; x < width; x += tile_size) {
+                const render_tile tile{ static_cast<uint32_t>(m_tiles.size()), static_cast<uint32_t>(x), static_cast<uint32_t>(y),
+                                        static_cast<uint32_t>(std::min(tile_size, width - x)),
+                                        static_cast<uint32_t>(std::min(tile_size, height - y)) };
+                m_tiles.push_back(tile);
+                m_pending.push_back(tile.id);
+            }
+        }
+    }
+
+    size_t tile_count() const
+    {
+        return m_tiles.size();
+    }
+
+    bool run(socket_listener& listener, int worker_count, const std::string& scene_path, uint64_t scene_key,
+             std::vector<float>& pixels, std::string& error, render_progress* progress = nullptr,
+             int accept_timeout_ms = 30000)
+    {
+        m_progress = progress;
+        pixels.assign(size_t(m_width) * m_height * 3, 0.0f);
+
+        // NOTE: accepting goes on while the first workers render; once the last tile is in,
+        // latecomers are only waited for briefly, they just get `done`
+        constexpr int accept_slice_ms = 100;
+        std::vector<std::thread> threads;
+        int waited_ms = 0;
+        while (static_cast<int>(threads.size()) < worker_count) {
+            socket_stream stream;
+            if (listener.accept(stream, accept_slice_ms)) {
+                const int worker = static_cast<int>(threads.size());
+                threads.emplace_back(&render_coordinator::serve, this, worker, std::move(stream), std::cref(scene_path), scene_key, std::ref(pixels));
+                waited_ms = 0;
+                continue;
+            }
+
+            waited_ms += accept_slice_ms;
+            if (waited_ms >= (finished() ? std::min(accept_timeout_ms, 1000) : accept_timeout_ms))
+                break;
+        }
+
+        for (auto& thread : threads)
+            thread.join();
+
+        if (threads.empty()) {
+            error = "no worker connected";
+            return false;
+        }
+        if (m_completed != m_tiles.size()) {
+            error = "all workers dropped out, " + std::to_string(m_tiles.size() - m_completed) + " tiles are missing";
+            return false;
+        }
+        return true;
+    }
+
+private:
+    bool finished()
+    {
+        std::lock_guard lock(m_mutex);
+        return m_completed == m_tiles.size();
+    }
+
+    void serve(int worker, socket_stream stream, const std::string& scene_path, uint64_t scene_key, std::vector<float>& pixels)
+    {
+        detail::render_message_header header;
+        detail::render_hello hello;
+
+        if (detail::receive_header(stream, detail::render_message::hello, header) == false || header.size != sizeof(hello)
+            || stream.receive_all(&hello, sizeof(hello)) == false
+            || hello.magic != detail::render_protocol_magic || hello.version != detail::render_protocol_version
+            || detail::send_message(stream, detail::render_message::scene, &scene_key, sizeof(scene_key),
+                                    scene_path.data(), scene_path.size()) == false) {
+            log(worker, "failed the handshake");
+            return;
+        }
+
+        std::vector<float> tile_pixels;
+        int tiles_done = 0;
+
+        while (true) {
+            uint32_t id;
+            {
+                // NOTE: a worker with nothing to do waits for the tiles in flight, one of them
+                // may come back from a worker that drops out
+                std::unique_lock lock(m_mutex);
+                m_changed.wait(lock, [this] { return m_pending.empty() == false || m_in_flight == 0; });
+                if (m_pending.empty())
+                    break;
+                id = m_pending.front();
+                m_pending.pop_front();
+                ++m_in_flight;
+            }
+
+            const render_tile& tile = m_tiles[id];
+            render_tile result;
+            tile_pixels.resize(size_t(tile.width) * tile.height * 3);
+
+            const bool ok = detail::send_message(stream, detail::render_message::tile, &tile, sizeof(tile))
+                && detail::receive_header(stream, detail::render_message::result, header)
+                && header.size == sizeof(result) + tile_pixels.size() * sizeof(float)
+                && stream.receive_all(&result, sizeof(result)) && result.id == id
+                && stream.receive_all(tile_pixels.data(), tile_pixels.size() * sizeof(float));
+
+            if (ok) {
+                // NOTE: tiles don't overlap, rows are copied without a lock
+                for (uint32_t row = 0; row < tile.height; ++row) {
+                    std::memcpy(pixels.data() + ((size_t(tile.y) + row) * m_width + tile.x) * 3,
+                                tile_pixels.data() + size_t(row) * tile.width * 3, size_t(tile.width) * 3 * sizeof(float));
+                }
+                ++tiles_done;
+                if (m_progress != nullptr)
+                    m_progress->counter(worker).add(1, 0);
+            }
+
+            {
+                std::lock_guard lock(m_mutex);
+                --m_in_flight;
+                if (ok)
+                    ++m_completed;
+                else
+                    m_pending.push_back(id);
+            }
+            m_changed.notify_all();
+
+            if (ok == false) {
+                log(worker, "dropped out, its tile is rendered again");
+                return;
+            }
+        }
+
+        detail::send_message(stream, detail::render_message::done, nullptr, 0);
+        log(worker, "rendered " + std::to_string(tiles_done) + " tiles");
+    }
+
+    void log(int worker, const std::string& message)
+    {
+        std::lock_guard lock(m_mutex);
+        std::cout << "Worker " << worker << ": " << message << std::endl;
+    }
+
+    int m_width;
+    int m_height;
+    std::vector<render_tile> m_tiles;
+
+    std::mutex m_mutex;
+    std::condition_variable m_changed;
+    std::deque<uint32_t> m_pending;
+    size_t m_in_flight = 0;
+    size_t m_completed = 0;
+    render_progress* m_progress = nullptr;
+};
+
+} // namespace rt
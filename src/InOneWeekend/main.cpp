@@ -1,282 +1,758 @@
 #include <iostream>
 #include <cstdint>
-#include <limits>
+#include <cstdio>
 #include <chrono>
 #include <memory>
+#include <string>
 
 #include <thread>
 #include <vector>
 #include <mutex>
-#include <atomic>
+#include <optional>
+#include <filesystem>
+#include <map>
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
 
-#include "common/stb_image_write.h"
+#include "common/partial_image.hpp"
+#include "common/arena.hpp"
+#include "common/bounded_queue.hpp"
+#include "common/socket.hpp"
+#include "common/process.hpp"
+#include "common/trace.hpp"
 
-#include "common/vec3.hpp"
-#include "common/ray.hpp"
-#include "common/utility.hpp"
-#include "common/camera.hpp"
+#include "rtcore/renderer.hpp"
 
-#include "hittable_list.hpp"
-#include "sphere.hpp"
-#include "material.hpp"
+#include "distributed.hpp"
+#include "render_server.hpp"
 
 
-const int g_ImageWidth = 1000;
-const int g_ImageHeight = 500;
-const int g_Channels = 3;
+// NOTE: resolution, samples, camera etc. come from rt::render_settings (rtcore/scene_file.hpp),
+// the defaults reproduce the book's final render; the render loops are in rtcore/renderer.cpp
+using fp_type = rt::fp_type;
 
-const int g_SamplesPerPixel = 40;
-const int g_MaxDepth = 20;
 
-const int g_NumThreads = 2;
-
-using fp_type = float;
-
-
-//class safe_cout
+//void render(int shift, rt::vec3<uint8_t>* img, rt::hittable_list<fp_type>& world, rt::camera<fp_type>& cam, std::atomic<int>& ray_count)
 //{
-//public:
-//    safe_cout()
-//    {
-//        pixels_ready = 0;
-//    }
+//    //int index = 1;
+//    int ray_count_t = 0;
+//
+//    for (int f = 0; f < 100; ++f) {
+//        rt::vec3<uint8_t>* img_ptr = img + shift;
+//        const fp_type lerpFac = fp_type(f) / (f + 1);
 //
-//    void update_thread(int thread_index)
-//    {
-//        std::lock_guard lock(m);
+//        for (int j = 0; j < g_ImageHeight; ++j) {
+//            for (int i = shift; i < g_ImageWidth; i += g_NumThreads) {
+//                rt::vec3<fp_type> color(0, 0, 0);
 //
-//        pixels_ready += 400 + thread_index * 10;
+//                for (int s = 0; s < g_SamplesPerPixel; ++s) {
+//                    fp_type v = fp_type(j + rt::s_random_gen()) / g_ImageHeight;
+//                    fp_type u = fp_type(i + rt::s_random_gen()) / g_ImageWidth;
 //
-//        std::cout << '\r' << std::flush;
-//        std::cout << pixels_ready << '/' << g_ImageHeight * g_ImageWidth;
-//        std::cout.flush();
-//    }
+//                    auto r = cam.get_ray(u, v);
+//                    color += ray_color(r, world, g_MaxDepth, ray_count_t);
+//                }
+//
+//                color /= fp_type(g_SamplesPerPixel);
+//                color = rt::vector_sqrt(color);// *static_cast<fp_type>(255.999);
+//
+//                rt::vec3<fp_type> prev(img_ptr->x, img_ptr->y, img_ptr->z);
+//                prev /= static_cast<fp_type>(255.999);
+//                color = (prev * lerpFac + color * (1 - lerpFac)) * static_cast<fp_type>(255.999);
 //
-//private:
-//    int pixels_ready;
-//    std::mutex m;
-//};
+//                *img_ptr = color;
+//                img_ptr += g_NumThreads;
+//            }
+//        }
+//    }
 //
-//safe_cout g_Info;
+//    ray_count.fetch_add(ray_count_t, std::memory_order::memory_order_relaxed);
+//}
 
+// Worker process of the distributed mode: renders tiles for the coordinator at address:port
+// on one thread, more workers are the way to more cores
+int worker_main(const std::string& coordinator)
+{
+    const size_t colon = coordinator.find_last_of(':');
+    const std::string address = coordinator.substr(0, colon);
+    const int port = colon != std::string::npos ? std::atoi(coordinator.c_str() + colon + 1) : 0;
+    if (port <= 0 || port > 0xffff) {
+        std::cout << "worker: expected address:port of the coordinator, got " << coordinator << std::endl;
+        return 1;
+    }
+
+    rt::render_settings<fp_type> settings;
+    rt::scene_file file;
+    rt::scene_builder<fp_type> builder;
+    rt::scene_cache<fp_type> cache;
+    rt::scene_arena arena;
+    std::optional<rt::scene<fp_type>> world;
+    std::optional<rt::camera<fp_type>> cam;
+    rt::render_stats stats;
+
+    auto load = [&](const std::string& path, uint64_t scene_key, std::string& error) {
+        const char* scene_path = path.empty() ? nullptr : path.c_str();
+        if (scene_path != nullptr && (file.open(scene_path, error) == false || file.read_settings(settings, error) == false))
+            return false;
+        if ((scene_path != nullptr ? file.scene_key() : rt::random_scene_key()) != scene_key) {
+            error = "the scene changed since the coordinator read it";
+            return false;
+        }
+        if (rt::load_scene(scene_path, file, true, builder, cache, error) == false)
+            return false;
+
+        world.emplace(cache.is_open() ? cache.make_world(arena) : rt::make_world(builder, arena));
+        cam.emplace(settings.make_camera());
+        return true;
+    };
+
+    auto render = [&](const rt::render_tile& tile, std::vector<float>& pixels) {
+        rt::render_region(tile, pixels.data(), *world, *cam, settings, stats);
+    };
+
+    std::string error;
+    if (rt::run_render_worker(address.c_str(), static_cast<uint16_t>(port), load, render, error) == false) {
+        std::cout << "worker: " << error << std::endl;
+        return 1;
+    }
+    return 0;
+}
 
-const int g_A = 11;
-const int g_B = 11;
 
-rt::hittable_list<fp_type> random_scene()
+// A scene the render server keeps between jobs, BVH and all; jobs hold on to it while they
+// render, so a scene that changed or was evicted goes away with its last job
+struct server_scene
 {
-    rt::random_generator<fp_type, std::minstd_rand> random_gen;
-    std::uniform_real_distribution<fp_type> dist_0_05(0, 0.5);
-    std::uniform_real_distribution<fp_type> dist_05_1(0.5, 1);
-
-    rt::hittable_list<fp_type> world;
-
-    world.add(std::make_shared<rt::sphere<fp_type>>(rt::vec3<fp_type>(0.0, -1000.0, 0.0),
-                                                    1000,
-                                                    std::make_shared<rt::lambertian<fp_type>>(rt::vec3<fp_type>(0.5, 0.5, 0.5))));
-
-    int i = 1;
-    for (int a = -g_A; a < g_A; ++a) {
-        for (int b = -g_B; b < g_B; ++b) {
-            fp_type choose_material = random_gen();
-            rt::vec3<fp_type> center(a + fp_type(0.9) * random_gen(), 0.2, b + fp_type(0.9) * random_gen());
-
-            if ((center - rt::vec3<fp_type>(4.0, 0.2, 0.0)).length() > fp_type(0.9)) {
-                // diffuse
-                if (choose_material < 0.5) {
-                    rt::vec3<fp_type> albedo = random_gen.random_vec3() * random_gen.random_vec3();
-                    world.add(std::make_shared<rt::sphere<fp_type>>(center,
-                                                                    0.2,
-                                                                    std::make_shared<rt::lambertian<fp_type>>(albedo)));
-                }
-                // metal
-                else if (choose_material < fp_type(0.75)) {
-                    rt::vec3<fp_type> albedo = random_gen.random_vec3(dist_05_1);
-                    fp_type fuzz = random_gen(dist_0_05);
-                    world.add(std::make_shared<rt::sphere<fp_type>>(center,
-                                                                    0.2,
-                                                                    std::make_shared<rt::metal<fp_type>>(albedo, fuzz)));
-                }
-                // glass
-                else {
-                    world.add(std::make_shared<rt::sphere<fp_type>>(center,
-                                                                    0.2,
-                                                                    std::make_shared<rt::dielectic<fp_type>>(1.5)));
+    uint64_t key = 0;
+    uint64_t last_used = 0;
+    rt::scene_builder<fp_type> builder;
+    rt::scene_cache<fp_type> cache;
+    rt::scene_arena arena;
+    std::optional<rt::scene<fp_type>> world;
+};
+
+struct server_job
+{
+    rt::render_settings<fp_type> settings;
+    std::optional<rt::camera<fp_type>> cam;
+    std::vector<float> pixels;
+};
+
+// NOTE: scenes beyond this are evicted, least recently used first
+const size_t g_ServerSceneLimit = 4;
+
+// Render server mode: takes jobs on `port` until a client sends shutdown (see render_server.hpp).
+// A job names a scene file (none: random_scene()) and overrides its settings and camera, see
+// scene_file::read_job_settings(); its rows are rendered on the pool by priority.
+int server_main(int port)
+{
+    rt::socket_listener listener;
+    if (listener.listen(static_cast<uint16_t>(port)) == false) {
+        std::cout << "can't listen on port " << port << std::endl;
+        return 1;
+    }
+
+    const int thread_count = static_cast<int>(std::max(std::thread::hardware_concurrency(), 1u));
+    rt::render_job_queue queue(thread_count);
+    std::cout << "Server: port " << listener.port() << ", " << thread_count << " threads" << std::endl;
+
+    // NOTE: keyed by path and scene key, a job keeps the version of a scene it was submitted
+    // with when the file is edited meanwhile
+    std::mutex scenes_mutex;
+    std::map<std::pair<std::string, uint64_t>, std::shared_ptr<server_scene>> scenes;
+    std::map<std::string, std::weak_ptr<server_scene>> mapped_caches;    // the version mapping each path's cache
+    uint64_t use_count = 0;
+
+    auto submit = [&](const rt::json_value& request, int priority, std::string& error) -> uint64_t {
+        const rt::json_value* scene_member = request.find("scene");
+        if (scene_member != nullptr && scene_member->is_string() == false) {
+            error = "scene must be a file name";
+            return 0;
+        }
+        const std::string path = scene_member != nullptr ? scene_member->string : std::string();
+        const char* scene_path = path.empty() ? nullptr : path.c_str();
+
+        auto job = std::make_shared<server_job>();
+        rt::scene_file file;
+        if (scene_path != nullptr && (file.open(scene_path, error) == false || file.read_settings(job->settings, error) == false)) {
+            error = path + ", " + error;
+            return 0;
+        }
+        if (rt::scene_file::read_job_settings(request, job->settings, error) == false)
+            return 0;
+
+        // NOTE: the file is parsed per job to see whether it changed, the scene is only built
+        // (or mapped from its cache) when it did
+        std::shared_ptr<server_scene> scene;
+        {
+            std::lock_guard lock(scenes_mutex);
+            const uint64_t scene_key = scene_path != nullptr ? file.scene_key() : rt::random_scene_key();
+            auto& entry = scenes[{ path, scene_key }];
+            std::shared_ptr<server_scene> mapped = entry == nullptr ? mapped_caches[path].lock() : nullptr;
+            if (mapped != nullptr && mapped->key == scene_key) {
+                entry = std::move(mapped);    // evicted, but its jobs still hold on to it
+            }
+            else if (entry == nullptr) {
+                // NOTE: while another version of the scene maps the cache file, this one is built
+                // in memory and the file is left alone; it is rewritten once that version is gone
+                auto loaded = std::make_shared<server_scene>();
+                if (rt::load_scene(scene_path, file, mapped == nullptr, loaded->builder, loaded->cache, error) == false) {
+                    scenes.erase({ path, scene_key });
+                    error = (scene_path != nullptr ? path : std::string("random_scene")) + ", " + error;
+                    return 0;
                 }
+                loaded->key = scene_key;
+                loaded->world.emplace(loaded->cache.is_open() ? loaded->cache.make_world(loaded->arena) : rt::make_world(loaded->builder, loaded->arena));
+                if (loaded->cache.is_open())
+                    mapped_caches[path] = loaded;
+                entry = std::move(loaded);
+                std::cout << "Server: loaded " << (scene_path != nullptr ? path : std::string("random_scene")) << std::endl;
+            }
+            entry->last_used = ++use_count;
+            scene = entry;
+
+            while (scenes.size() > g_ServerSceneLimit) {
+                scenes.erase(std::min_element(scenes.begin(), scenes.end(), [](const auto& a, const auto& b) {
+                    return a.second->last_used < b.second->last_used;
+                }));
             }
         }
-    }
 
-    world.add(std::make_shared<rt::sphere<fp_type>>(rt::vec3<fp_type>(0.0, 1.0, 0.0),
-                                                    1.0,
-                                                    std::make_shared<rt::dielectic<fp_type>>(1.5)));
+        const auto& settings = job->settings;
+        job->cam.emplace(settings.make_camera());
+        // NOTE: read_job_settings() bounds the size, but even a bounded job may not fit next to
+        // the others; the client gets an error rather than the server going down
+        try {
+            job->pixels.resize(size_t(settings.width) * settings.height * 3);
+        }
+        catch (const std::exception&) {
+            error = "not enough memory for a " + std::to_string(settings.width) + "x" + std::to_string(settings.height) + " job";
+            return 0;
+        }
+
+        // NOTE: a row is a tile of render_region(), seeded by its row, so a job renders the same
+        // however the pool shares it out
+        auto render_row = [scene, job](int row) {
+            const auto& settings = job->settings;
+            const rt::render_tile tile{ static_cast<uint32_t>(row), 0, static_cast<uint32_t>(row), static_cast<uint32_t>(settings.width), 1 };
+            rt::render_stats stats;
+            rt::render_region(tile, job->pixels.data() + size_t(row) * settings.width * 3, *scene->world, *job->cam, settings, stats);
+        };
+
+        auto finish = [job](std::string& error) {
+            const auto& settings = job->settings;
+            rt::framebuffer image(settings.width, settings.height);
+            {
+                RT_TRACE_SCOPE("tonemap");
+                for (size_t i = 0; i < job->pixels.size(); i += 3)
+                    rt::store_color(rt::vec3<fp_type>(job->pixels[i], job->pixels[i + 1], job->pixels[i + 2]), image.rgb.data() + i);
+            }
+
+            const std::string stem = settings.output.substr(0, settings.output.find_last_of('.'));
+            if (rt::write_image(stem, settings.output.substr(stem.size()), image) == false) {
+                error = "can't write " + settings.output;
+                return false;
+            }
+            return true;
+        };
+
+        return queue.submit(priority, settings.height, std::move(render_row), std::move(finish));
+    };
+
+    rt::run_render_server(listener, queue, submit);
+
+    std::cout << "Server: shutting down" << std::endl;
+    return 0;
+}
+
 
-    world.add(std::make_shared<rt::sphere<fp_type>>(rt::vec3<fp_type>(-4.0, 1.0, 0.0),
-                                                    1.0,
-                                                    std::make_shared<rt::lambertian<fp_type>>(rt::vec3<fp_type>(0.4, 0.2, 0.1))));
+// --stats and --stats-json of a finished render
+bool report_stats(const rt::render_stats& stats, bool print, const char* json_path)
+{
+    if (print)
+        rt::print_stats(std::cout, stats);
+
+    if (json_path != nullptr) {
+        std::ofstream out(json_path);
+        out << rt::stats_json(stats) << '\n';
+        if (out.good() == false) {
+            std::cout << "can't write " << json_path << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
 
-    world.add(std::make_shared<rt::sphere<fp_type>>(rt::vec3<fp_type>(4.0, 1.0, 0.0),
-                                                    1.0,
-                                                    std::make_shared<rt::metal<fp_type>>(rt::vec3<fp_type>(0.7, 0.6, 0.5),
-                                                                                         0.0)));
 
-    return world;
+// Which mode rendered and its throughput; in background mode also how far the governor held it
+// back, and by what signal
+void print_mode(const rt::worker_throttle* throttle, uint64_t rays, double time_ms)
+{
+    std::cout << "Mode: " << (throttle != nullptr ? "background" : "normal") << ", "
+              << (time_ms > 0 ? double(rays) / time_ms / 1000 : 0.0) << " Mrays/s";
+    if (throttle != nullptr) {
+        std::cout << ", " << throttle->average_workers() << " of " << throttle->max_workers() << " workers on average, "
+                  << throttle->adjustments() << " adjustments by " << (throttle->has_pressure_stall_info() ? "PSI" : "load average");
+    }
+    std::cout << "\n";
 }
 
+// --trace: the timeline is written when main returns, whichever way it does
+struct trace_output
+{
+    const char* path = nullptr;
+
+    ~trace_output()
+    {
+        if (path != nullptr && rt::write_trace(path) == false)
+            std::cout << "can't write " << path << std::endl;
+    }
+};
+
 
-rt::vec3<fp_type> ray_color(const rt::ray<fp_type>& r, const rt::hittable<fp_type>& world, int depth, int& ray_count)
+// One of the two scene states of the pipeline: where its builder stands and what is seen from
+// where. `builder` is only advanced for moving geometry.
+struct frame_state
 {
-    if (depth <= 0)
-        return rt::vec3<fp_type>(0);
+    int frame;
+    rt::scene_builder<fp_type>* builder;
+    const rt::scene<fp_type>* world;
+    rt::camera<fp_type> cam;
+};
 
-    ++ray_count;
+struct frame_job
+{
+    int frame;
+    int state;    // index of the frame_state
+    int image;    // index of the image buffer, once rendering starts
+};
+
+// usage: InOneWeekend [options] [scene file]   (see scene_file.hpp, without one the built-in random_scene() is rendered)
+//   --workers N     render distributed over N local worker processes
+//   --port P        port of the coordinator, the default picks a free one
+//   --external      don't start the workers, wait for N of them to connect
+//   --tile N        tile size of the distributed mode, 64 by default
+//   --worker A:P    run as a worker of the coordinator at address A, port P
+//   --samples A:B   render samples [A, B) of every pixel into <output>_A-B.rtpart for tools/merge_samples
+//   --serve P       run as a render server on port P (0 picks a free one), taking jobs until shut down
+//   --heatmap M     also write the cost of every pixel, M = rays or cycles, to <output>_heat.png/.pfm
+//   --stats         print the render statistics: rays by kind, scatters per material, path lengths
+//   --stats-json F  write them to F as JSON (BVH counters need the RT_TRAVERSAL_STATS build option)
+//   --trace F       write a Chrome trace timeline to F (needs the RT_TRACE build option), give it
+//                   before --serve or --worker to trace those
+//   --progress      print pixels (tiles in the distributed mode) done, Mrays/s and ETA every second
+//   --status F      keep F updated with the same as JSON, for scripts and dashboards
+//   --background    render at idle priority, parking render threads while other work waits for CPU;
+//                   at most one thread per usable CPU
+int main(int argc, char** argv)
+{
+    const char* scene_path = nullptr;
+    long long sample_begin = -1;
+    long long sample_end = -1;
+    int worker_count = 0;
+    int port = 0;
+    int tile_size = 64;
+    bool spawn_workers = true;
+    bool print_stats = false;
+    rt::heatmap_metric heatmap_metric = rt::heatmap_metric::none;
+    const char* stats_path = nullptr;
+    bool print_progress = false;
+    std::string status_path;
+    bool background = false;
+    trace_output trace;
+    RT_TRACE_THREAD("main");
+
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--worker" && i + 1 < argc)
+            return worker_main(argv[++i]);
+        else if (arg == "--serve" && i + 1 < argc)
+            return server_main(std::atoi(argv[++i]));
+        else if (arg == "--workers" && i + 1 < argc)
+            worker_count = std::atoi(argv[++i]);
+        else if (arg == "--port" && i + 1 < argc)
+            port = std::atoi(argv[++i]);
+        else if (arg == "--tile" && i + 1 < argc)
+            tile_size = std::atoi(argv[++i]);
+        else if (arg == "--external")
+            spawn_workers = false;
+        else if (arg == "--heatmap" && i + 1 < argc) {
+            if (rt::parse_heatmap_metric(argv[++i], heatmap_metric) == false) {
+                std::cout << "--heatmap expects rays or cycles" << std::endl;
+                return 1;
+            }
+        }
+        else if (arg == "--stats")
+            print_stats = true;
+        else if (arg == "--trace" && i + 1 < argc) {
+            trace.path = argv[++i];
+            if (RT_TRACE == 0)
+                std::cout << "built without RT_TRACE, the trace will be empty" << std::endl;
+        }
+        else if (arg == "--stats-json" && i + 1 < argc)
+            stats_path = argv[++i];
+        else if (arg == "--progress")
+            print_progress = true;
+        else if (arg == "--status" && i + 1 < argc)
+            status_path = argv[++i];
+        else if (arg == "--background")
+            background = true;
+        else if (arg == "--samples" && i + 1 < argc) {
+            const std::string range = argv[++i];
+            const size_t colon = range.find(':');
+            sample_begin = std::atoll(range.c_str());
+            sample_end = colon != std::string::npos ? std::atoll(range.c_str() + colon + 1) : -1;
+            if (sample_begin < 0 || sample_end <= sample_begin || sample_end > 0xffffffff) {
+                std::cout << "--samples expects a range A:B with 0 <= A < B" << std::endl;
+                return 1;
+            }
+        }
+        else if (arg.starts_with("--") || scene_path != nullptr) {
+            std::cout << "unknown argument " << arg << std::endl;
+            return 1;
+        }
+        else
+            scene_path = argv[i];
+    }
 
-    rt::hit_record<fp_type> record;
+    rt::render_settings<fp_type> settings;
+    rt::scene_file file;
+    std::string error;
 
-    // NOTE: 0.001 instead of 0.0, fixing "shadow acne" problem
-    if (world.hit(r, fp_type(0.001), std::numeric_limits<fp_type>::infinity(), record)) {
-        rt::ray<fp_type> scattered;
-        rt::vec3<fp_type> attenuation;
+    if (scene_path != nullptr && (file.open(scene_path, error) == false || file.read_settings(settings, error) == false)) {
+        std::cout << scene_path << ", " << error << std::endl;
+        return 1;
+    }
 
-        if (record.material_ptr->scatter(r, record, attenuation, scattered))
-            return attenuation * ray_color(scattered, world, depth - 1, ray_count);
+    const bool animation = settings.frame_count > 1;
+    const std::string output_stem = settings.output.substr(0, settings.output.find_last_of('.'));
+    const std::string output_extension = settings.output.substr(output_stem.size());
 
-        return rt::vec3<fp_type>(0);
+    if ((worker_count > 0 || sample_end > 0) && animation) {
+        std::cout << "the distributed and sample range modes render single frames" << std::endl;
+        return 1;
+    }
+    if ((worker_count > 0 || sample_end > 0) && heatmap_metric != rt::heatmap_metric::none) {
+        std::cout << "--heatmap is for local renders, not the distributed and sample range modes" << std::endl;
+        return 1;
+    }
+    if (worker_count > 0 && background) {
+        std::cout << "--background is for local renders, start the workers at low priority instead" << std::endl;
+        return 1;
+    }
+    if (worker_count > 0 && sample_end > 0) {
+        std::cout << "--samples and --workers don't combine" << std::endl;
+        return 1;
     }
 
-    auto unit_direction = rt::unit_vector(r.direction);
-    fp_type t = fp_type(0.5) * (unit_direction.getY() + 1);
+    // NOTE: the first run builds the scene and its BVH and writes the cache, later runs map it.
+    // Animations keep the builder instead, its arrays are updated in place between frames.
+    auto load_start_t = std::chrono::high_resolution_clock::now();
 
-    //return (1 - t) * rt::vec3<fp_type>(1, 1, 1) + t * rt::vec3<fp_type>(0.5, 0.7, 1.0);
+    rt::scene_builder<fp_type> builder;
+    rt::scene_cache<fp_type> cache;
 
-    return rt::lerp(rt::vec3<fp_type>(1), rt::vec3<fp_type>(0.5, 0.7, 1.0), t);
-}
+    if (rt::load_scene(scene_path, file, animation == false, builder, cache, error) == false) {
+        std::cout << scene_path << ", " << error << std::endl;
+        return 1;
+    }
 
+    if (worker_count > 0) {
+        // NOTE: the scene was loaded for its cache, the workers map that instead of building
+        rt::socket_listener listener;
+        if (listener.listen(static_cast<uint16_t>(port)) == false) {
+            std::cout << "can't listen on port " << port << std::endl;
+            return 1;
+        }
+        std::cout << "Coordinator: port " << listener.port() << ", " << worker_count << " workers" << std::endl;
 
-// TODO: random generator is not thread safe
-void render(int shift, uint8_t* __restrict img, rt::hittable_list<fp_type>& world, rt::camera<fp_type>& cam, std::atomic<int>& ray_count)
-{
-    //int index = 1;
-    int ray_count_t = 0;
-    uint8_t* img_ptr = img + (shift * g_Channels);
+        std::vector<rt::child_process> workers(spawn_workers ? worker_count : 0);
+        const std::string executable = rt::executable_path(argv[0]);
+        for (auto& worker : workers) {
+            if (worker.start({ executable, "--worker", "127.0.0.1:" + std::to_string(listener.port()) }) == false)
+                std::cout << "can't start a worker" << std::endl;
+        }
 
-    for (int j = 0; j < g_ImageHeight; ++j) {
-        for (int i = shift; i < g_ImageWidth; i+=g_NumThreads) {
-            rt::vec3<fp_type> color(0, 0, 0);
+        auto start_t = std::chrono::high_resolution_clock::now();
 
-            for (int s = 0; s < g_SamplesPerPixel; ++s) {
-                fp_type v = fp_type(j + rt::s_random_gen()) / g_ImageHeight;
-                fp_type u = fp_type(i + rt::s_random_gen()) / g_ImageWidth;
+        const std::string worker_scene_path = scene_path != nullptr ? std::filesystem::absolute(scene_path).string() : std::string();
+        const uint64_t scene_key = scene_path != nullptr ? file.scene_key() : rt::random_scene_key();
 
-                auto r = cam.get_ray(u, v);
-                color += ray_color(r, world, g_MaxDepth, ray_count_t);
-            }
+        rt::render_coordinator coordinator(settings.width, settings.height, tile_size);
+        std::optional<rt::render_progress> progress;
+        if (print_progress || status_path.empty() == false) {
+            progress.emplace("tiles", coordinator.tile_count(), worker_count, print_progress, status_path);
+            progress->start();
+        }
 
-            color /= g_SamplesPerPixel;
+        std::vector<float> pixels;
+        const bool ok = coordinator.run(listener, worker_count, worker_scene_path, scene_key, pixels, error,
+                                        progress ? &*progress : nullptr);
+        if (progress)
+            progress->stop();
+
+        // NOTE: workers that never got through see the closed port and exit, nobody waits forever
+        listener.close();
+        if (ok == false) {
+            std::cout << "Coordinator: " << error << std::endl;
+            return 1;
+        }
+
+        auto time = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - start_t).count();
+        std::cout << "Tiles: " << coordinator.tile_count() << "\nTime: " << time << "ms\n";
 
-            auto final_color = rt::vector_sqrt(color) * static_cast<fp_type>(255.999);
-            img_ptr[0] = final_color.getX();
-            img_ptr[1] = final_color.getY();
-            img_ptr[2] = final_color.getZ();
-            img_ptr += g_NumThreads * g_Channels;
-
-            /*++index;
-            if (index == 400 + shift * 10) {
-                index = 0;
-                g_Info.update_thread(shift);
-            }*/
+        rt::framebuffer image(settings.width, settings.height);
+        {
+            RT_TRACE_SCOPE("tonemap");
+            for (size_t i = 0; i < pixels.size(); i += 3)
+                rt::store_color(rt::vec3<fp_type>(pixels[i], pixels[i + 1], pixels[i + 2]), image.rgb.data() + i);
         }
+
+        if (rt::write_image(output_stem, output_extension, image) == false) {
+            std::cout << "can't write " << output_stem << output_extension << std::endl;
+            return 1;
+        }
+
+        std::cout << "Done.\n";
+        return 0;
     }
 
-    ray_count.fetch_add(ray_count_t, std::memory_order::memory_order_relaxed);
-}
+    if (sample_end > 0) {
+        // NOTE: sums instead of an image, one node of a render farm; the partial images of all
+        // nodes are merged by tools/merge_samples
+        rt::scene_arena arena;
+        const rt::scene<fp_type> world = cache.is_open() ? cache.make_world(arena) : rt::make_world(builder, arena);
+        const rt::camera<fp_type> cam = settings.make_camera();
+
+        rt::partial_image image;
+        image.reset(settings.width, settings.height, scene_path != nullptr ? file.scene_key() : rt::random_scene_key(),
+                    static_cast<uint32_t>(sample_begin), static_cast<uint32_t>(sample_end));
+
+        std::optional<rt::render_progress> progress;
+        if (print_progress || status_path.empty() == false) {
+            progress.emplace("pixels", uint64_t(settings.width) * settings.height, settings.thread_count, print_progress, status_path);
+            progress->start();
+        }
 
-//void render(int shift, rt::vec3<uint8_t>* img, rt::hittable_list<fp_type>& world, rt::camera<fp_type>& cam, std::atomic<int>& ray_count)
-//{
-//    //int index = 1;
-//    int ray_count_t = 0;
-//
-//    for (int f = 0; f < 100; ++f) {
-//        rt::vec3<uint8_t>* img_ptr = img + shift;
-//        const fp_type lerpFac = fp_type(f) / (f + 1);
-//
-//        for (int j = 0; j < g_ImageHeight; ++j) {
-//            for (int i = shift; i < g_ImageWidth; i += g_NumThreads) {
-//                rt::vec3<fp_type> color(0, 0, 0);
-//
-//                for (int s = 0; s < g_SamplesPerPixel; ++s) {
-//                    fp_type v = fp_type(j + rt::s_random_gen()) / g_ImageHeight;
-//                    fp_type u = fp_type(i + rt::s_random_gen()) / g_ImageWidth;
-//
-//                    auto r = cam.get_ray(u, v);
-//                    color += ray_color(r, world, g_MaxDepth, ray_count_t);
-//                }
-//
-//                color /= fp_type(g_SamplesPerPixel);
-//                color = rt::vector_sqrt(color);// *static_cast<fp_type>(255.999);
-//
-//                rt::vec3<fp_type> prev(img_ptr->x, img_ptr->y, img_ptr->z);
-//                prev /= static_cast<fp_type>(255.999);
-//                color = (prev * lerpFac + color * (1 - lerpFac)) * static_cast<fp_type>(255.999);
-//
-//                *img_ptr = color;
-//                img_ptr += g_NumThreads;
-//
-//                /*++index;
-//                if (index == 400 + shift * 10) {
-//                    index = 0;
-//                    g_Info.update_thread(shift);
-//                }*/
-//            }
-//        }
-//    }
-//
-//    ray_count.fetch_add(ray_count_t, std::memory_order::memory_order_relaxed);
-//}
+        std::optional<rt::worker_throttle> throttle;
+        if (background) {
+            throttle.emplace(settings.thread_count);
+            throttle->start();
+        }
 
-int _cdecl main()
-{
-    auto look_from = rt::vec3<fp_type>(13.0, 2.0, 3.0);
-    auto look_at = rt::vec3<fp_type>(0.0, 0.0, 0.0);
-    auto up = rt::vec3<fp_type>(0.0, 1.0, 0.0);
-    const auto dist_to_focus = static_cast<fp_type>(10.0);
-    const auto aperture = static_cast<fp_type>(0.0);
-    const auto aspect_ratio = fp_type(g_ImageWidth) / g_ImageHeight;
+        auto start_t = std::chrono::high_resolution_clock::now();
+        const rt::render_stats stats = rt::render_samples(image, world, cam, settings, progress ? &*progress : nullptr,
+                                                          throttle ? &*throttle : nullptr);
+        if (progress)
+            progress->stop();
+        if (throttle)
+            throttle->stop();
+
+        auto time = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - start_t).count();
+        std::cout << "Samples: " << sample_begin << " to " << sample_end << "\nRays: " << stats.rays() << "\nTime: " << time << "ms\n";
+        print_mode(throttle ? &*throttle : nullptr, stats.rays(), double(time));
+        if (report_stats(stats, print_stats, stats_path) == false)
+            return 1;
+
+        const std::string stem = output_stem + "_" + std::to_string(sample_begin) + "-" + std::to_string(sample_end);
+        {
+            RT_TRACE_SCOPE("encode");
+            if (rt::write_partial_image((stem + ".rtpart").c_str(), image, error) == false) {
+                std::cout << error << std::endl;
+                return 1;
+            }
+        }
 
-    rt::camera<fp_type> cam(look_from, look_at, up,
-                            20.0, aspect_ratio,
-                            aperture, dist_to_focus);
+        // NOTE: the range on its own, as a preview; the same conversion as merge_samples
+        rt::framebuffer preview(settings.width, settings.height);
+        {
+            RT_TRACE_SCOPE("tonemap");
+            image.resolve_rgb8(preview.rgb);
+        }
+        if (rt::write_image(stem, output_extension, preview) == false) {
+            std::cout << "can't write " << stem << output_extension << std::endl;
+            return 1;
+        }
 
-    auto world = random_scene();
+        std::cout << "Done.\n";
+        return 0;
+    }
 
-    auto* img = new uint8_t[g_ImageHeight * g_ImageWidth * g_Channels];
+    // NOTE: two scene states, so that the next frame is updated while this one renders. Still
+    // geometry needs only one, the states then differ by camera.
+    const bool moving = animation && builder.motions.empty() == false;
+    rt::scene_builder<fp_type> next_builder;
+    if (moving)
+        next_builder = builder;
+
+    rt::scene_arena arena;
+    std::optional<rt::scene<fp_type>> worlds[2];
+    worlds[0].emplace(cache.is_open() ? cache.make_world(arena) : rt::make_world(builder, arena));
+    if (moving)
+        worlds[1].emplace(rt::make_world(next_builder, arena));
+
+    frame_state states[2] = {
+        { 0, &builder, &*worlds[0], settings.make_camera() },
+        { 0, moving ? &next_builder : &builder, moving ? &*worlds[1] : &*worlds[0], settings.make_camera() },
+    };
+
+    auto load_time = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - load_start_t).count();
+    std::cout << "Scene: " << worlds[0]->sphere_count() << " spheres, ";
+    if (worlds[0]->instance_count() > 0)
+        std::cout << worlds[0]->instance_count() << " instances, ";
+    std::cout << load_time << "ms"
+              << (cache.is_open() ? " (cached)" : "") << std::endl;
+
+    std::cout << "Pixels: " << settings.height * settings.width << std::endl;
+
+    // Three stage pipeline: the update thread prepares scene state and camera of frame k + 1 and
+    // the encode thread writes frame k - 1 while frame k renders. The queues are bounded by the
+    // two scene states and two images, so no stage runs more than a frame ahead.
+    rt::bounded_queue<int> free_states(2);
+    rt::bounded_queue<frame_job> ready_frames(1);
+    rt::bounded_queue<int> free_images(2);
+    rt::bounded_queue<frame_job> encode_frames(1);
+
+    rt::framebuffer images[2];
+    for (int i = 0; i < 2; ++i) {
+        images[i] = rt::framebuffer(settings.width, settings.height);
+        free_states.push(i);
+        free_images.push(i);
+    }
 
-    std::atomic<int> ray_count{ 0 };
+    double update_time = 0;
+    std::thread update_thread([&] {
+        RT_TRACE_THREAD("update");
+        for (int frame = 0; frame < settings.frame_count; ++frame) {
+            const int index = *free_states.pop();
+            frame_state& state = states[index];
+            RT_TRACE_SCOPE("update");
+
+            // NOTE: a refit is a linear pass over the nodes, the topology of the first frame's
+            // build is kept
+            auto start_t = std::chrono::high_resolution_clock::now();
+            if (moving && state.frame != frame) {
+                state.builder->advance(fp_type(frame - state.frame));
+                state.builder->refit();
+            }
+            state.frame = frame;
+            state.cam = settings.make_camera(frame);
+            update_time += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start_t).count();
 
-    std::cout << "Pixels: " << g_ImageHeight * g_ImageWidth << std::endl;
+            ready_frames.push({ frame, index, -1 });
+        }
+    });
+
+    auto frame_stem = [&](int frame) {
+        std::string stem = output_stem;
+        if (animation) {
+            char number[16];
+            std::snprintf(number, sizeof(number), "_%04d", frame);
+            stem += number;
+        }
+        return stem;
+    };
+
+    // NOTE: the first frame that couldn't be written, the pipeline goes on and main reports it
+    // after joining the thread
+    double encode_time = 0;
+    std::string encode_failure;
+    std::thread encode_thread([&] {
+        RT_TRACE_THREAD("encode");
+        for (int frame = 0; frame < settings.frame_count; ++frame) {
+            const frame_job job = *encode_frames.pop();
+            auto start_t = std::chrono::high_resolution_clock::now();
+
+            if (rt::write_image(frame_stem(job.frame), output_extension, images[job.image]) == false && encode_failure.empty())
+                encode_failure = frame_stem(job.frame) + output_extension;
+
+            encode_time += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start_t).count();
+            free_images.push(job.image);
+        }
+    });
+
+    auto sequence_start_t = std::chrono::high_resolution_clock::now();
+    double render_time = 0;
+    rt::render_stats sequence_stats;
+
+    // NOTE: a diagnostic, written on the render thread; without it render_frame() runs its plain loop
+    std::optional<rt::heatmap> costs;
+    if (heatmap_metric != rt::heatmap_metric::none)
+        costs.emplace(heatmap_metric, settings.width, settings.height);
+
+    // NOTE: over the whole sequence, the ETA of an animation is that of its last frame
+    std::optional<rt::render_progress> progress;
+    if (print_progress || status_path.empty() == false) {
+        progress.emplace("pixels", uint64_t(settings.width) * settings.height * settings.frame_count, settings.thread_count,
+                         print_progress, status_path);
+        progress->start();
+    }
 
-    std::vector<std::thread> threads;
+    // NOTE: one governor over the sequence, the frames go on where the last one left the workers
+    std::optional<rt::worker_throttle> throttle;
+    if (background) {
+        throttle.emplace(settings.thread_count);
+        throttle->start();
+    }
 
-    auto start_t = std::chrono::high_resolution_clock::now();
+    for (int frame = 0; frame < settings.frame_count; ++frame) {
+        frame_job job = *ready_frames.pop();
+        job.image = *free_images.pop();
+        const frame_state& state = states[job.state];
+
+        auto start_t = std::chrono::high_resolution_clock::now();
+        const rt::render_stats stats = rt::render_frame(images[job.image], *state.world, state.cam, settings, costs ? &*costs : nullptr,
+                                                        progress ? &*progress : nullptr, throttle ? &*throttle : nullptr);
+        sequence_stats += stats;
+
+        auto end_t = std::chrono::high_resolution_clock::now();
+        auto time = std::chrono::duration_cast<std::chrono::milliseconds>(end_t - start_t).count();
+        render_time += std::chrono::duration<double, std::milli>(end_t - start_t).count();
+
+        free_states.push(job.state);
+        encode_frames.push(job);
+
+        if (animation)
+            std::cout << "Frame " << frame << "\n";
+        std::cout << "Rays: " << stats.rays();
+        std::cout << "\nTime: " << time << "ms\n";
+        std::cout << "Rays\\s: " << (double(stats.rays()) / time * 1000) << "\n";
+
+        if (costs) {
+            const std::string heat_stem = frame_stem(frame) + "_heat";
+            if (rt::write_heatmap(heat_stem, *costs) == false)
+                std::cout << "can't write " << heat_stem << ".png" << std::endl;
+            else
+                std::cout << "Heatmap: " << heat_stem << ".png, " << rt::to_string(heatmap_metric) << " per pixel up to "
+                          << costs->high_cost() << " (99th percentile)\n";
+        }
+    }
 
-    for (int i = 0; i < g_NumThreads; ++i)
-        threads.emplace_back(render, i, img, world, cam, std::ref(ray_count));
-    for (auto& thread : threads)
-        thread.join();
+    if (progress)
+        progress->stop();
+    if (throttle)
+        throttle->stop();
+    print_mode(throttle ? &*throttle : nullptr, sequence_stats.rays(), render_time);
 
-    auto end_t = std::chrono::high_resolution_clock::now();
-    auto time = std::chrono::duration_cast<std::chrono::milliseconds>(end_t - start_t).count();
+    update_thread.join();
+    encode_thread.join();
 
-    std::cout << "Rays: " << ray_count;
-    std::cout << "\nTime: " << time << "ms\n";
-    std::cout << "Rays\\s: " << (double(ray_count) / time * 1000);
+    if (encode_failure.empty() == false) {
+        std::cout << "can't write " << encode_failure << std::endl;
+        return 1;
+    }
 
-    stbi_flip_vertically_on_write(true);
-    stbi_write_png("image.png", g_ImageWidth, g_ImageHeight, g_Channels, img, g_ImageWidth * g_Channels);
+    if (animation) {
+        auto sequence_time = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - sequence_start_t).count();
+        std::cout << "Sequence: " << settings.frame_count << " frames, " << sequence_time << "ms, render "
+                  << render_time << "ms, update " << update_time << "ms, encode " << encode_time << "ms (overlapped)\n";
+    }
 
-    std::cout << "\nDone.\n";
+    if (report_stats(sequence_stats, print_stats, stats_path) == false)
+        return 1;
 
-    delete[] img;
+    std::cout << "Done.\n";
 
     return 0;
 }
@@ -0,0 +1,414 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "common/json.hpp"
+#include "common/trace.hpp"
+#include "common/socket.hpp"
+
+
+// Render server: a long-lived process that takes render jobs from a local socket, so a service
+// pays for parsing the scene and building its BVH once instead of per job.
+//
+// render_job_queue schedules the jobs on one thread pool: every thread takes the next row of
+// the job with the highest priority (the oldest among equals), so a new urgent job gets the whole
+// pool as soon as the rows in flight are done, and a cancelled job stops within a row.
+// run_render_server() speaks the protocol: one JSON object per line and one per line back,
+//   { "op": "submit", ... }              -> { "id": 1 }, the members besides op and priority
+//                                           are the submit callback's business
+//   { "op": "status", "id": 1 }          -> { "id": 1, "state": "rendering", "progress": 0.25 }, only
+//                                           the latest finished jobs are remembered, older ones
+//                                           get "no such job"
+//   { "op": "cancel", "id": 1 }          -> the status after cancelling
+//   { "op": "shutdown" }                 -> { "state": "shutdown" }, queued jobs are still finished
+// Failed requests get { "error": "..." }.
+namespace rt
+{
+
+enum class render_job_state { queued, rendering, done, failed, cancelled };
+
+inline const char* to_string(render_job_state state)
+{
+    switch (state) {
+    case render_job_state::queued: return "queued";
+    case render_job_state::rendering: return "rendering";
+    case render_job_state::done: return "done";
+    case render_job_state::failed: return "failed";
+    case render_job_state::cancelled: return "cancelled";
+    }
+    return "unknown";
+}
+
+struct render_job_status
+{
+    uint64_t id = 0;
+    render_job_state state = render_job_state::queued;
+    float progress = 0;    // rows done / rows
+    std::string error;     // of a failed job
+};
+
+
+class render_job_queue
+{
+public:
+    // Finished, failed and cancelled jobs kept for status queries, the oldest are forgotten
+    static constexpr size_t max_finished_jobs = 1024;
+
+    // render_row(row) renders one row of a job, any rows of a job may run at the same time;
+    // finish(error) runs once after the last row, e.g. to write the image
+    using row_function = std::function<void(int)>;
+    using finish_function = std::function<bool(std::string&)>;
+
+    explicit render_job_queue(int thread_count)
+    {
+        for (int i = 0; i < std::max(thread_count, 1); ++i)
+            m_threads.emplace_back(&render_job_queue::work, this);
+    }
+
+    render_job_queue(const render_job_queue&) = delete;
+    render_job_queue& operator=(const render_job_queue&) = delete;
+
+    // Finishes the jobs that are left
+    ~render_job_queue()
+    {
+        {
+            std::unique_lock lock(m_mutex);
+            m_idle.wait(lock, [this] { return m_active.empty(); });
+            m_stopping = true;
+        }
+        m_work.notify_all();
+        for (auto& thread : m_threads)
+            thread.join();
+    }
+
+    // row_count must be positive
+    uint64_t submit(int priority, int row_count, row_function render_row, finish_function finish)
+    {
+        auto job = std::make_unique<render_job>();
+        job->priority = priority;
+        job->row_count = row_count;
+        job->render_row = std::move(render_row);
+        job->finish = std::move(finish);
+
+        uint64_t id;
+        {
+            std::lock_guard lock(m_mutex);
+            id = ++m_last_id;
+            job->id = id;
+            m_active.push_back(job.get());
+            m_jobs.emplace(id, std::move(job));
+        }
+        m_work.notify_all();
+        return id;
+    }
+
+    bool status(uint64_t id, render_job_status& status)
+    {
+        std::lock_guard lock(m_mutex);
+        const auto it = m_jobs.find(id);
+        if (it == m_jobs.end())
+            return false;
+
+        const render_job& job = *it->second;
+        status.id = id;
+        status.state = job.state;
+        status.progress = float(job.rows_done) / job.row_count;
+        status.error = job.error;
+        return true;
+    }
+
+    // False if there is no such job or it is past its last row. Rows in flight are finished
+    // and thrown away, no more are started.
+    bool cancel(uint64_t id)
+    {
+        std::lock_guard lock(m_mutex);
+        const auto it = m_jobs.find(id);
+        if (it == m_jobs.end())
+            return false;
+
+        render_job& job = *it->second;
+        if ((job.state != render_job_state::queued && job.state != render_job_state::rendering) || job.rows_done == job.row_count)
+            return false;
+
+        job.state = render_job_state::cancelled;
+        if (job.rows_active == 0)
+            retire(job);
+        return true;
+    }
+
+private:
+    struct render_job
+    {
+        uint64_t id = 0;
+        int priority = 0;
+        int row_count = 0;
+        int next_row = 0;
+        int rows_active = 0;
+        int rows_done = 0;
+        render_job_state state = render_job_state::queued;
+        std::string error;
+        row_function render_row;
+        finish_function finish;
+    };
+
+    // NOTE: with m_mutex held; finished jobs stay in m_jobs for status queries, without the
+    // callbacks and what they hold on to, until max_finished_jobs newer ones have finished
+    void retire(render_job& job)
+    {
+        job.render_row = nullptr;
+        job.finish = nullptr;
+        std::erase(m_active, &job);
+        if (m_active.empty())
+            m_idle.notify_all();
+
+        m_finished.push_back(job.id);
+        if (m_finished.size() > max_finished_jobs) {
+            m_jobs.erase(m_finished.front());
+            m_finished.pop_front();
+        }
+    }
+
+    // NOTE: with m_mutex held; m_active is in submit order, so the first of the highest
+    // priority is the oldest
+    render_job* next_job()
+    {
+        render_job* best = nullptr;
+        for (render_job* job : m_active) {
+            const bool runnable = job->state != render_job_state::cancelled && job->next_row < job->row_count;
+            if (runnable && (best == nullptr || job->priority > best->priority))
+                best = job;
+        }
+        return best;
+    }
+
+    void work()
+    {
+        RT_TRACE_THREAD("server pool");
+        std::unique_lock lock(m_mutex);
+        while (true) {
+            render_job* job = nullptr;
+            m_work.wait(lock, [&] { return m_stopping || (job = next_job()) != nullptr; });
+            if (job == nullptr)
+                return;
+
+            const int row = job->next_row++;
+            job->state = render_job_state::rendering;
+            ++job->rows_active;
+
+            lock.unlock();
+            job->render_row(row);
+            lock.lock();
+
+            --job->rows_active;
+            ++job->rows_done;
+
+            if (job->state == render_job_state::cancelled) {
+                if (job->rows_active == 0)
+                    retire(*job);
+            }
+            else if (job->rows_done == job->row_count) {
+                finish(*job, lock);
+            }
+        }
+    }
+
+    void finish(render_job& job, std::unique_lock<std::mutex>& lock)
+    {
+        // NOTE: the state stays `rendering` meanwhile, cancel() leaves a job alone once all its
+        // rows are done
+        std::string error;
+        lock.unlock();
+        const bool ok = job.finish(error);
+        lock.lock();
+
+        job.state = ok ? render_job_state::done : render_job_state::failed;
+        job.error = std::move(error);
+        retire(job);
+        m_work.notify_all();
+    }
+
+    std::mutex m_mutex;
+    std::condition_variable m_work;
+    std::condition_variable m_idle;
+    std::map<uint64_t, std::unique_ptr<render_job>> m_jobs;
+    std::vector<render_job*> m_active;    // not yet done, failed or retired after a cancel
+    std::deque<uint64_t> m_finished;      // ids of the retired jobs in m_jobs, oldest first
+    uint64_t m_last_id = 0;
+    bool m_stopping = false;
+    std::vector<std::thread> m_threads;
+};
+
+
+namespace detail
+{
+
+// Splits a stream into lines, for the line based protocol of the render server
+class line_reader
+{
+public:
+    explicit line_reader(socket_stream& stream)
+        : m_stream(stream)
+    {}
+
+    // False once the peer is gone or a line is unreasonably long
+    bool read_line(std::string& line)
+    {
+        constexpr size_t max_line = 1 << 20;
+        while (true) {
+            const size_t end = m_buffer.find('\n', m_scanned);
+            if (end != std::string::npos) {
+                line.assign(m_buffer, 0, end);
+                m_buffer.erase(0, end + 1);
+                m_scanned = 0;
+                return true;
+            }
+            m_scanned = m_buffer.size();
+            if (m_buffer.size() > max_line)
+                return false;
+
+            char chunk[4096];
+            const size_t received = m_stream.receive_some(chunk, sizeof(chunk));
+            if (received == 0)
+                return false;
+            m_buffer.append(chunk, received);
+        }
+    }
+
+private:
+    socket_stream& m_stream;
+    std::string m_buffer;
+    size_t m_scanned = 0;
+};
+
+inline std::string status_line(const render_job_status& status)
+{
+    std::string line = "{ \"id\": " + std::to_string(status.id) + ", \"state\": \"" + to_string(status.state)
+        + "\", \"progress\": " + std::to_string(status.progress);
+    if (status.error.empty() == false)
+        line += ", \"error\": " + json_quote(status.error);
+    return line + " }\n";
+}
+
+inline std::string error_line(const std::string& error)
+{
+    return "{ \"error\": " + json_quote(error) + " }\n";
+}
+
+} // namespace detail
+
+
+// Serves clients on `listener` until one of them sends shutdown, one thread per connection.
+// submit(request, priority, error) parses a submit request and queues its job, it returns the
+// job id or 0 with a reason in `error`; it may be called by several connections at once.
+template<typename SubmitFunc>
+void run_render_server(socket_listener& listener, render_job_queue& queue, SubmitFunc&& submit)
+{
+    struct connection
+    {
+        socket_stream stream;
+        std::thread thread;
+        std::atomic<bool> closed{ false };
+    };
+
+    std::atomic<bool> stopping{ false };
+    std::vector<std::unique_ptr<connection>> connections;
+
+    auto serve = [&](connection& client) {
+        detail::line_reader reader(client.stream);
+        std::string line;
+
+        while (stopping == false && reader.read_line(line)) {
+            json_value request;
+            std::string error;
+            std::string response;
+            const json_value* op = nullptr;
+            const json_value* id = nullptr;
+
+            if (parse_json(line, request, error) == false || request.is_object() == false
+                || (op = request.find("op")) == nullptr || op->is_string() == false) {
+                response = detail::error_line(error.empty() ? "expected an object with an \"op\"" : error);
+            }
+            else if (op->string == "submit") {
+                const json_value* priority_member = request.find("priority");
+                int priority = 0;
+                if (priority_member != nullptr && priority_member->get_number(priority) == false) {
+                    response = detail::error_line("priority must be a number in the range of int");
+                }
+                else {
+                    const uint64_t job = submit(request, priority, error);
+                    response = job != 0 ? "{ \"id\": " + std::to_string(job) + " }\n" : detail::error_line(error);
+                }
+            }
+            else if (op->string == "status" || op->string == "cancel") {
+                render_job_status status;
+                uint64_t job = 0;
+                if ((id = request.find("id")) == nullptr || id->get_number(job) == false) {
+                    response = detail::error_line("id must be a job id");
+                }
+                else {
+                    const bool cancelled = op->string == "cancel" && queue.cancel(job);
+                    if (queue.status(job, status) == false)
+                        response = detail::error_line("no such job");
+                    else if (op->string == "cancel" && cancelled == false)
+                        response = detail::error_line("job " + std::to_string(status.id) + " is already finishing or " + to_string(status.state));
+                    else
+                        response = detail::status_line(status);
+                }
+            }
+            else if (op->string == "shutdown") {
+                stopping = true;
+                response = "{ \"state\": \"shutdown\" }\n";
+            }
+            else {
+                response = detail::error_line("unknown op \"" + op->string + "\"");
+            }
+
+            if (client.stream.send_all(response.data(), response.size()) == false)
+                break;
+        }
+        client.closed = true;
+    };
+
+    // NOTE: accepting in slices, so that a shutdown request is seen; connections that are gone
+    // are joined on the way
+    while (stopping == false) {
+        socket_stream stream;
+        const bool accepted = listener.accept(stream, 100);
+
+        for (auto it = connections.begin(); it != connections.end();) {
+            if ((*it)->closed) {
+                (*it)->thread.join();
+                it = connections.erase(it);
+            }
+            else {
+                ++it;
+            }
+        }
+
+        if (accepted) {
+            auto client = std::make_unique<connection>();
+            client->stream = std::move(stream);
+            client->thread = std::thread(serve, std::ref(*client));
+            connections.push_back(std::move(client));
+        }
+    }
+
+    listener.close();
+    for (auto& client : connections) {
+        client->stream.shutdown();
+        client->thread.join();
+    }
+}
+
+} // namespace rt
@@ -1,14 +1,32 @@
 #pragma once
 
 #include <cassert>
-
-#define WIN32_LEAN_AND_MEAN
-#define NOMINMAX
-#include <Windows.h>
-
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#if defined(_WIN32)
+    #define WIN32_LEAN_AND_MEAN
+    #define NOMINMAX
+    #include <Windows.h>
+#elif RT_WINDOW_X11
+    #include <X11/Xlib.h>
+    #include <X11/Xutil.h>
+    #include <X11/keysym.h>
+#endif
+
+
+// The viewer's window: every PollEvents() lets the callback render a frame into a 32-bit BGRX
+// buffer, rows from the bottom, and shows it. Win32 on Windows, X11 elsewhere (RT_WINDOW_X11,
+// defined when CMake finds it); without X11 or a display the window is headless, it renders
+// headless_frames frames, prints their time and closes.
 namespace rt
 {
 
+#if defined(_WIN32)
+
 class window
 {
 public:
@@ -27,7 +45,7 @@ private:
     void CreateBuffer(const int width, const int height);
     void CopyBufferToWindow(HDC deviceContext) const;
 
-    void window::RenderGradient();
+    void RenderGradient();
 
 
     HWND m_windowHandle;
@@ -170,7 +188,7 @@ LRESULT window::HandleMessage(UINT message, WPARAM wParam, LPARAM lParam)
             CopyBufferToWindow(hdc);
 
             static char s_Buffer[200];
-            sprintf_s(s_Buffer, sizeof(s_Buffer), "frames %i\n", frame_count);
+            std::snprintf(s_Buffer, sizeof(s_Buffer), "frames %i\n", frame_count);
             RECT textRect;
             textRect.left = 5;
             textRect.top = 5;
@@ -266,4 +284,153 @@ void window::RenderGradient()
     }
 }
 
+#else
+
+class window
+{
+public:
+    using DrawCallback = void(*)(int width, int height, unsigned char* buffer, int frame_count);
+
+    static constexpr int headless_frames = 8;
+
+    window(const char* title, int width, int height, DrawCallback drawToBuffer);
+    ~window();
+
+    window(const window&) = delete;
+    window& operator=(const window&) = delete;
+
+    void PollEvents();
+    bool ShouldClose() const;
+
+private:
+    void DrawFrame();
+
+    int m_width;
+    int m_height;
+    bool m_windowShouldClose = false;
+    int m_frameCount = 0;
+    std::vector<unsigned char> m_buffer;    // BGRX, rows from the bottom like the Win32 DIB
+    DrawCallback m_drawToBuffer;
+    std::chrono::steady_clock::time_point m_start;
+
+#if RT_WINDOW_X11
+    void CopyBufferToWindow();
+
+    Display* m_display = nullptr;
+    Window m_windowHandle = 0;
+    GC m_gc = nullptr;
+    XImage* m_image = nullptr;
+    Atom m_deleteWindow = 0;
+#endif
+};
+
+
+inline window::window(const char* title, int width, int height, DrawCallback drawToBuffer)
+    : m_width(width)
+    , m_height(height)
+    , m_buffer(size_t(width) * height * 4)
+    , m_drawToBuffer(drawToBuffer)
+    , m_start(std::chrono::steady_clock::now())
+{
+#if RT_WINDOW_X11
+    // NOTE: no display (ssh, CI) is not an error, the window is headless then
+    m_display = XOpenDisplay(nullptr);
+    if (m_display == nullptr)
+        return;
+
+    const int screen = DefaultScreen(m_display);
+    m_windowHandle = XCreateSimpleWindow(m_display, RootWindow(m_display, screen), 0, 0, width, height, 0,
+                                         BlackPixel(m_display, screen), BlackPixel(m_display, screen));
+    XStoreName(m_display, m_windowHandle, title);
+
+    // NOTE: a fixed size, the buffer is not stretched like on Win32
+    XSizeHints hints{};
+    hints.flags = PMinSize | PMaxSize;
+    hints.min_width = hints.max_width = width;
+    hints.min_height = hints.max_height = height;
+    XSetWMNormalHints(m_display, m_windowHandle, &hints);
+
+    m_deleteWindow = XInternAtom(m_display, "WM_DELETE_WINDOW", False);
+    XSetWMProtocols(m_display, m_windowHandle, &m_deleteWindow, 1);
+    XSelectInput(m_display, m_windowHandle, KeyPressMask | StructureNotifyMask);
+    XMapWindow(m_display, m_windowHandle);
+
+    m_gc = XCreateGC(m_display, m_windowHandle, 0, nullptr);
+    // NOTE: the image owns its (top-down) copy of the buffer, XDestroyImage frees it
+    char* pixels = static_cast<char*>(std::malloc(m_buffer.size()));
+    m_image = XCreateImage(m_display, DefaultVisual(m_display, screen), DefaultDepth(m_display, screen), ZPixmap, 0,
+                           pixels, width, height, 32, width * 4);
+    assert(m_image != nullptr);
+#else
+    (void)title;
+#endif
+}
+
+inline window::~window()
+{
+#if RT_WINDOW_X11
+    if (m_display != nullptr) {
+        XDestroyImage(m_image);
+        XFreeGC(m_display, m_gc);
+        XDestroyWindow(m_display, m_windowHandle);
+        XCloseDisplay(m_display);
+    }
+#endif
+}
+
+inline bool window::ShouldClose() const
+{
+    return m_windowShouldClose;
+}
+
+inline void window::PollEvents()
+{
+#if RT_WINDOW_X11
+    if (m_display != nullptr) {
+        while (XPending(m_display) > 0) {
+            XEvent event;
+            XNextEvent(m_display, &event);
+            if ((event.type == ClientMessage && Atom(event.xclient.data.l[0]) == m_deleteWindow)
+                || (event.type == KeyPress && XLookupKeysym(&event.xkey, 0) == XK_Escape))
+                m_windowShouldClose = true;
+        }
+        if (m_windowShouldClose == false) {
+            DrawFrame();
+            CopyBufferToWindow();
+        }
+        return;
+    }
+#endif
+
+    DrawFrame();
+    if (m_frameCount == headless_frames) {
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - m_start).count();
+        std::printf("No display: %d frames headless, %.1f ms per frame\n", m_frameCount, seconds * 1000 / m_frameCount);
+        m_windowShouldClose = true;
+    }
+}
+
+inline void window::DrawFrame()
+{
+    m_drawToBuffer(m_width, m_height, m_buffer.data(), m_frameCount++);
+}
+
+#if RT_WINDOW_X11
+inline void window::CopyBufferToWindow()
+{
+    const size_t pitch = size_t(m_width) * 4;
+    for (int y = 0; y < m_height; ++y)
+        std::memcpy(m_image->data + y * pitch, m_buffer.data() + (m_height - 1 - y) * pitch, pitch);
+    XPutImage(m_display, m_windowHandle, m_gc, m_image, 0, 0, 0, 0, m_width, m_height);
+
+    char text[32];
+    const int length = std::snprintf(text, sizeof(text), "frames %i", m_frameCount);
+    XSetForeground(m_display, m_gc, WhitePixel(m_display, DefaultScreen(m_display)));
+    XDrawString(m_display, m_windowHandle, m_gc, 5, 15, text, length);
+    XFlush(m_display);
+}
+#endif
+
+#endif // _WIN32
+
 } // namespace rt
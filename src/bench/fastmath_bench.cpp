@@ -0,0 +1,237 @@
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "common/rt_math.hpp"
+
+
+// Accuracy and throughput of rt::fastmath against libm. The error sweep is what the
+// documented bounds in rt_math.hpp come from. The _ps kernels are x86 only (RT_X86).
+
+namespace
+{
+
+const int g_Count = 1 << 20;
+const int g_Repeats = 50;
+
+volatile float g_Sink;
+
+
+template<typename Func>
+double time_ns_per_op(Func&& func)
+{
+    double best = std::numeric_limits<double>::max();
+
+    for (int r = 0; r < 5; ++r) {
+        auto start_t = std::chrono::high_resolution_clock::now();
+        for (int i = 0; i < g_Repeats; ++i)
+            func();
+        auto end_t = std::chrono::high_resolution_clock::now();
+
+        double ns = std::chrono::duration<double, std::nano>(end_t - start_t).count();
+        best = std::min(best, ns / (double(g_Repeats) * g_Count));
+    }
+
+    return best;
+}
+
+void report(const char* name, double libm_ns, double fast_ns, double max_error)
+{
+    std::cout << std::left << std::setw(10) << name << std::right
+              << std::setw(12) << std::setprecision(3) << std::fixed << libm_ns << " ns"
+              << std::setw(12) << fast_ns << " ns"
+              << std::setw(10) << std::setprecision(2) << libm_ns / fast_ns << 'x'
+              << std::setw(14) << std::setprecision(3) << std::scientific << max_error << '\n';
+}
+
+std::vector<float> make_input(float min, float max)
+{
+    std::minstd_rand engine(456);
+    std::uniform_real_distribution<float> dist(min, max);
+
+    std::vector<float> input(g_Count);
+    for (auto& x : input)
+        x = dist(engine);
+
+    return input;
+}
+
+} // namespace
+
+
+int main()
+{
+    std::cout << "kernel          libm        fast   speedup     max error\n";
+
+    // sincos, abs error over the sampling range [0, 2pi] and a wide range
+    {
+        auto input = make_input(0, 2 * std::numbers::pi_v<float>);
+        auto wide = make_input(-8192, 8192);
+        double max_error = 0;
+
+        for (const auto* in : { &input, &wide }) {
+            for (float x : *in) {
+                float s, c;
+                rt::fastmath::sincos(x, s, c);
+                max_error = std::max(max_error, std::abs(s - std::sin(double(x))));
+                max_error = std::max(max_error, std::abs(c - std::cos(double(x))));
+
+#if RT_X86
+                alignas(16) float xs[4] = { x, x, x, x };
+                alignas(16) float ss[4], cs[4];
+                __m128 cv;
+                _mm_store_ps(ss, rt::fastmath::sincos_ps(_mm_load_ps(xs), cv));
+                _mm_store_ps(cs, cv);
+                max_error = std::max(max_error, std::abs(ss[0] - std::sin(double(x))));
+                max_error = std::max(max_error, std::abs(cs[0] - std::cos(double(x))));
+#endif
+            }
+        }
+
+        auto libm = time_ns_per_op([&] {
+            float acc = 0;
+            for (float x : input)
+                acc += std::sin(x) + std::cos(x);
+            g_Sink = acc;
+        });
+        auto fast = time_ns_per_op([&] {
+            float acc = 0;
+            for (float x : input) {
+                float s, c;
+                rt::fastmath::sincos(x, s, c);
+                acc += s + c;
+            }
+            g_Sink = acc;
+        });
+        report("sincos", libm, fast, max_error);
+#if RT_X86
+        auto fast_ps = time_ns_per_op([&] {
+            __m128 acc = _mm_setzero_ps();
+            for (int i = 0; i < g_Count; i += 4) {
+                __m128 c;
+                __m128 s = rt::fastmath::sincos_ps(_mm_loadu_ps(&input[i]), c);
+                acc = _mm_add_ps(acc, _mm_add_ps(s, c));
+            }
+            g_Sink = _mm_cvtss_f32(acc);
+        });
+        report("sincos_ps", libm, fast_ps, max_error);
+#endif
+    }
+
+    // cbrt, relative error
+    {
+        auto input = make_input(0, 1);
+        auto wide = make_input(-1e6f, 1e6f);
+        double max_error = 0;
+
+        for (const auto* in : { &input, &wide }) {
+            for (float x : *in) {
+                if (x == 0)
+                    continue;
+                const double expected = std::cbrt(double(x));
+                max_error = std::max(max_error, std::abs((rt::fastmath::cbrt(x) - expected) / expected));
+
+#if RT_X86
+                float out[4];
+                _mm_storeu_ps(out, rt::fastmath::cbrt_ps(_mm_set1_ps(x)));
+                max_error = std::max(max_error, std::abs((out[0] - expected) / expected));
+#endif
+            }
+        }
+
+        auto libm = time_ns_per_op([&] {
+            float acc = 0;
+            for (float x : input)
+                acc += std::cbrt(x);
+            g_Sink = acc;
+        });
+        auto fast = time_ns_per_op([&] {
+            float acc = 0;
+            for (float x : input)
+                acc += rt::fastmath::cbrt(x);
+            g_Sink = acc;
+        });
+        report("cbrt", libm, fast, max_error);
+#if RT_X86
+        auto fast_ps = time_ns_per_op([&] {
+            __m128 acc = _mm_setzero_ps();
+            for (int i = 0; i < g_Count; i += 4)
+                acc = _mm_add_ps(acc, rt::fastmath::cbrt_ps(_mm_loadu_ps(&input[i])));
+            g_Sink = _mm_cvtss_f32(acc);
+        });
+        report("cbrt_ps", libm, fast_ps, max_error);
+#endif
+    }
+
+    // rsqrt, relative error
+    {
+        auto input = make_input(1e-6f, 1e6f);
+        double max_error = 0;
+
+        for (float x : input) {
+            const double expected = 1 / std::sqrt(double(x));
+            max_error = std::max(max_error, std::abs((rt::fastmath::rsqrt(x) - expected) / expected));
+
+#if RT_X86
+            float out[4];
+            _mm_storeu_ps(out, rt::fastmath::rsqrt_ps(_mm_set1_ps(x)));
+            max_error = std::max(max_error, std::abs((out[0] - expected) / expected));
+#endif
+        }
+
+        auto libm = time_ns_per_op([&] {
+            float acc = 0;
+            for (float x : input)
+                acc += 1 / std::sqrt(x);
+            g_Sink = acc;
+        });
+        auto fast = time_ns_per_op([&] {
+            float acc = 0;
+            for (float x : input)
+                acc += rt::fastmath::rsqrt(x);
+            g_Sink = acc;
+        });
+        report("rsqrt", libm, fast, max_error);
+#if RT_X86
+        auto fast_ps = time_ns_per_op([&] {
+            __m128 acc = _mm_setzero_ps();
+            for (int i = 0; i < g_Count; i += 4)
+                acc = _mm_add_ps(acc, rt::fastmath::rsqrt_ps(_mm_loadu_ps(&input[i])));
+            g_Sink = _mm_cvtss_f32(acc);
+        });
+        report("rsqrt_ps", libm, fast_ps, max_error);
+#endif
+    }
+
+    // pow(x, 5) vs the unrolled integer power
+    {
+        auto input = make_input(0, 1);
+        double max_error = 0;
+
+        for (float x : input) {
+            const double expected = std::pow(double(x), 5.0);
+            if (expected > 0)
+                max_error = std::max(max_error, std::abs((rt::pow<5>(x) - expected) / expected));
+        }
+
+        auto libm = time_ns_per_op([&] {
+            float acc = 0;
+            for (float x : input)
+                acc += std::pow(x, 5.0f);
+            g_Sink = acc;
+        });
+        auto fast = time_ns_per_op([&] {
+            float acc = 0;
+            for (float x : input)
+                acc += rt::pow<5>(x);
+            g_Sink = acc;
+        });
+
+        report("pow5", libm, fast, max_error);
+    }
+
+    return 0;
+}
@@ -0,0 +1,134 @@
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <numbers>
+
+#include "common/vec3.hpp"
+#include "common/ray.hpp"
+#include "common/utility.hpp"
+#include "common/camera.hpp"
+
+#include "rtcore/triangle_mesh.hpp"
+
+
+// BVH build and primary ray throughput on a generated torus mesh, with the 8-wide AVX leaf
+// test against the one-triangle-at-a-time loop. Rays shot from inside the closed torus check
+// that the watertight test has no leaks.
+// usage: bench_mesh [grid resolution = 1200]   (2 * grid^2 triangles)
+
+using fp_type = float;
+
+namespace
+{
+
+using clock_type = std::chrono::high_resolution_clock;
+
+double elapsed_ms(clock_type::time_point start_t)
+{
+    return std::chrono::duration<double, std::milli>(clock_type::now() - start_t).count();
+}
+
+const fp_type g_MajorRadius = 2;
+const fp_type g_MinorRadius = fp_type(0.6);
+
+// closed torus with a small ripple, so neighbouring triangles are not coplanar
+void make_torus(rt::triangle_mesh<fp_type>& mesh, int grid)
+{
+    const fp_type two_pi = 2 * std::numbers::pi_v<fp_type>;
+
+    mesh.x.resize(size_t(grid) * grid);
+    mesh.y.resize(size_t(grid) * grid);
+    mesh.z.resize(size_t(grid) * grid);
+
+    for (int i = 0; i < grid; ++i) {
+        for (int j = 0; j < grid; ++j) {
+            fp_type phi = two_pi * i / grid;
+            fp_type theta = two_pi * j / grid;
+            fp_type minor = g_MinorRadius * (1 + fp_type(0.05) * std::sin(8 * phi) * std::sin(8 * theta));
+            size_t index = size_t(i) * grid + j;
+            mesh.x[index] = (g_MajorRadius + minor * std::cos(theta)) * std::cos(phi);
+            mesh.y[index] = minor * std::sin(theta);
+            mesh.z[index] = (g_MajorRadius + minor * std::cos(theta)) * std::sin(phi);
+        }
+    }
+
+    mesh.indices.reserve(size_t(grid) * grid * 6);
+    for (int i = 0; i < grid; ++i) {
+        for (int j = 0; j < grid; ++j) {
+            uint32_t a = i * grid + j;
+            uint32_t b = ((i + 1) % grid) * grid + j;
+            uint32_t c = ((i + 1) % grid) * grid + (j + 1) % grid;
+            uint32_t d = i * grid + (j + 1) % grid;
+            mesh.indices.insert(mesh.indices.end(), { a, b, c, a, c, d });
+        }
+    }
+}
+
+template<bool Wide>
+void trace_primary(const rt::triangle_mesh<fp_type>& mesh, const char* name)
+{
+    const int width = 512;
+    const int height = 256;
+
+    rt::camera<fp_type> cam(rt::vec3<fp_type>(0, 4, 6), rt::vec3<fp_type>(0, 0, 0), rt::vec3<fp_type>(0, 1, 0),
+                            40, fp_type(width) / height, 0, 1);
+
+    int hits = 0;
+    double t_sum = 0;
+    auto start_t = clock_type::now();
+
+    for (int j = 0; j < height; ++j) {
+        for (int i = 0; i < width; ++i) {
+            auto r = cam.get_ray<false>(fp_type(i + 0.5) / width, fp_type(j + 0.5) / height);
+            rt::hit_record<fp_type> rec;
+            if (mesh.intersect<Wide>(r, 0, std::numeric_limits<fp_type>::infinity(), rec)) {
+                ++hits;
+                t_sum += rec.t;
+            }
+        }
+    }
+
+    auto ms = elapsed_ms(start_t);
+    std::cout << name << ": " << ms << "ms  " << width * height / ms / 1000 << " Mrays/s"
+              << "  (hits " << hits << ", sum t " << t_sum << ")\n";
+}
+
+template<bool Wide>
+void check_leaks(const rt::triangle_mesh<fp_type>& mesh, int ray_count)
+{
+    int leaks = 0;
+    for (int i = 0; i < ray_count; ++i) {
+        rt::ray<fp_type> r(rt::vec3<fp_type>(g_MajorRadius, 0, 0), rt::s_random_gen.random_vec3_lambertian());
+        rt::hit_record<fp_type> rec;
+        leaks += mesh.intersect<Wide>(r, 0, std::numeric_limits<fp_type>::infinity(), rec) == false;
+    }
+
+    std::cout << "leaks from inside: " << leaks << '/' << ray_count << '\n';
+}
+
+} // namespace
+
+
+int main(int argc, char** argv)
+{
+    const int grid = argc > 1 ? std::atoi(argv[1]) : 1200;
+
+    rt::triangle_mesh<fp_type> mesh(nullptr);
+    make_torus(mesh, grid);
+
+    std::cout << "Triangles: " << mesh.triangle_count() << "\nVertices: " << mesh.vertex_count() << '\n';
+
+    auto start_t = clock_type::now();
+    mesh.build();
+    std::cout << "BVH build: " << elapsed_ms(start_t) << "ms, "
+              << mesh.acceleration_bytes() / (1024 * 1024) << "MB\n";
+
+#if defined(__AVX__)
+    trace_primary<true>(mesh, "8-wide leaves");
+    check_leaks<true>(mesh, 1 << 18);
+#endif
+    trace_primary<false>(mesh, "scalar leaves");
+    check_leaks<false>(mesh, 1 << 18);
+
+    return 0;
+}
@@ -0,0 +1,447 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "common/vec3.hpp"
+#include "common/ray.hpp"
+#include "common/utility.hpp"
+#include "common/camera.hpp"
+#include "common/arena.hpp"
+#include "common/json.hpp"
+#include "common/perf_counters.hpp"
+
+#include "rtcore/hittable_list.hpp"
+#include "rtcore/sphere.hpp"
+#include "rtcore/material.hpp"
+#include "rtcore/scene.hpp"
+
+
+// Microbenchmarks of the kernels under the render loop: intersection, camera rays, material
+// scattering, the samplers of random_generator and vec3 arithmetic. Every kernel runs in batches
+// over a fixed, seeded input set; a batch is sized to take about 10ms, and the statistics are
+// over `samples` batches after a warm-up batch. The vec3 kernels measure the backend the build
+// selected (VEC3_SIMD, see common/vec3.hpp), compare two builds' output for scalar against AVX.
+// hittable_list::hit/N and scene::hit/N test the same spheres, linearly and through the BVH.
+//
+// usage: rt_bench [--filter text] [--samples N] [--perf] [--json path] [--csv path]
+//   --filter    only kernels whose name contains `text`
+//   --samples   timed batches per kernel, 20 by default
+//   --perf      hardware counters per op over the timed batches (Linux, common/perf_counters.hpp)
+//   --json/csv  also write the results there, for regression tracking
+
+using fp_type = float;
+
+namespace
+{
+
+using clock_type = std::chrono::high_resolution_clock;
+using vec3_fp = rt::vec3<fp_type>;
+using ray_type = rt::ray<fp_type>;
+
+// NOTE: inputs are cycled through, 4096 of them stay in L1/L2 so that the kernel is measured
+// rather than memory
+const int g_InputCount = 4096;
+
+volatile fp_type g_Sink;
+
+
+struct bench_result
+{
+    std::string name;
+    long long batch;       // ops per sample
+    int samples;
+    double ns_median;      // per op
+    double ns_mean;
+    double ns_min;
+    double ns_stddev;
+    rt::perf_sample perf;  // over all timed batches, samples * batch ops
+
+    double ops_per_second() const
+    {
+        return 1e9 / ns_median;
+    }
+};
+
+
+// `kernel(count)` runs `count` ops and returns something derived from their results, which
+// goes to g_Sink so that the work is not optimized away. With `perf` the timed batches are
+// counted as well.
+bench_result run(const std::string& name, int samples, const std::function<fp_type(long long)>& kernel, rt::perf_counters* perf)
+{
+    long long batch = 1024;
+    while (true) {
+        auto start_t = clock_type::now();
+        g_Sink = kernel(batch);
+        const double ms = std::chrono::duration<double, std::milli>(clock_type::now() - start_t).count();
+        if (ms >= 10 || batch >= (1ll << 34))
+            break;
+        batch *= ms > 0.5 ? std::max<long long>(2, static_cast<long long>(10 / ms)) : 16;
+    }
+
+    // NOTE: the counters run across the clock reads too, 2 of them per 10ms batch are noise
+    if (perf != nullptr)
+        perf->start();
+    std::vector<double> ns(samples);
+    for (auto& sample : ns) {
+        auto start_t = clock_type::now();
+        g_Sink = kernel(batch);
+        sample = std::chrono::duration<double, std::nano>(clock_type::now() - start_t).count() / batch;
+    }
+    const rt::perf_sample counters = perf != nullptr ? perf->stop() : rt::perf_sample{};
+
+    double mean = 0;
+    for (double x : ns)
+        mean += x;
+    mean /= samples;
+
+    double variance = 0;
+    for (double x : ns)
+        variance += (x - mean) * (x - mean);
+    variance /= std::max(samples - 1, 1);
+
+    std::sort(ns.begin(), ns.end());
+    const double median = samples % 2 ? ns[samples / 2] : (ns[samples / 2 - 1] + ns[samples / 2]) / 2;
+
+    return { name, batch, samples, median, mean, ns.front(), std::sqrt(variance), counters };
+}
+
+// Per op, "-" for events that weren't counted
+void print_perf(const rt::perf_sample& perf, double ops)
+{
+    auto column = [&](rt::perf_event event, int width) {
+        if (perf.has(event))
+            std::cout << std::setw(width) << std::setprecision(2) << perf[event] / ops;
+        else
+            std::cout << std::setw(width) << '-';
+    };
+    column(rt::perf_event::cycles, 10);
+    if (perf.has(rt::perf_event::cycles) && perf.has(rt::perf_event::instructions) && perf[rt::perf_event::cycles] > 0)
+        std::cout << std::setw(6) << std::setprecision(2) << perf[rt::perf_event::instructions] / perf[rt::perf_event::cycles];
+    else
+        std::cout << std::setw(6) << '-';
+    column(rt::perf_event::l1d_misses, 9);
+    column(rt::perf_event::llc_misses, 9);
+    column(rt::perf_event::branch_misses, 9);
+}
+
+void print(const bench_result& result, bool perf)
+{
+    std::cout << std::left << std::setw(36) << result.name << std::right << std::fixed
+              << std::setw(10) << std::setprecision(3) << result.ns_median << " ns"
+              << std::setw(10) << std::setprecision(3) << result.ns_min << " ns"
+              << std::setw(8) << std::setprecision(1) << 100 * result.ns_stddev / result.ns_mean << " %"
+              << std::setw(12) << std::setprecision(2) << result.ops_per_second() / 1e6;
+    if (perf)
+        print_perf(result.perf, double(result.batch) * result.samples);
+    std::cout << '\n';
+}
+
+bool write_json(const char* path, const std::vector<bench_result>& results)
+{
+    std::ofstream out(path);
+    out << "{\n    \"arch\": " << rt::json_quote(RT_ARCH_NAME) << ",\n    \"vec3_backend\": " << rt::json_quote(rt::vec3_backend)
+        << ",\n    \"fast_math\": " << RT_FAST_MATH
+        << ",\n    \"results\": [\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const auto& r = results[i];
+        out << "        { \"name\": " << rt::json_quote(r.name) << ", \"ns_per_op\": " << r.ns_median
+            << ", \"ns_mean\": " << r.ns_mean << ", \"ns_min\": " << r.ns_min << ", \"ns_stddev\": " << r.ns_stddev
+            << ", \"ops_per_s\": " << r.ops_per_second() << ", \"samples\": " << r.samples << ", \"batch\": " << r.batch
+            << ", \"perf_per_op\": " << rt::perf_json(r.perf, double(r.batch) * r.samples) << " }" << (i + 1 < results.size() ? "," : "") << '\n';
+    }
+    out << "    ]\n}\n";
+    return out.good();
+}
+
+bool write_csv(const char* path, const std::vector<bench_result>& results)
+{
+    std::ofstream out(path);
+    out << "name,arch,vec3_backend,ns_per_op,ns_mean,ns_min,ns_stddev,ops_per_s,samples,batch";
+    for (int i = 0; i < rt::perf_sample::event_count; ++i)
+        out << ',' << rt::to_string(rt::perf_event(i)) << "_per_op";
+    out << '\n';
+
+    // NOTE: empty fields for events that weren't counted
+    for (const auto& r : results) {
+        out << r.name << ',' << RT_ARCH_NAME << ',' << rt::vec3_backend << ',' << r.ns_median << ',' << r.ns_mean << ',' << r.ns_min << ','
+            << r.ns_stddev << ',' << r.ops_per_second() << ',' << r.samples << ',' << r.batch;
+        for (int i = 0; i < rt::perf_sample::event_count; ++i) {
+            out << ',';
+            if (r.perf.valid[i])
+                out << r.perf.value[i] / (double(r.batch) * r.samples);
+        }
+        out << '\n';
+    }
+    return out.good();
+}
+
+
+// Fixed inputs: points in a box and unit directions, from a seeded generator
+struct inputs
+{
+    std::vector<vec3_fp> points;
+    std::vector<vec3_fp> directions;
+    std::vector<fp_type> numbers;    // [0, 1)
+
+    inputs()
+    {
+        rt::random_generator<fp_type, std::minstd_rand> random_gen;
+        for (int i = 0; i < g_InputCount; ++i) {
+            points.push_back(random_gen.random_vec3(-1, 1));
+            directions.push_back(rt::unit_vector(random_gen.random_vec3(-1, 1) + vec3_fp(0, 0, fp_type(-0.01))));
+            numbers.push_back(random_gen());
+        }
+    }
+};
+
+// Rays from a ring around the origin towards points near it, about half of them hit the
+// unit spheres the intersection kernels test against
+std::vector<ray_type> make_rays(const inputs& in)
+{
+    std::vector<ray_type> rays;
+    for (int i = 0; i < g_InputCount; ++i) {
+        const vec3_fp origin = in.points[i] * fp_type(0.5) + vec3_fp(0, 0, 6);
+        rays.emplace_back(origin, rt::unit_vector(in.points[(i * 7 + 1) % g_InputCount] * fp_type(1.5) - origin));
+    }
+    return rays;
+}
+
+} // namespace
+
+
+int main(int argc, char** argv)
+{
+    std::string filter;
+    int samples = 20;
+    const char* json_path = nullptr;
+    const char* csv_path = nullptr;
+    bool use_perf = false;
+
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--filter" && i + 1 < argc)
+            filter = argv[++i];
+        else if (arg == "--samples" && i + 1 < argc)
+            samples = std::max(std::atoi(argv[++i]), 2);
+        else if (arg == "--perf")
+            use_perf = true;
+        else if (arg == "--json" && i + 1 < argc)
+            json_path = argv[++i];
+        else if (arg == "--csv" && i + 1 < argc)
+            csv_path = argv[++i];
+        else {
+            std::cerr << "usage: rt_bench [--filter text] [--samples N] [--perf] [--json path] [--csv path]\n";
+            return 2;
+        }
+    }
+
+    // NOTE: without counters (no permission, no PMU in a VM) the timings are still worth having
+    rt::perf_counters perf;
+    if (use_perf) {
+        std::string error;
+        if (perf.open(error) == false) {
+            std::cerr << "no hardware counters: " << error << '\n';
+            use_perf = false;
+        }
+    }
+
+    const inputs in;
+    const std::vector<ray_type> rays = make_rays(in);
+    const int mask = g_InputCount - 1;
+
+    std::vector<bench_result> results;
+    auto bench = [&](const std::string& name, const std::function<fp_type(long long)>& kernel) {
+        if (name.find(filter) == std::string::npos)
+            return;
+        results.push_back(run(name, samples, kernel, use_perf ? &perf : nullptr));
+        print(results.back(), use_perf);
+    };
+
+    std::cout << "arch: " << RT_ARCH_NAME << ", vec3 backend: " << rt::vec3_backend << ", fast math: " << RT_FAST_MATH << '\n'
+              << "kernel                               median        min  stddev     Mops/s";
+    if (use_perf)
+        std::cout << "  cycles/op   IPC   L1D/op   LLC/op    br/op";
+    std::cout << '\n';
+
+    rt::scene_arena arena;
+    const auto* diffuse = arena.make_material<rt::lambertian<fp_type>>(vec3_fp(fp_type(0.5)));
+
+    // ---- intersection ----
+    {
+        const rt::sphere<fp_type> sphere(vec3_fp(0), 1, diffuse);
+        bench("sphere::hit", [&](long long count) {
+            fp_type acc = 0;
+            rt::hit_record<fp_type> record;
+            for (long long i = 0; i < count; ++i) {
+                if (sphere.hit(rays[i & mask], fp_type(0.001), std::numeric_limits<fp_type>::infinity(), record))
+                    acc += record.t;
+            }
+            return acc;
+        });
+
+        for (int size : { 1, 4, 16, 64, 256 }) {
+            rt::hittable_list<fp_type> list;
+            rt::random_generator<fp_type, std::minstd_rand> random_gen;
+            for (int i = 0; i < size; ++i)
+                list.add(arena.make_primitive<rt::sphere<fp_type>>(random_gen.random_vec3(-2, 2), fp_type(0.3), diffuse));
+
+            // NOTE: ns per ray, not per sphere test
+            bench("hittable_list::hit/" + std::to_string(size), [&](long long count) {
+                fp_type acc = 0;
+                rt::hit_record<fp_type> record;
+                for (long long i = 0; i < count; ++i) {
+                    if (list.hit(rays[i & mask], fp_type(0.001), std::numeric_limits<fp_type>::infinity(), record))
+                        acc += record.t;
+                }
+                return acc;
+            });
+
+            // NOTE: the same spheres as the list above, behind the BVH
+            rt::scene_builder<fp_type> builder;
+            const uint32_t material_id = builder.add_lambertian(vec3_fp(fp_type(0.5)));
+            rt::random_generator<fp_type, std::minstd_rand> same_gen;
+            for (int i = 0; i < size; ++i)
+                builder.add_sphere(same_gen.random_vec3(-2, 2), fp_type(0.3), material_id);
+            builder.build();
+            const auto world = rt::make_world(builder, arena);
+
+            bench("scene::hit/" + std::to_string(size), [&](long long count) {
+                fp_type acc = 0;
+                rt::hit_record<fp_type> record;
+                for (long long i = 0; i < count; ++i) {
+                    if (world.hit(rays[i & mask], fp_type(0.001), std::numeric_limits<fp_type>::infinity(), record))
+                        acc += record.t;
+                }
+                return acc;
+            });
+        }
+    }
+
+    // ---- camera ----
+    {
+        const rt::camera<fp_type> pinhole(vec3_fp(13, 2, 3), vec3_fp(0), vec3_fp(0, 1, 0), 20, 2, 0, 10);
+        const rt::camera<fp_type> thin_lens(vec3_fp(13, 2, 3), vec3_fp(0), vec3_fp(0, 1, 0), 20, 2, fp_type(0.1), 10);
+        const rt::camera<fp_type> motion_blur(vec3_fp(13, 2, 3), vec3_fp(0), vec3_fp(0, 1, 0), 20, 2, 0, 10, 0, 1);
+
+        auto get_rays = [&](const rt::camera<fp_type>& cam, auto thin_lens_tag) {
+            return [&, thin_lens_tag](long long count) {
+                fp_type acc = 0;
+                for (long long i = 0; i < count; ++i) {
+                    const auto r = cam.template get_ray<decltype(thin_lens_tag)::value>(in.numbers[i & mask], in.numbers[(i + 1) & mask]);
+                    acc += r.direction.getX();
+                }
+                return acc;
+            };
+        };
+        bench("camera::get_ray/pinhole", get_rays(pinhole, std::false_type{}));
+        bench("camera::get_ray/thin_lens", get_rays(thin_lens, std::true_type{}));
+        bench("camera::get_ray/motion_blur", get_rays(motion_blur, std::false_type{}));
+
+        rt::camera_ray_table<fp_type> ray_table;
+        ray_table.update(pinhole, 256, 128);
+        bench("camera_ray_table::get_ray", [&](long long count) {
+            fp_type acc = 0;
+            for (long long i = 0; i < count; ++i) {
+                const auto r = ray_table.get_ray<false>(int(i & 255), int((i >> 8) & 127), in.numbers[i & mask], in.numbers[(i + 1) & mask]);
+                acc += r.direction.getX();
+            }
+            return acc;
+        });
+    }
+
+    // ---- materials ----
+    {
+        const rt::lambertian<fp_type> lambertian(vec3_fp(fp_type(0.5)));
+        const rt::metal<fp_type> metal(vec3_fp(fp_type(0.7)), fp_type(0.3));
+        const rt::dielectic<fp_type> dielectric(fp_type(1.5));
+
+        // NOTE: hit point and normal of the ray against the unit sphere, precomputed so that
+        // scatter() is all that is timed
+        std::vector<rt::surface_interaction<fp_type>> interactions(g_InputCount);
+        for (int i = 0; i < g_InputCount; ++i) {
+            interactions[i].p = in.directions[i];
+            interactions[i].set_face_normal(rays[i], in.directions[i]);
+        }
+
+        auto scatter = [&](const rt::material<fp_type>& material) {
+            return [&](long long count) {
+                fp_type acc = 0;
+                vec3_fp attenuation;
+                ray_type scattered;
+                for (long long i = 0; i < count; ++i) {
+                    if (material.scatter(rays[i & mask], interactions[i & mask], attenuation, scattered))
+                        acc += scattered.direction.getX();
+                }
+                return acc;
+            };
+        };
+        bench("material::scatter/lambertian", scatter(lambertian));
+        bench("material::scatter/metal", scatter(metal));
+        bench("material::scatter/dielectric", scatter(dielectric));
+    }
+
+    // ---- samplers ----
+    {
+        rt::random_generator<fp_type, std::minstd_rand> random_gen;
+
+        auto sample = [&](auto&& sampler) {
+            return [&, sampler](long long count) {
+                fp_type acc = 0;
+                for (long long i = 0; i < count; ++i)
+                    acc += sampler(i);
+                return acc;
+            };
+        };
+        bench("random_generator::operator()", sample([&](long long) { return random_gen(); }));
+        bench("random_generator::random_vec3", sample([&](long long) { return random_gen.random_vec3().getX(); }));
+        bench("random_generator::lambertian", sample([&](long long) { return random_gen.random_vec3_lambertian().getX(); }));
+        bench("random_generator::in_unit_disk", sample([&](long long) { return random_gen.random_vec3_in_unit_disk().getX(); }));
+        bench("random_generator::in_unit_sphere", sample([&](long long) { return random_gen.random_vec3_in_unit_sphere().getX(); }));
+        bench("random_generator::in_hemisphere", sample([&](long long i) { return random_gen.random_vec3_in_hemisphere(in.directions[i & mask]).getX(); }));
+        // NOTE: reseed and first draw, what render_samples() pays per sample
+        bench("random_generator::reseed", sample([&](long long i) { random_gen.seed(rt::counter_seed(uint64_t(i), 0)); return random_gen(); }));
+    }
+
+    // ---- vec3 ----
+    {
+        const auto& a = in.points;
+        const auto& b = in.directions;
+
+        auto op = [&](auto&& func) {
+            return [&, func](long long count) {
+                vec3_fp acc(0);
+                for (long long i = 0; i < count; ++i)
+                    acc += func(a[i & mask], b[(i + 1) & mask]);
+                return acc.getX() + acc.getY() + acc.getZ();
+            };
+        };
+        bench("vec3::add", op([](const vec3_fp& x, const vec3_fp& y) { return x + y; }));
+        bench("vec3::mul", op([](const vec3_fp& x, const vec3_fp& y) { return x * y; }));
+        bench("vec3::scale", op([](const vec3_fp& x, const vec3_fp& y) { return x * y.getX(); }));
+        bench("vec3::dot", op([](const vec3_fp& x, const vec3_fp& y) { return vec3_fp(rt::dot(x, y)); }));
+        bench("vec3::cross", op([](const vec3_fp& x, const vec3_fp& y) { return rt::cross(x, y); }));
+        bench("vec3::length", op([](const vec3_fp& x, const vec3_fp&) { return vec3_fp(x.length()); }));
+        bench("vec3::unit_vector", op([](const vec3_fp& x, const vec3_fp&) { return rt::unit_vector(x); }));
+        bench("vec3::lerp", op([](const vec3_fp& x, const vec3_fp& y) { return rt::lerp(x, y, fp_type(0.25)); }));
+    }
+
+    if (json_path != nullptr && write_json(json_path, results) == false) {
+        std::cerr << "can't write " << json_path << '\n';
+        return 1;
+    }
+    if (csv_path != nullptr && write_csv(csv_path, results) == false) {
+        std::cerr << "can't write " << csv_path << '\n';
+        return 1;
+    }
+    return 0;
+}
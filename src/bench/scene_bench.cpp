@@ -0,0 +1,440 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "common/image_io.hpp"
+#include "common/json.hpp"
+#include "common/partial_image.hpp"
+#include "common/perf_counters.hpp"
+
+#include "rtcore/renderer.hpp"
+
+
+// End-to-end renders of a fixed set of scenes for tracking throughput and quality across builds.
+// Every scene renders at a fixed resolution and sample count with 1, 2, 4 .. --threads threads;
+// render_samples() seeds per pixel and sample, so the image does not depend on the thread count
+// and the only thing that changes between runs is the time. Per run the report has Mrays/s, the
+// render time, the scaling efficiency against one thread and the RMSE of the image against a
+// reference rendered with many more samples. A missing reference is rendered and stored first;
+// RMSE then measures the noise left at the benchmark's sample count, and a change in it between
+// builds that are meant to render the same image points at a bug rather than at noise.
+// With --perf the report adds hardware counters per ray (common/perf_counters.hpp), e.g. to see
+// where the cycles of a scene go: cache misses in a large BVH, branch misses in glass.
+// With --background every thread count up to the usable CPUs, the most workers the background
+// mode runs, also renders in that mode (idle priority, throttled by CPU pressure), to see what
+// yielding costs on an idle machine and what is left of the throughput while something else runs.
+//
+// usage: bench_scenes [--filter text] [--threads N] [--samples N] [--runs N] [--references dir]
+//                     [--reference-samples N] [--perf] [--background] [--json path] [--csv path]
+//   --threads            largest thread count, the hardware concurrency by default
+//   --samples            samples per pixel of the timed renders, 16 by default
+//   --runs               renders per thread count, the fastest is reported
+//   --references         where the reference images are kept, bench_references by default
+//   --reference-samples  samples per pixel of references, 256 by default
+
+namespace
+{
+
+using clock_type = std::chrono::high_resolution_clock;
+using fp_type = rt::fp_type;
+using vec3_fp = rt::vec3<fp_type>;
+
+const int g_Width = 320;
+const int g_Height = 160;
+
+double elapsed_ms(clock_type::time_point start_t)
+{
+    return std::chrono::duration<double, std::milli>(clock_type::now() - start_t).count();
+}
+
+
+struct bench_scene
+{
+    const char* name;
+    int max_depth;
+    void (*build)(rt::scene_builder<fp_type>& builder, rt::render_settings<fp_type>& settings);
+};
+
+void build_random(rt::scene_builder<fp_type>& builder, rt::render_settings<fp_type>&)
+{
+    rt::random_scene(builder);
+}
+
+// The book's small spheres on a 1000 x 1000 grid, seen from above at a low angle so that the
+// far field is in view
+void build_million(rt::scene_builder<fp_type>& builder, rt::render_settings<fp_type>& settings)
+{
+    builder.add_sphere(vec3_fp(0, -1000, 0), 1000, builder.add_lambertian(vec3_fp(fp_type(0.5))));
+    rt::add_random_spheres(builder, 500, 500);
+
+    settings.camera_start.look_from = vec3_fp(0, 12, 40);
+    settings.camera_start.look_at = vec3_fp(0, 0, -40);
+    settings.camera_start.vfov = 40;
+}
+
+// Rows of glass balls in front of coloured diffuse ones, most paths refract several times
+void build_glass(rt::scene_builder<fp_type>& builder, rt::render_settings<fp_type>& settings)
+{
+    builder.add_sphere(vec3_fp(0, -1000, 0), 1000, builder.add_lambertian(vec3_fp(fp_type(0.5))));
+
+    const uint32_t glass = builder.add_dielectric(fp_type(1.5));
+    for (int a = -4; a <= 4; ++a) {
+        for (int b = -2; b <= 2; ++b) {
+            builder.add_sphere(vec3_fp(fp_type(a), fp_type(0.45), fp_type(b)), fp_type(0.45), glass);
+            builder.add_sphere(vec3_fp(fp_type(a + 0.5), fp_type(1.2), fp_type(b + 0.5)), fp_type(0.3), glass);
+        }
+    }
+    for (int a = -4; a <= 4; ++a) {
+        const vec3_fp albedo(fp_type(0.2 + 0.08 * (a + 4)), fp_type(0.3), fp_type(0.9 - 0.08 * (a + 4)));
+        builder.add_sphere(vec3_fp(fp_type(a), fp_type(0.45), -4), fp_type(0.45), builder.add_lambertian(albedo));
+    }
+
+    settings.camera_start.look_from = vec3_fp(0, 3, 10);
+    settings.camera_start.look_at = vec3_fp(0, fp_type(0.5), 0);
+    settings.camera_start.vfov = 40;
+}
+
+// Polished metal spheres packed around the camera: paths keep bouncing until max_depth
+void build_deep_bounce(rt::scene_builder<fp_type>& builder, rt::render_settings<fp_type>& settings)
+{
+    const uint32_t mirror = builder.add_metal(vec3_fp(fp_type(0.95)), 0);
+    const uint32_t satin = builder.add_metal(vec3_fp(fp_type(0.9), fp_type(0.8), fp_type(0.7)), fp_type(0.05));
+
+    for (int a = -2; a <= 2; ++a) {
+        for (int b = -2; b <= 2; ++b) {
+            for (int c = -2; c <= 2; ++c) {
+                if (a == 0 && b == 0 && c == 0)
+                    continue;
+                builder.add_sphere(vec3_fp(fp_type(2 * a), fp_type(2 * b), fp_type(2 * c)), fp_type(0.95),
+                                   (a + b + c) % 2 == 0 ? mirror : satin);
+            }
+        }
+    }
+
+    settings.camera_start.look_from = vec3_fp(fp_type(0.1), fp_type(0.2), fp_type(0.3));
+    settings.camera_start.look_at = vec3_fp(1, fp_type(0.5), -1);
+    settings.camera_start.vfov = 90;
+}
+
+const bench_scene g_Scenes[] = {
+    { "random_scene", 20, build_random },
+    { "million_spheres", 20, build_million },
+    { "glass", 32, build_glass },
+    { "deep_bounce", 64, build_deep_bounce },
+};
+
+
+struct bench_result
+{
+    std::string scene;
+    const char* mode;      // normal or background
+    int threads;
+    int samples;
+    double build_ms;
+    double render_ms;
+    long long rays;
+    double speedup;        // against one thread in the normal mode
+    double rmse;           // against the reference, -1 without one
+    rt::perf_sample perf;  // of the reported render, all its threads
+
+    double mrays_per_second() const
+    {
+        return rays / (render_ms * 1e3);
+    }
+
+    double efficiency() const
+    {
+        return speedup / threads;
+    }
+};
+
+
+// One render of samples [0, samples) of every pixel, resolved to 8 bits like the renderer's output.
+// The render threads are joined before it returns, so `perf` counts them all. With `background`
+// in the background mode, the governor's thread included in the time.
+double render(rt::framebuffer& image, int samples, int threads, const rt::hittable<fp_type>& world,
+              const rt::camera<fp_type>& cam, rt::render_settings<fp_type> settings, long long& rays,
+              rt::perf_counters* perf = nullptr, rt::perf_sample* counters = nullptr, bool background = false)
+{
+    settings.thread_count = threads;
+
+    rt::partial_image partial;
+    partial.reset(settings.width, settings.height, 0, 0, uint32_t(samples));
+
+    std::optional<rt::worker_throttle> throttle;
+    if (background)
+        throttle.emplace(threads);
+
+    if (perf != nullptr)
+        perf->start();
+    auto start_t = clock_type::now();
+    if (throttle)
+        throttle->start();
+    rays = static_cast<long long>(rt::render_samples(partial, world, cam, settings, nullptr, throttle ? &*throttle : nullptr).rays());
+    if (throttle)
+        throttle->stop();
+    const double ms = elapsed_ms(start_t);
+    if (perf != nullptr)
+        *counters = perf->stop();
+
+    partial.resolve_rgb8(image.rgb);
+    return ms;
+}
+
+// Image rows are stored bottom up, PPM rows top down
+double rmse(const rt::framebuffer& image, const rt::image& reference)
+{
+    if (reference.width != image.width || reference.height != image.height)
+        return -1;
+
+    const size_t row_size = size_t(image.width) * rt::framebuffer::channels;
+    double squared_sum = 0;
+    for (int j = 0; j < image.height; ++j) {
+        const uint8_t* row = image.rgb.data() + (image.height - 1 - j) * row_size;
+        const float* reference_row = reference.data.data() + j * row_size;
+        for (size_t i = 0; i < row_size; ++i) {
+            const double diff = row[i] / 255.0 - reference_row[i];
+            squared_sum += diff * diff;
+        }
+    }
+    return std::sqrt(squared_sum / (row_size * image.height));
+}
+
+// Per ray, "-" for events that weren't counted
+void print_perf(const rt::perf_sample& perf, double rays)
+{
+    auto column = [&](rt::perf_event event, int width) {
+        if (perf.has(event))
+            std::cout << std::setw(width) << std::setprecision(2) << perf[event] / rays;
+        else
+            std::cout << std::setw(width) << '-';
+    };
+    column(rt::perf_event::cycles, 11);
+    if (perf.has(rt::perf_event::cycles) && perf.has(rt::perf_event::instructions) && perf[rt::perf_event::cycles] > 0)
+        std::cout << std::setw(6) << std::setprecision(2) << perf[rt::perf_event::instructions] / perf[rt::perf_event::cycles];
+    else
+        std::cout << std::setw(6) << '-';
+    column(rt::perf_event::l1d_misses, 9);
+    column(rt::perf_event::llc_misses, 9);
+    column(rt::perf_event::branch_misses, 9);
+}
+
+void print(const bench_result& result, bool perf)
+{
+    std::cout << std::left << std::setw(18) << result.scene << std::right << std::fixed
+              << std::setw(7) << result.threads
+              << std::setw(12) << result.mode
+              << std::setw(11) << std::setprecision(1) << result.render_ms << " ms"
+              << std::setw(9) << std::setprecision(2) << result.mrays_per_second()
+              << std::setw(9) << std::setprecision(2) << result.speedup
+              << std::setw(10) << std::setprecision(0) << 100 * result.efficiency() << " %"
+              << std::setw(10) << std::setprecision(5) << result.rmse;
+    if (perf)
+        print_perf(result.perf, double(std::max(result.rays, 1ll)));
+    std::cout << '\n';
+}
+
+bool write_json(const char* path, const std::vector<bench_result>& results)
+{
+    std::ofstream out(path);
+    out << "{\n    \"width\": " << g_Width << ",\n    \"height\": " << g_Height << ",\n    \"arch\": "
+        << rt::json_quote(RT_ARCH_NAME) << ",\n    \"vec3_backend\": " << rt::json_quote(rt::vec3_backend)
+        << ",\n    \"fast_math\": " << RT_FAST_MATH << ",\n    \"results\": [\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const auto& r = results[i];
+        out << "        { \"scene\": " << rt::json_quote(r.scene) << ", \"mode\": " << rt::json_quote(r.mode)
+            << ", \"threads\": " << r.threads
+            << ", \"samples\": " << r.samples << ", \"build_ms\": " << r.build_ms << ", \"render_ms\": " << r.render_ms
+            << ", \"rays\": " << r.rays << ", \"mrays_per_s\": " << r.mrays_per_second() << ", \"speedup\": " << r.speedup
+            << ", \"efficiency\": " << r.efficiency() << ", \"rmse\": " << r.rmse
+            << ", \"perf_per_ray\": " << rt::perf_json(r.perf, double(std::max(r.rays, 1ll))) << " }"
+            << (i + 1 < results.size() ? "," : "") << '\n';
+    }
+    out << "    ]\n}\n";
+    return out.good();
+}
+
+bool write_csv(const char* path, const std::vector<bench_result>& results)
+{
+    std::ofstream out(path);
+    out << "scene,arch,mode,threads,samples,build_ms,render_ms,rays,mrays_per_s,speedup,efficiency,rmse";
+    for (int i = 0; i < rt::perf_sample::event_count; ++i)
+        out << ',' << rt::to_string(rt::perf_event(i)) << "_per_ray";
+    out << '\n';
+
+    // NOTE: empty fields for events that weren't counted
+    for (const auto& r : results) {
+        out << r.scene << ',' << RT_ARCH_NAME << ',' << r.mode << ',' << r.threads << ',' << r.samples << ',' << r.build_ms << ',' << r.render_ms << ','
+            << r.rays << ',' << r.mrays_per_second() << ',' << r.speedup << ',' << r.efficiency() << ',' << r.rmse;
+        for (int i = 0; i < rt::perf_sample::event_count; ++i) {
+            out << ',';
+            if (r.perf.valid[i])
+                out << r.perf.value[i] / double(std::max(r.rays, 1ll));
+        }
+        out << '\n';
+    }
+    return out.good();
+}
+
+} // namespace
+
+
+int main(int argc, char** argv)
+{
+    std::string filter;
+    int max_threads = std::max(1, int(std::thread::hardware_concurrency()));
+    int samples = 16;
+    int runs = 1;
+    std::string reference_dir = "bench_references";
+    int reference_samples = 256;
+    const char* json_path = nullptr;
+    const char* csv_path = nullptr;
+    bool use_perf = false;
+    bool background = false;
+
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--perf") {
+            use_perf = true;
+            continue;
+        }
+        if (arg == "--background") {
+            background = true;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            std::cerr << "missing value of " << arg << '\n';
+            return 2;
+        }
+        if (arg == "--filter")
+            filter = argv[++i];
+        else if (arg == "--threads")
+            max_threads = std::max(std::atoi(argv[++i]), 1);
+        else if (arg == "--samples")
+            samples = std::max(std::atoi(argv[++i]), 1);
+        else if (arg == "--runs")
+            runs = std::max(std::atoi(argv[++i]), 1);
+        else if (arg == "--references")
+            reference_dir = argv[++i];
+        else if (arg == "--reference-samples")
+            reference_samples = std::max(std::atoi(argv[++i]), 1);
+        else if (arg == "--json")
+            json_path = argv[++i];
+        else if (arg == "--csv")
+            csv_path = argv[++i];
+        else {
+            std::cerr << "usage: bench_scenes [--filter text] [--threads N] [--samples N] [--runs N] [--references dir]\n"
+                         "                    [--reference-samples N] [--perf] [--background] [--json path] [--csv path]\n";
+            return 2;
+        }
+    }
+
+    std::vector<int> thread_counts;
+    for (int threads = 1; threads < max_threads; threads *= 2)
+        thread_counts.push_back(threads);
+    thread_counts.push_back(max_threads);
+
+    // NOTE: without counters (no permission, no PMU in a VM) the timings are still worth having
+    rt::perf_counters perf;
+    if (use_perf) {
+        std::string error;
+        if (perf.open(error) == false) {
+            std::cerr << "no hardware counters: " << error << '\n';
+            use_perf = false;
+        }
+    }
+
+    std::cout << g_Width << 'x' << g_Height << ", " << samples << " samples per pixel, arch: " << RT_ARCH_NAME << ", vec3 backend: "
+              << rt::vec3_backend << ", fast math: " << RT_FAST_MATH << "\n\n"
+              << "scene             threads        mode     render   Mray/s  speedup  efficiency      RMSE";
+    if (use_perf)
+        std::cout << "  cycles/ray   IPC   L1D/ray  LLC/ray   br/ray";
+    std::cout << '\n';
+
+    std::vector<bench_result> results;
+
+    for (const auto& bench_scene : g_Scenes) {
+        if (std::string(bench_scene.name).find(filter) == std::string::npos)
+            continue;
+
+        rt::render_settings<fp_type> settings;
+        settings.width = g_Width;
+        settings.height = g_Height;
+        settings.max_depth = bench_scene.max_depth;
+
+        auto start_t = clock_type::now();
+        rt::scene_builder<fp_type> builder;
+        bench_scene.build(builder, settings);
+        builder.build();
+        rt::scene_arena arena;
+        const auto world = rt::make_world(builder, arena);
+        const double build_ms = elapsed_ms(start_t);
+
+        const auto cam = settings.make_camera();
+        rt::framebuffer image(g_Width, g_Height);
+        long long rays = 0;
+
+        // NOTE: the reference depends on nothing but the scene and the sample count, any thread
+        // count or build that renders correctly reproduces it
+        const std::string reference_path = reference_dir + "/" + bench_scene.name + ".ppm";
+        rt::image reference;
+        if (rt::read_image(reference_path.c_str(), reference) == false) {
+            std::cout << bench_scene.name << ": rendering the reference, " << reference_samples << " samples" << std::endl;
+            render(image, reference_samples, max_threads, world, cam, settings, rays);
+
+            std::filesystem::create_directories(reference_dir);
+            if (rt::write_ppm(reference_path.c_str(), g_Width, g_Height, image.rgb.data(), true) == false
+                || rt::read_image(reference_path.c_str(), reference) == false) {
+                std::cerr << "can't write " << reference_path << '\n';
+                return 1;
+            }
+        }
+
+        double single_thread_ms = 0;
+        for (int threads : thread_counts) {
+            for (const bool background_mode : { false, true }) {
+                if (background_mode && (background == false || threads > rt::usable_cpus()))
+                    continue;
+
+                double render_ms = std::numeric_limits<double>::max();
+                rt::perf_sample counters;
+                for (int run = 0; run < runs; ++run) {
+                    rt::perf_sample run_counters;
+                    const double ms = render(image, samples, threads, world, cam, settings, rays, use_perf ? &perf : nullptr,
+                                             &run_counters, background_mode);
+                    if (ms < render_ms) {
+                        render_ms = ms;
+                        counters = run_counters;
+                    }
+                }
+
+                if (threads == 1 && background_mode == false)
+                    single_thread_ms = render_ms;
+
+                results.push_back({ bench_scene.name, background_mode ? "background" : "normal", threads, samples, build_ms,
+                                    render_ms, rays, single_thread_ms / render_ms, rmse(image, reference), counters });
+                print(results.back(), use_perf);
+            }
+        }
+    }
+
+    if (json_path != nullptr && write_json(json_path, results) == false) {
+        std::cerr << "can't write " << json_path << '\n';
+        return 1;
+    }
+    if (csv_path != nullptr && write_csv(csv_path, results) == false) {
+        std::cerr << "can't write " << csv_path << '\n';
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,150 @@
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "common/vec3.hpp"
+#include "common/ray.hpp"
+#include "common/utility.hpp"
+#include "common/arena.hpp"
+
+#include "rtcore/hittable_list.hpp"
+#include "rtcore/sphere.hpp"
+#include "rtcore/material.hpp"
+
+
+// Scene build time and linear traversal time of N spheres allocated one by one with
+// std::make_shared (the old random_scene()) against a rt::scene_arena.
+// usage: bench_scene_build [sphere count = 1000000] [ray count = 32]
+
+using fp_type = float;
+
+namespace
+{
+
+using clock_type = std::chrono::high_resolution_clock;
+
+double elapsed_ms(clock_type::time_point start_t)
+{
+    return std::chrono::duration<double, std::milli>(clock_type::now() - start_t).count();
+}
+
+
+struct shared_scene
+{
+    std::vector<std::shared_ptr<rt::hittable<fp_type>>> objects;
+    std::vector<std::shared_ptr<rt::material<fp_type>>> materials;
+
+    bool hit(const rt::ray<fp_type>& r, fp_type t_min, fp_type t_max, rt::hit_record<fp_type>& rec) const
+    {
+        bool hit_anything = false;
+        fp_type closest_so_far = t_max;
+
+        for (const auto& object : objects) {
+            if (object->hit(r, t_min, closest_so_far, rec)) {
+                hit_anything = true;
+                closest_so_far = rec.t;
+            }
+        }
+
+        return hit_anything;
+    }
+};
+
+
+template<typename AddSphere>
+void generate(int count, AddSphere&& add_sphere)
+{
+    rt::random_generator<fp_type, std::minstd_rand> random_gen;
+
+    for (int i = 0; i < count; ++i) {
+        rt::vec3<fp_type> center = random_gen.random_vec3(-100, 100);
+        add_sphere(center, fp_type(0.2), random_gen(), random_gen.random_vec3());
+    }
+}
+
+std::vector<rt::ray<fp_type>> make_rays(int count)
+{
+    rt::random_generator<fp_type, std::minstd_rand> random_gen;
+    std::vector<rt::ray<fp_type>> rays;
+
+    for (int i = 0; i < count; ++i)
+        rays.emplace_back(rt::vec3<fp_type>(0), random_gen.random_vec3_lambertian());
+
+    return rays;
+}
+
+} // namespace
+
+
+int main(int argc, char** argv)
+{
+    const int sphere_count = argc > 1 ? std::atoi(argv[1]) : 1000000;
+    const int ray_count = argc > 2 ? std::atoi(argv[2]) : 32;
+    const auto rays = make_rays(ray_count);
+
+    std::cout << "Spheres: " << sphere_count << "\nRays: " << ray_count << "\n\n";
+
+    // make_shared per object
+    {
+        auto start_t = clock_type::now();
+
+        shared_scene scene;
+        generate(sphere_count, [&](auto center, fp_type radius, fp_type choose, auto albedo) {
+            std::shared_ptr<rt::material<fp_type>> material;
+            if (choose < fp_type(0.5))
+                material = std::make_shared<rt::lambertian<fp_type>>(albedo);
+            else
+                material = std::make_shared<rt::metal<fp_type>>(albedo, fp_type(0.1));
+            scene.materials.push_back(material);
+            scene.objects.push_back(std::make_shared<rt::sphere<fp_type>>(center, radius, material.get()));
+        });
+        auto build_ms = elapsed_ms(start_t);
+
+        start_t = clock_type::now();
+        int hits = 0;
+        for (const auto& r : rays) {
+            rt::hit_record<fp_type> rec;
+            hits += scene.hit(r, fp_type(0.001), std::numeric_limits<fp_type>::infinity(), rec);
+        }
+        auto traverse_ms = elapsed_ms(start_t);
+
+        std::cout << "make_shared  build: " << build_ms << "ms  traverse: " << traverse_ms
+                  << "ms  (" << traverse_ms * 1e6 / (double(ray_count) * sphere_count) << " ns/test, hits " << hits << ")\n";
+    }
+
+    // scene_arena
+    {
+        auto start_t = clock_type::now();
+
+        rt::scene_arena arena;
+        rt::hittable_list<fp_type> world;
+        world.reserve(sphere_count);
+        generate(sphere_count, [&](auto center, fp_type radius, fp_type choose, auto albedo) {
+            const rt::material<fp_type>* material;
+            if (choose < fp_type(0.5))
+                material = arena.make_material<rt::lambertian<fp_type>>(albedo);
+            else
+                material = arena.make_material<rt::metal<fp_type>>(albedo, fp_type(0.1));
+            world.add(arena.make_primitive<rt::sphere<fp_type>>(center, radius, material));
+        });
+        auto build_ms = elapsed_ms(start_t);
+
+        start_t = clock_type::now();
+        int hits = 0;
+        for (const auto& r : rays) {
+            rt::hit_record<fp_type> rec;
+            hits += world.hit(r, fp_type(0.001), std::numeric_limits<fp_type>::infinity(), rec);
+        }
+        auto traverse_ms = elapsed_ms(start_t);
+
+        std::cout << "scene_arena  build: " << build_ms << "ms  traverse: " << traverse_ms
+                  << "ms  (" << traverse_ms * 1e6 / (double(ray_count) * sphere_count) << " ns/test, hits " << hits << ")\n"
+                  << "             primitives: " << arena.primitives.bytes_used() / 1024 << "KB"
+                  << "  materials: " << arena.materials.bytes_used() / 1024 << "KB\n";
+    }
+
+    return 0;
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <limits>
+
+#include "common/vec3.hpp"
+
+
+namespace rt
+{
+
+template<typename T>
+inline T component(const vec3<T>& v, int axis)
+{
+    return axis == 0 ? v.getX() : (axis == 1 ? v.getY() : v.getZ());
+}
+
+
+template<typename FloatType,
+    typename = std::enable_if_t<std::is_floating_point<FloatType>::value>
+>
+struct aabb
+{
+    using vec3_fp = vec3<FloatType>;
+
+    // empty box, expanding it by anything gives that thing's bounds
+    aabb()
+        : min(vec3_fp(std::numeric_limits<FloatType>::infinity()))
+        , max(vec3_fp(-std::numeric_limits<FloatType>::infinity()))
+    {}
+
+    aabb(const vec3_fp& min, const vec3_fp& max)
+        : min(min)
+        , max(max)
+    {}
+
+    void expand(const vec3_fp& p)
+    {
+        min = rt::min(min, p);
+        max = rt::max(max, p);
+    }
+
+    void expand(const aabb& box)
+    {
+        min = rt::min(min, box.min);
+        max = rt::max(max, box.max);
+    }
+
+    bool empty() const
+    {
+        return min.getX() > max.getX();
+    }
+
+    vec3_fp centroid() const
+    {
+        return (min + max) * static_cast<FloatType>(0.5);
+    }
+
+    FloatType surface_area() const
+    {
+        if (empty())
+            return 0;
+
+        auto d = max - min;
+        return 2 * (d.getX() * d.getY() + d.getY() * d.getZ() + d.getZ() * d.getX());
+    }
+
+    int longest_axis() const
+    {
+        auto d = max - min;
+        if (d.getX() > d.getY() && d.getX() > d.getZ())
+            return 0;
+        return d.getY() > d.getZ() ? 1 : 2;
+    }
+
+public:
+    vec3_fp min;
+    vec3_fp max;
+};
+
+} // namespace rt
@@ -0,0 +1,162 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+
+namespace rt
+{
+
+// Monotonic bump allocator. Objects are placed back to back in large blocks and are released
+// all at once when the arena is destroyed; destructors run only for types that need them.
+// Not thread safe, scenes are built on one thread.
+class arena
+{
+public:
+    static constexpr size_t default_block_size = size_t(1) << 20;
+
+    explicit arena(size_t block_size = default_block_size)
+        : m_block_size(block_size)
+        , m_current(nullptr)
+        , m_end(nullptr)
+        , m_bytes_used(0)
+    {}
+
+    arena(const arena&) = delete;
+    arena& operator=(const arena&) = delete;
+
+    arena(arena&& other) noexcept
+        : m_block_size(other.m_block_size)
+        , m_blocks(std::move(other.m_blocks))
+        , m_destructors(std::move(other.m_destructors))
+        , m_current(std::exchange(other.m_current, nullptr))
+        , m_end(std::exchange(other.m_end, nullptr))
+        , m_bytes_used(std::exchange(other.m_bytes_used, 0))
+    {}
+
+    ~arena()
+    {
+        release();
+    }
+
+    void* allocate(size_t size, size_t alignment)
+    {
+        auto address = reinterpret_cast<uintptr_t>(m_current);
+        auto aligned = (address + alignment - 1) & ~(uintptr_t(alignment) - 1);
+
+        if (m_current == nullptr || aligned + size > reinterpret_cast<uintptr_t>(m_end)) {
+            add_block(size + alignment);
+            address = reinterpret_cast<uintptr_t>(m_current);
+            aligned = (address + alignment - 1) & ~(uintptr_t(alignment) - 1);
+        }
+
+        m_current = reinterpret_cast<std::byte*>(aligned + size);
+        m_bytes_used += size;
+
+        return reinterpret_cast<void*>(aligned);
+    }
+
+    template<typename T, typename... Args>
+    T* make(Args&&... args)
+    {
+        void* memory = allocate(sizeof(T), alignof(T));
+        T* object = ::new (memory) T(std::forward<Args>(args)...);
+
+        if constexpr (std::is_trivially_destructible_v<T> == false)
+            m_destructors.push_back({ [](void* p) { static_cast<T*>(p)->~T(); }, object });
+
+        return object;
+    }
+
+    // Uninitialized storage for `count` elements, for SoA buffers built in place
+    template<typename T>
+    T* make_array(size_t count)
+    {
+        static_assert(std::is_trivially_destructible_v<T>);
+
+        return static_cast<T*>(allocate(sizeof(T) * count, alignof(T)));
+    }
+
+    size_t bytes_used() const
+    {
+        return m_bytes_used;
+    }
+
+    size_t bytes_reserved() const
+    {
+        size_t total = 0;
+        for (const auto& b : m_blocks)
+            total += b.size;
+        return total;
+    }
+
+    void release()
+    {
+        for (auto it = m_destructors.rbegin(); it != m_destructors.rend(); ++it)
+            it->destroy(it->object);
+
+        m_destructors.clear();
+        m_blocks.clear();
+        m_current = nullptr;
+        m_end = nullptr;
+        m_bytes_used = 0;
+    }
+
+private:
+    struct block
+    {
+        std::unique_ptr<std::byte[]> memory;
+        size_t size;
+    };
+
+    struct destructor_entry
+    {
+        void (*destroy)(void*);
+        void* object;
+    };
+
+    void add_block(size_t min_size)
+    {
+        const size_t size = std::max(m_block_size, min_size);
+
+        m_blocks.push_back({ std::unique_ptr<std::byte[]>(new std::byte[size]), size });
+        m_current = m_blocks.back().memory.get();
+        m_end = m_current + size;
+    }
+
+    size_t m_block_size;
+    std::vector<block> m_blocks;
+    std::vector<destructor_entry> m_destructors;
+    std::byte* m_current;
+    std::byte* m_end;
+    size_t m_bytes_used;
+};
+
+
+// Primitives and materials are kept in separate arenas so that the objects touched by
+// intersection are packed together, with materials read only for the closest hit.
+struct scene_arena
+{
+    arena primitives;
+    arena materials;
+
+    template<typename T, typename... Args>
+    T* make_primitive(Args&&... args)
+    {
+        return primitives.make<T>(std::forward<Args>(args)...);
+    }
+
+    template<typename T, typename... Args>
+    T* make_material(Args&&... args)
+    {
+        return materials.make<T>(std::forward<Args>(args)...);
+    }
+};
+
+} // namespace rt
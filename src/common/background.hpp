@@ -0,0 +1,307 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#if defined(_WIN32)
+    #define WIN32_LEAN_AND_MEAN
+    #define NOMINMAX
+    #include <Windows.h>
+#elif defined(__linux__)
+    #include <sched.h>
+    #include <sys/resource.h>
+    #include <sys/syscall.h>
+    #include <unistd.h>
+#endif
+
+#include "trace.hpp"
+
+
+// Background rendering on a machine someone is working at: the render threads run at idle
+// priority, so any other thread gets the CPU first, and a governor parks render threads while
+// other work is waiting for CPU and resumes them when the machine is idle again. The signal is
+// the kernel's pressure stall information (/proc/pressure/cpu), the share of time in which some
+// runnable task had to wait; without it the load average stands in, which follows slowly.
+namespace rt
+{
+
+// CPUs the process may run on: its affinity mask on Linux, which taskset and containers narrow
+inline int usable_cpus()
+{
+#if defined(__linux__)
+    cpu_set_t set;
+    if (sched_getaffinity(0, sizeof(set), &set) == 0)
+        return std::max(CPU_COUNT(&set), 1);
+#endif
+    return static_cast<int>(std::max(std::thread::hardware_concurrency(), 1u));
+}
+
+
+// Idle priority for the calling thread: SCHED_IDLE on Linux, falling back to nice 19 where that
+// is refused, the background mode of the thread on Windows
+inline bool lower_thread_priority(std::string& error)
+{
+#if defined(_WIN32)
+    if (SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_BEGIN) == FALSE) {
+        error = "SetThreadPriority failed";
+        return false;
+    }
+    return true;
+#elif defined(__linux__)
+    sched_param param{};
+    if (sched_setscheduler(0, SCHED_IDLE, &param) == 0)
+        return true;
+
+    // NOTE: Linux keeps a nice value per thread, `who` is the thread id
+    if (setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), 19) == 0)
+        return true;
+    error = "neither SCHED_IDLE nor nice 19 were allowed";
+    return false;
+#else
+    error = "no idle priority on this platform";
+    return false;
+#endif
+}
+
+
+// Share of wall time in which runnable tasks waited for a CPU, between two calls of sample()
+class cpu_pressure
+{
+public:
+    // false if the kernel has no pressure stall information (before 4.20, or psi=0)
+    bool open()
+    {
+        uint64_t total;
+        m_available = read_total(total);
+        m_last_total = total;
+        m_last_t = std::chrono::steady_clock::now();
+        return m_available;
+    }
+
+    bool available() const
+    {
+        return m_available;
+    }
+
+    // In [0, 1]; the load average above `own_threads` over the CPU count when there is no PSI
+    double sample(int own_threads)
+    {
+        const auto now = std::chrono::steady_clock::now();
+        const double elapsed_us = std::chrono::duration<double, std::micro>(now - m_last_t).count();
+        m_last_t = now;
+
+        if (m_available) {
+            uint64_t total;
+            if (read_total(total) == false || elapsed_us <= 0)
+                return 0;
+            const double stalled_us = double(total - m_last_total);
+            m_last_total = total;
+            return std::clamp(stalled_us / elapsed_us, 0.0, 1.0);
+        }
+
+        double load = 0;
+        std::ifstream loadavg("/proc/loadavg");
+        if ((loadavg >> load).fail())
+            return 0;
+        return std::clamp((load - own_threads) / usable_cpus(), 0.0, 1.0);
+    }
+
+private:
+    // NOTE: "some avg10=.. avg60=.. avg300=.. total=<us>"; the averages span 10s and more, the
+    // total's difference tells what happened since the last sample
+    static bool read_total(uint64_t& total)
+    {
+        std::ifstream in("/proc/pressure/cpu");
+        std::string line;
+        while (std::getline(in, line)) {
+            const size_t at = line.find("total=");
+            if (line.starts_with("some") && at != std::string::npos) {
+                std::istringstream value(line.substr(at + 6));
+                return static_cast<bool>(value >> total);
+            }
+        }
+        return false;
+    }
+
+    bool m_available = false;
+    uint64_t m_last_total = 0;
+    std::chrono::steady_clock::time_point m_last_t;
+};
+
+
+struct background_settings
+{
+    double pressure_high = 0.10;    // above, the active workers are halved
+    double pressure_low = 0.02;     // below, one more is resumed
+    int min_workers = 1;            // never parks all, the render keeps crawling
+    std::chrono::milliseconds interval{ 250 };
+};
+
+
+// Governs how many of `max_workers` workers may run. Worker i calls wait_turn(i) between work
+// items, which parks it while i >= active(); a governor thread samples the pressure every
+// interval and adjusts active() like congestion control: halved when others wait for CPU,
+// raised by one when they don't. Whoever ends the work calls wake_all(), so that parked workers
+// see it without waiting for the governor.
+//
+// There are no more workers than usable CPUs: past that they wait for each other, and the
+// pressure can't tell that from other work wanting the CPU, the governor would throttle the
+// render on an idle machine. At most one worker per CPU, any stall is someone else's.
+class worker_throttle
+{
+    using clock_type = std::chrono::steady_clock;
+
+public:
+    explicit worker_throttle(int max_workers, const background_settings& settings = {})
+        : m_settings(settings)
+        , m_max_workers(std::clamp(max_workers, 1, usable_cpus()))
+        , m_active(m_max_workers)
+    {
+        m_settings.min_workers = std::clamp(m_settings.min_workers, 1, m_max_workers);
+    }
+
+    ~worker_throttle()
+    {
+        stop();
+    }
+
+    worker_throttle(const worker_throttle&) = delete;
+    worker_throttle& operator=(const worker_throttle&) = delete;
+
+    int max_workers() const
+    {
+        return m_max_workers;
+    }
+
+    int active() const
+    {
+        return m_active.load(std::memory_order_relaxed);
+    }
+
+    bool has_pressure_stall_info() const
+    {
+        return m_pressure.available();
+    }
+
+    void start()
+    {
+        m_pressure.open();
+        m_start_t = m_last_change_t = clock_type::now();
+        m_worker_seconds = 0;
+        m_adjustments = 0;
+        m_stop = false;
+        m_governor = std::thread(&worker_throttle::govern, this);
+    }
+
+    // Resumes all workers, so that none stays parked once the governor is gone
+    void stop()
+    {
+        if (m_governor.joinable() == false)
+            return;
+
+        {
+            std::lock_guard lock(m_mutex);
+            m_stop = true;
+            account(clock_type::now());
+            m_active.store(m_max_workers, std::memory_order_relaxed);
+        }
+        m_resume.notify_all();
+        m_wake.notify_one();
+        m_governor.join();
+    }
+
+    // A relaxed load while worker `index` may run; the mutex only when it has to park, until it
+    // may run again or done() is true
+    template<typename Done>
+    void wait_turn(int index, Done&& done)
+    {
+        if (index < m_active.load(std::memory_order_relaxed))
+            return;
+
+        RT_TRACE_SCOPE("parked");
+        std::unique_lock lock(m_mutex);
+        m_resume.wait(lock, [&] { return index < m_active.load(std::memory_order_relaxed) || done(); });
+    }
+
+    // Parked workers check done() again
+    void wake_all()
+    {
+        // NOTE: through the mutex, a worker between its check and its wait would miss the notify
+        {
+            std::lock_guard lock(m_mutex);
+        }
+        m_resume.notify_all();
+    }
+
+    // Time average of the active workers since start()
+    double average_workers() const
+    {
+        std::lock_guard lock(m_mutex);
+        const double seconds = std::chrono::duration<double>(m_last_change_t - m_start_t).count();
+        return seconds > 0 ? m_worker_seconds / seconds : m_max_workers;
+    }
+
+    int adjustments() const
+    {
+        std::lock_guard lock(m_mutex);
+        return m_adjustments;
+    }
+
+private:
+    void govern()
+    {
+        RT_TRACE_THREAD("governor");
+        std::unique_lock lock(m_mutex);
+        while (m_wake.wait_for(lock, m_settings.interval, [this] { return m_stop; }) == false) {
+            const int active = m_active.load(std::memory_order_relaxed);
+            const double pressure = m_pressure.sample(active);
+
+            int target = active;
+            if (pressure > m_settings.pressure_high)
+                target = std::max(m_settings.min_workers, active / 2);
+            else if (pressure < m_settings.pressure_low)
+                target = std::min(m_max_workers, active + 1);
+            if (target == active)
+                continue;
+
+            account(clock_type::now());
+            m_active.store(target, std::memory_order_relaxed);
+            ++m_adjustments;
+            if (target > active)
+                m_resume.notify_all();
+        }
+    }
+
+    // Under m_mutex
+    void account(clock_type::time_point now)
+    {
+        m_worker_seconds += m_active.load(std::memory_order_relaxed) * std::chrono::duration<double>(now - m_last_change_t).count();
+        m_last_change_t = now;
+    }
+
+    background_settings m_settings;
+    int m_max_workers;
+    std::atomic<int> m_active;
+    cpu_pressure m_pressure;
+
+    std::thread m_governor;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_resume;
+    std::condition_variable m_wake;
+    bool m_stop = false;
+
+    clock_type::time_point m_start_t;
+    clock_type::time_point m_last_change_t;
+    double m_worker_seconds = 0;
+    int m_adjustments = 0;
+};
+
+} // namespace rt
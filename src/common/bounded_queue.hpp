@@ -0,0 +1,74 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <optional>
+
+
+namespace rt
+{
+
+// Blocking FIFO of at most `capacity` items, connects the stages of a pipeline: a full queue
+// stalls the producer, so a fast stage can't run ahead of a slow one by more than the capacity.
+// close() wakes everyone up, pop() then drains what is left and returns nothing after that.
+template<typename T>
+class bounded_queue
+{
+public:
+    explicit bounded_queue(size_t capacity)
+        : m_capacity(capacity > 0 ? capacity : 1)
+    {}
+
+    bounded_queue(const bounded_queue&) = delete;
+    bounded_queue& operator=(const bounded_queue&) = delete;
+
+    // false if the queue was closed, the item is dropped then
+    bool push(T item)
+    {
+        std::unique_lock lock(m_mutex);
+        m_not_full.wait(lock, [this] { return m_closed || m_items.size() < m_capacity; });
+        if (m_closed)
+            return false;
+
+        m_items.push_back(std::move(item));
+        lock.unlock();
+        m_not_empty.notify_one();
+        return true;
+    }
+
+    std::optional<T> pop()
+    {
+        std::unique_lock lock(m_mutex);
+        m_not_empty.wait(lock, [this] { return m_closed || m_items.empty() == false; });
+        if (m_items.empty())
+            return std::nullopt;
+
+        T item = std::move(m_items.front());
+        m_items.pop_front();
+        lock.unlock();
+        m_not_full.notify_one();
+        return item;
+    }
+
+    void close()
+    {
+        {
+            std::lock_guard lock(m_mutex);
+            m_closed = true;
+        }
+        m_not_full.notify_all();
+        m_not_empty.notify_all();
+    }
+
+private:
+    std::mutex m_mutex;
+    std::condition_variable m_not_full;
+    std::condition_variable m_not_empty;
+    std::deque<T> m_items;
+    size_t m_capacity;
+    bool m_closed = false;
+};
+
+} // namespace rt
@@ -0,0 +1,357 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <span>
+#include <vector>
+
+#include "common/vec3.hpp"
+#include "common/ray.hpp"
+#include "common/aabb.hpp"
+
+
+// NOTE: traversal counting is off by default, its increments sit in the innermost loop
+#ifndef RT_TRAVERSAL_STATS
+    #define RT_TRAVERSAL_STATS 0
+#endif
+
+
+namespace rt
+{
+
+// Nodes and leaf items bvh::traverse() visited on this thread, counted with RT_TRAVERSAL_STATS
+// only. Never reset: users take the difference around their work (render_stats.hpp).
+struct traversal_counters
+{
+    uint64_t nodes_visited = 0;
+    uint64_t primitive_tests = 0;
+};
+
+inline thread_local traversal_counters s_traversal_counters;
+
+
+// Flattened node, depth-first order: the first child of an interior node is the next node,
+// `offset` is the index of the second child. For leaves `offset` is the first item of the
+// leaf, and what an item is (primitive index, packet index, instance) is up to the owner.
+template<typename FloatType>
+struct bvh_node
+{
+    FloatType lower[3];
+    FloatType upper[3];
+    uint32_t offset;
+    uint16_t count;    // items in a leaf, 0 for interior nodes
+    uint8_t axis;      // split axis of interior nodes, for front-to-back traversal
+    uint8_t pad;
+
+    bool is_leaf() const
+    {
+        return count > 0;
+    }
+};
+
+static_assert(sizeof(bvh_node<float>) == 32);
+
+
+// Binned SAH bounding volume hierarchy over item bounds. It knows nothing about the items:
+// build() takes one box per item and leaves item_order[] as the order the leaves refer to,
+// traverse() calls back for every leaf the ray reaches, refit() updates the bounds of moved items.
+// items_per_test is how many items of a leaf one intersection test handles (8 for packed
+// triangles), the SAH then charges a leaf per test instead of per item.
+template<typename FloatType,
+    typename = std::enable_if_t<std::is_floating_point<FloatType>::value>
+>
+class bvh
+{
+    using vec3_fp = vec3<FloatType>;
+    using ray_type = ray<FloatType>;
+    using aabb_type = aabb<FloatType>;
+    using node_type = bvh_node<FloatType>;
+
+    static constexpr int bin_count = 16;
+
+public:
+    // Traversal stack entries, the deepest interior node a tree may have
+    static constexpr int stack_size = 64;
+
+    void build(const std::vector<aabb_type>& item_bounds, int max_leaf_size, int items_per_test = 1)
+    {
+        const uint32_t item_count = static_cast<uint32_t>(item_bounds.size());
+
+        nodes.clear();
+        item_order.resize(item_count);
+        m_centroids.resize(item_count);
+
+        for (uint32_t i = 0; i < item_count; ++i) {
+            item_order[i] = i;
+            m_centroids[i] = item_bounds[i].centroid();
+        }
+
+        if (item_count == 0)
+            return;
+
+        nodes.reserve(2 * (item_count / std::max(1, max_leaf_size / 2)) + 1);
+        m_max_leaf_size = std::min(max_leaf_size, 0xffff);
+        m_items_per_test = std::max(items_per_test, 1);
+        build_recursive(item_bounds, 0, item_count);
+
+        m_centroids.clear();
+        m_centroids.shrink_to_fit();
+    }
+
+    bool empty() const
+    {
+        return nodes.empty();
+    }
+
+    aabb_type bounds() const
+    {
+        if (nodes.empty())
+            return aabb_type();
+        return node_bounds(nodes[0]);
+    }
+
+    // leaf(first, count, t_max) intersects the items of a leaf, shrinks t_max and returns true on a hit
+    template<typename LeafFunc>
+    bool traverse(const ray_type& r, FloatType t_min, FloatType t_max, LeafFunc&& leaf) const
+    {
+        return traverse(std::span<const node_type>(nodes), r, t_min, t_max, leaf);
+    }
+
+    // NOTE: also works on nodes that are not owned by a bvh, e.g. mapped from a scene cache
+    template<typename LeafFunc>
+    static bool traverse(std::span<const node_type> nodes, const ray_type& r, FloatType t_min, FloatType t_max, LeafFunc&& leaf)
+    {
+        if (nodes.empty())
+            return false;
+
+        const FloatType origin[3] = { r.origin.getX(), r.origin.getY(), r.origin.getZ() };
+        const FloatType inv_dir[3] = { 1 / r.direction.getX(), 1 / r.direction.getY(), 1 / r.direction.getZ() };
+        const bool dir_is_neg[3] = { inv_dir[0] < 0, inv_dir[1] < 0, inv_dir[2] < 0 };
+
+        uint32_t stack[stack_size];
+        int stack_top = 0;
+        uint32_t current = 0;
+        bool hit_anything = false;
+
+        while (true) {
+            const node_type& node = nodes[current];
+#if RT_TRAVERSAL_STATS
+            ++s_traversal_counters.nodes_visited;
+#endif
+
+            if (intersect_node(node, origin, inv_dir, t_min, t_max)) {
+                if (node.is_leaf()) {
+#if RT_TRAVERSAL_STATS
+                    s_traversal_counters.primitive_tests += node.count;
+#endif
+                    hit_anything |= leaf(node.offset, node.count, t_max);
+                }
+                else {
+                    // NOTE: visit the near child first, the far one is often culled by then
+                    if (dir_is_neg[node.axis]) {
+                        stack[stack_top++] = current + 1;
+                        current = node.offset;
+                    }
+                    else {
+                        stack[stack_top++] = node.offset;
+                        current = current + 1;
+                    }
+                    continue;
+                }
+            }
+
+            if (stack_top == 0)
+                break;
+            current = stack[--stack_top];
+        }
+
+        return hit_anything;
+    }
+
+    // Updates the bounds bottom-up after the items moved, keeping the topology: a linear pass
+    // instead of a build. leaf_bounds(first, count) returns the bounds of a leaf's items.
+    // NOTE: the tree degrades when items move far relative to each other, rebuild then
+    template<typename LeafBoundsFunc>
+    void refit(LeafBoundsFunc&& leaf_bounds)
+    {
+        refit(std::span<node_type>(nodes), leaf_bounds);
+    }
+
+    template<typename LeafBoundsFunc>
+    static void refit(std::span<node_type> nodes, LeafBoundsFunc&& leaf_bounds)
+    {
+        // NOTE: children are stored after their parent, a backward sweep visits them first
+        for (size_t i = nodes.size(); i-- > 0;) {
+            node_type& node = nodes[i];
+            if (node.is_leaf()) {
+                set_bounds(node, leaf_bounds(node.offset, node.count));
+            }
+            else {
+                aabb_type box = node_bounds(nodes[i + 1]);
+                box.expand(node_bounds(nodes[node.offset]));
+                set_bounds(node, box);
+            }
+        }
+    }
+
+    static aabb_type node_bounds(const node_type& node)
+    {
+        return aabb_type(vec3_fp(node.lower[0], node.lower[1], node.lower[2]),
+                         vec3_fp(node.upper[0], node.upper[1], node.upper[2]));
+    }
+
+public:
+    std::vector<node_type> nodes;
+    std::vector<uint32_t> item_order;
+
+private:
+    static bool intersect_node(const node_type& node, const FloatType* origin, const FloatType* inv_dir,
+                               FloatType t_min, FloatType t_max)
+    {
+        // NOTE: the far distance is pushed out by 2 * gamma(3) (PBRT 3.9.2) so that rounding never
+        // culls a box whose contents are hit close to its faces
+        constexpr FloatType epsilon = std::numeric_limits<FloatType>::epsilon() / 2;
+        constexpr FloatType far_scale = 1 + 2 * (3 * epsilon) / (1 - 3 * epsilon);
+
+        for (int axis = 0; axis < 3; ++axis) {
+            FloatType t0 = (node.lower[axis] - origin[axis]) * inv_dir[axis];
+            FloatType t1 = (node.upper[axis] - origin[axis]) * inv_dir[axis];
+            if (inv_dir[axis] < 0)
+                std::swap(t0, t1);
+            t1 *= far_scale;
+
+            t_min = t0 > t_min ? t0 : t_min;
+            t_max = t1 < t_max ? t1 : t_max;
+        }
+
+        return t_min <= t_max;
+    }
+
+    static void set_bounds(node_type& node, const aabb_type& box)
+    {
+        node.lower[0] = box.min.getX();
+        node.lower[1] = box.min.getY();
+        node.lower[2] = box.min.getZ();
+        node.upper[0] = box.max.getX();
+        node.upper[1] = box.max.getY();
+        node.upper[2] = box.max.getZ();
+    }
+
+    uint32_t make_leaf(const aabb_type& box, uint32_t begin, uint32_t end)
+    {
+        node_type node{};
+        set_bounds(node, box);
+        node.offset = begin;
+        node.count = static_cast<uint16_t>(end - begin);
+
+        nodes.push_back(node);
+        return static_cast<uint32_t>(nodes.size() - 1);
+    }
+
+    uint32_t build_recursive(const std::vector<aabb_type>& item_bounds, uint32_t begin, uint32_t end)
+    {
+        aabb_type box, centroid_box;
+        for (uint32_t i = begin; i < end; ++i) {
+            box.expand(item_bounds[item_order[i]]);
+            centroid_box.expand(m_centroids[item_order[i]]);
+        }
+
+        const uint32_t count = end - begin;
+        if (count == 1)
+            return make_leaf(box, begin, end);
+
+        const int axis = centroid_box.longest_axis();
+        const FloatType axis_min = component(centroid_box.min, axis);
+        const FloatType axis_extent = component(centroid_box.max, axis) - axis_min;
+
+        uint32_t mid = begin + count / 2;
+
+        if (axis_extent <= 0) {
+            // NOTE: all centroids coincide, no split plane separates them
+            if (static_cast<int>(count) <= m_max_leaf_size)
+                return make_leaf(box, begin, end);
+        }
+        else {
+            struct bin { aabb_type box; uint32_t count = 0; };
+            bin bins[bin_count];
+
+            const FloatType scale = bin_count / axis_extent;
+            auto bin_index = [&](uint32_t item) {
+                int b = static_cast<int>((component(m_centroids[item], axis) - axis_min) * scale);
+                return std::clamp(b, 0, bin_count - 1);
+            };
+
+            for (uint32_t i = begin; i < end; ++i) {
+                bin& b = bins[bin_index(item_order[i])];
+                b.box.expand(item_bounds[item_order[i]]);
+                ++b.count;
+            }
+
+            // sweep from the right to get the cost of every split plane
+            FloatType right_area[bin_count - 1];
+            uint32_t right_count[bin_count - 1];
+            aabb_type right_box;
+            uint32_t right_sum = 0;
+            for (int b = bin_count - 1; b > 0; --b) {
+                right_box.expand(bins[b].box);
+                right_sum += bins[b].count;
+                right_area[b - 1] = right_box.surface_area();
+                right_count[b - 1] = right_sum;
+            }
+
+            aabb_type left_box;
+            uint32_t left_sum = 0;
+            FloatType best_cost = std::numeric_limits<FloatType>::infinity();
+            int best_split = -1;
+            for (int b = 0; b < bin_count - 1; ++b) {
+                left_box.expand(bins[b].box);
+                left_sum += bins[b].count;
+                if (left_sum == 0 || right_count[b] == 0)
+                    continue;
+
+                FloatType cost = left_sum * left_box.surface_area() + right_count[b] * right_area[b];
+                if (cost < best_cost) {
+                    best_cost = cost;
+                    best_split = b;
+                }
+            }
+
+            // NOTE: relative to a traversal step costing as much as one leaf test
+            const uint32_t tests = (count + m_items_per_test - 1) / m_items_per_test;
+            const FloatType leaf_cost = tests * box.surface_area();
+            const FloatType split_cost = box.surface_area() + best_cost / m_items_per_test;
+
+            if (static_cast<int>(count) <= m_max_leaf_size && leaf_cost <= split_cost)
+                return make_leaf(box, begin, end);
+
+            if (best_split >= 0) {
+                auto* split = std::partition(item_order.data() + begin, item_order.data() + end,
+                                             [&](uint32_t item) { return bin_index(item) <= best_split; });
+                mid = static_cast<uint32_t>(split - item_order.data());
+            }
+        }
+
+        if (mid == begin || mid == end) {
+            std::nth_element(item_order.begin() + begin, item_order.begin() + begin + count / 2, item_order.begin() + end,
+                             [&](uint32_t a, uint32_t b) { return component(m_centroids[a], axis) < component(m_centroids[b], axis); });
+            mid = begin + count / 2;
+        }
+
+        const uint32_t index = static_cast<uint32_t>(nodes.size());
+        nodes.emplace_back();
+        set_bounds(nodes[index], box);
+        nodes[index].axis = static_cast<uint8_t>(axis);
+
+        build_recursive(item_bounds, begin, mid);
+        nodes[index].offset = build_recursive(item_bounds, mid, end);
+
+        return index;
+    }
+
+    std::vector<vec3_fp> m_centroids;
+    int m_max_leaf_size = 1;
+    int m_items_per_test = 1;
+};
+
+} // namespace rt
@@ -1,8 +1,11 @@
 #pragma once
 
+#include <vector>
+
 #include "common/rt_math.hpp"
 #include "common/vec3.hpp"
 #include "common/ray.hpp"
+#include "common/utility.hpp"
 
 
 namespace rt
@@ -19,9 +22,12 @@ class camera
 public:
     camera(vec3_fp look_from, vec3_fp look_at, vec3_fp up,
            FloatType vfov_degree, FloatType aspect_ratio,
-           FloatType aperture, FloatType focus_distance)
+           FloatType aperture, FloatType focus_distance,
+           FloatType time0 = 0, FloatType time1 = 0)
         : origin(look_from)
         , lens_radius(aperture / 2)
+        , time0(time0)
+        , time1(time1)
     {
         auto theta = rt::radians(vfov_degree);
         auto half_height = rt::tan(theta / 2);
@@ -37,8 +43,13 @@ public:
         vertical = 2 * half_height * focus_distance * v;
     }
 
+    // ThinLens = false compiles out the unit-disk sample, use it when lens_radius is 0
+    template<bool ThinLens = true>
     ray_type get_ray(FloatType s, FloatType t) const
     {
+        if constexpr (ThinLens == false)
+            return ray_type(origin, lower_left_corner + s * horizontal + t * vertical - origin, sample_time());
+
         // NOTE: tuple/pair instead of vec3 ?
         auto rd = lens_radius * s_random_gen.random_vec3_in_unit_disk();
         auto offset = u * rd.getX() + v * rd.getY();
@@ -47,7 +58,13 @@ public:
         //return ray(origin, lower_left_corner + u * horizontal + v * vertical - origin - offset);
 
         // NOTE: can be optimized a little?
-        return ray_type(origin + offset, lower_left_corner + s * horizontal + t * vertical - origin - offset);
+        return ray_type(origin + offset, lower_left_corner + s * horizontal + t * vertical - origin - offset, sample_time());
+    }
+
+    // NOTE: a closed shutter (time1 <= time0) draws no random number, still scenes render as before
+    FloatType sample_time() const
+    {
+        return time1 > time0 ? time0 + (time1 - time0) * s_random_gen() : time0;
     }
 
 public:
@@ -57,6 +74,114 @@ public:
     vec3_fp vertical;
     vec3_fp u, v, w;
     FloatType lens_radius;
+    FloatType time0, time1;    // shutter open and close, in frame time
+};
+
+
+// Per-frame ray setup for a fixed resolution: caches the base direction of every row and the
+// per-pixel steps, so a sample costs two multiply-adds instead of the full plane interpolation.
+// update() rebuilds only when the camera or the resolution changed since the last call.
+template<typename FloatType = float,
+    typename = std::enable_if_t<std::is_floating_point<FloatType>::value>
+>
+class camera_ray_table
+{
+    using vec3_fp = vec3<FloatType>;
+    using ray_type = ray<FloatType>;
+    using camera_type = camera<FloatType>;
+
+public:
+    camera_ray_table()
+        : m_lens_radius(0)
+        , m_time0(0)
+        , m_time1(0)
+        , m_width(0)
+        , m_height(0)
+    {}
+
+    bool update(const camera_type& cam, int width, int height)
+    {
+        if (width == m_width && height == m_height && same_camera(cam))
+            return false;
+
+        m_width = width;
+        m_height = height;
+        m_origin = cam.origin;
+        m_lower_left_corner = cam.lower_left_corner;
+        m_horizontal = cam.horizontal;
+        m_vertical = cam.vertical;
+        m_u = cam.u;
+        m_v = cam.v;
+        m_lens_radius = cam.lens_radius;
+        m_time0 = cam.time0;
+        m_time1 = cam.time1;
+
+        m_pixel_dx = m_horizontal / static_cast<FloatType>(width);
+        m_pixel_dy = m_vertical / static_cast<FloatType>(height);
+
+        m_row_directions.resize(height);
+        for (int j = 0; j < height; ++j)
+            m_row_directions[j] = m_lower_left_corner + static_cast<FloatType>(j) * m_pixel_dy - m_origin;
+
+        return true;
+    }
+
+    bool thin_lens() const
+    {
+        return m_lens_radius > 0;
+    }
+
+    // dx, dy in [0, 1) is the sample position inside pixel (i, j)
+    template<bool ThinLens = true>
+    ray_type get_ray(int i, int j, FloatType dx, FloatType dy) const
+    {
+        auto direction = m_row_directions[j] + (static_cast<FloatType>(i) + dx) * m_pixel_dx + dy * m_pixel_dy;
+
+        if constexpr (ThinLens == false)
+            return ray_type(m_origin, direction, sample_time());
+
+        auto rd = m_lens_radius * s_random_gen.random_vec3_in_unit_disk();
+        auto offset = m_u * rd.getX() + m_v * rd.getY();
+
+        return ray_type(m_origin + offset, direction - offset, sample_time());
+    }
+
+private:
+    static bool same_vector(const vec3_fp& a, const vec3_fp& b)
+    {
+        return a.getX() == b.getX() && a.getY() == b.getY() && a.getZ() == b.getZ();
+    }
+
+    FloatType sample_time() const
+    {
+        return m_time1 > m_time0 ? m_time0 + (m_time1 - m_time0) * s_random_gen() : m_time0;
+    }
+
+    bool same_camera(const camera_type& cam) const
+    {
+        return cam.lens_radius == m_lens_radius
+            && cam.time0 == m_time0 && cam.time1 == m_time1
+            && same_vector(cam.origin, m_origin)
+            && same_vector(cam.lower_left_corner, m_lower_left_corner)
+            && same_vector(cam.horizontal, m_horizontal)
+            && same_vector(cam.vertical, m_vertical)
+            && same_vector(cam.u, m_u)
+            && same_vector(cam.v, m_v);
+    }
+
+    std::vector<vec3_fp> m_row_directions;
+    vec3_fp m_pixel_dx;
+    vec3_fp m_pixel_dy;
+
+    vec3_fp m_origin;
+    vec3_fp m_lower_left_corner;
+    vec3_fp m_horizontal;
+    vec3_fp m_vertical;
+    vec3_fp m_u, m_v;
+    FloatType m_lens_radius;
+    FloatType m_time0, m_time1;
+    int m_width;
+    int m_height;
 };
 
 } //namespace rt
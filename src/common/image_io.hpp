@@ -0,0 +1,132 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+
+namespace rt
+{
+
+// Minimal readers/writers for binary PPM (P6, 8-bit) and PFM (PF, 32-bit float) images.
+// Both are headerless enough to be written without a dependency and are used for image
+// comparisons (tools/image_diff) and float partial images.
+struct image
+{
+    int width = 0;
+    int height = 0;
+    int channels = 3;
+    std::vector<float> data;    // row-major, top row first, values of 8-bit images scaled to [0, 1]
+};
+
+
+namespace detail
+{
+
+inline bool read_header_token(std::FILE* file, std::string& token)
+{
+    token.clear();
+    int c = std::fgetc(file);
+
+    while (c != EOF) {
+        if (c == '#') {
+            while (c != EOF && c != '\n')
+                c = std::fgetc(file);
+        }
+        else if (c == ' ' || c == '\t' || c == '\r' || c == '\n') {
+            if (token.empty() == false)
+                return true;
+        }
+        else {
+            token.push_back(static_cast<char>(c));
+        }
+        c = std::fgetc(file);
+    }
+
+    return token.empty() == false;
+}
+
+} // namespace detail
+
+
+inline bool write_ppm(const char* path, int width, int height, const uint8_t* rgb, bool flip_vertically = false)
+{
+    std::FILE* file = std::fopen(path, "wb");
+    if (file == nullptr)
+        return false;
+
+    std::fprintf(file, "P6\n%d %d\n255\n", width, height);
+
+    bool ok = true;
+    const size_t row_size = size_t(width) * 3;
+    for (int j = 0; j < height && ok; ++j) {
+        const int row = flip_vertically ? height - 1 - j : j;
+        ok = std::fwrite(rgb + row * row_size, 1, row_size, file) == row_size;
+    }
+    std::fclose(file);
+
+    return ok;
+}
+
+// PFM rows are stored bottom-to-top; `rgb` is top row first like everywhere else
+inline bool write_pfm(const char* path, int width, int height, const float* rgb)
+{
+    std::FILE* file = std::fopen(path, "wb");
+    if (file == nullptr)
+        return false;
+
+    std::fprintf(file, "PF\n%d %d\n-1.0\n", width, height);
+
+    bool ok = true;
+    const size_t row_size = size_t(width) * 3;
+    for (int j = height - 1; j >= 0 && ok; --j)
+        ok = std::fwrite(rgb + j * row_size, sizeof(float), row_size, file) == row_size;
+    std::fclose(file);
+
+    return ok;
+}
+
+inline bool read_image(const char* path, image& img)
+{
+    std::FILE* file = std::fopen(path, "rb");
+    if (file == nullptr)
+        return false;
+
+    std::string magic, width, height, scale;
+    bool ok = detail::read_header_token(file, magic)
+           && detail::read_header_token(file, width)
+           && detail::read_header_token(file, height)
+           && detail::read_header_token(file, scale);
+
+    if (ok) {
+        img.width = std::stoi(width);
+        img.height = std::stoi(height);
+        img.channels = 3;
+        img.data.resize(size_t(img.width) * img.height * 3);
+        const size_t row_size = size_t(img.width) * 3;
+
+        if (magic == "P6" && std::stoi(scale) == 255) {
+            std::vector<uint8_t> row(row_size);
+            for (int j = 0; j < img.height && ok; ++j) {
+                ok = std::fread(row.data(), 1, row_size, file) == row_size;
+                for (size_t i = 0; i < row_size; ++i)
+                    img.data[j * row_size + i] = row[i] / 255.0f;
+            }
+        }
+        else if (magic == "PF" && std::stof(scale) < 0) {
+            for (int j = img.height - 1; j >= 0 && ok; --j)
+                ok = std::fread(img.data.data() + j * row_size, sizeof(float), row_size, file) == row_size;
+        }
+        else {
+            ok = false;    // big-endian PFM, greyscale and 16-bit PPM are not supported
+        }
+    }
+
+    std::fclose(file);
+
+    return ok;
+}
+
+} // namespace rt
@@ -0,0 +1,363 @@
+#pragma once
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+
+namespace rt
+{
+
+// JSON-like document for scene and settings files. Besides strict JSON the parser takes
+// `//` and `#` line comments and trailing commas, which hand-edited scene files tend to have.
+// Numbers are parsed with std::from_chars, and every value remembers the source range it was
+// parsed from.
+class json_value
+{
+public:
+    enum class kind : uint8_t { null, boolean, number, string, array, object };
+
+    bool is_null() const { return type == kind::null; }
+    bool is_bool() const { return type == kind::boolean; }
+    bool is_number() const { return type == kind::number; }
+    bool is_string() const { return type == kind::string; }
+    bool is_array() const { return type == kind::array; }
+    bool is_object() const { return type == kind::object; }
+
+    // false unless this is a finite number that T can hold, integers are truncated; std::from_chars
+    // takes "1e300" and "nan", which a plain cast would turn into undefined behavior
+    template<typename T>
+    bool get_number(T& out) const
+    {
+        if (is_number() == false || std::isfinite(number) == false)
+            return false;
+
+        if constexpr (std::is_integral_v<T>) {
+            // NOTE: 2^digits is exact in a double, the maximum of a 64-bit type is not
+            if (number < double(std::numeric_limits<T>::lowest()) || number >= std::ldexp(1.0, std::numeric_limits<T>::digits))
+                return false;
+        }
+        else if (std::abs(number) > double(std::numeric_limits<T>::max())) {
+            return false;
+        }
+
+        out = static_cast<T>(number);
+        return true;
+    }
+
+    // nullptr when this is not an object or has no such member
+    const json_value* find(std::string_view key) const
+    {
+        for (const auto& member : members) {
+            if (member.first == key)
+                return &member.second;
+        }
+        return nullptr;
+    }
+
+public:
+    kind type = kind::null;
+    bool boolean = false;
+    double number = 0;
+    std::string string;
+    std::vector<json_value> elements;                          // arrays
+    std::vector<std::pair<std::string, json_value>> members;   // objects, in file order
+    size_t source_begin = 0;
+    size_t source_end = 0;
+};
+
+
+namespace detail
+{
+
+class json_parser
+{
+public:
+    explicit json_parser(std::string_view text)
+        : m_text(text)
+    {}
+
+    bool parse(json_value& root, std::string& error)
+    {
+        if (parse_value(root, 0) == false || (skip_whitespace(), m_position != m_text.size())) {
+            if (m_error.empty())
+                m_error = "unexpected trailing characters";
+            error = location() + m_error;
+            return false;
+        }
+        return true;
+    }
+
+private:
+    static constexpr int max_depth = 256;
+
+    bool fail(const char* message)
+    {
+        m_error = message;
+        return false;
+    }
+
+    std::string location() const
+    {
+        size_t line = 1, column = 1;
+        for (size_t i = 0; i < m_position && i < m_text.size(); ++i) {
+            if (m_text[i] == '\n') {
+                ++line;
+                column = 1;
+            }
+            else {
+                ++column;
+            }
+        }
+        return "line " + std::to_string(line) + ", column " + std::to_string(column) + ": ";
+    }
+
+    void skip_whitespace()
+    {
+        while (m_position < m_text.size()) {
+            const char c = m_text[m_position];
+            if (c == ' ' || c == '\t' || c == '\r' || c == '\n') {
+                ++m_position;
+            }
+            else if (c == '#' || (c == '/' && m_position + 1 < m_text.size() && m_text[m_position + 1] == '/')) {
+                while (m_position < m_text.size() && m_text[m_position] != '\n')
+                    ++m_position;
+            }
+            else {
+                break;
+            }
+        }
+    }
+
+    bool consume(std::string_view word)
+    {
+        if (m_text.substr(m_position, word.size()) != word)
+            return false;
+        m_position += word.size();
+        return true;
+    }
+
+    bool parse_value(json_value& value, int depth)
+    {
+        if (depth > max_depth)
+            return fail("nesting is too deep");
+
+        skip_whitespace();
+        if (m_position >= m_text.size())
+            return fail("unexpected end of input");
+
+        value.source_begin = m_position;
+        bool ok = true;
+
+        switch (m_text[m_position]) {
+        case '{':
+            ok = parse_object(value, depth);
+            break;
+        case '[':
+            ok = parse_array(value, depth);
+            break;
+        case '"':
+            value.type = json_value::kind::string;
+            ok = parse_string(value.string);
+            break;
+        case 't':
+        case 'f':
+            value.type = json_value::kind::boolean;
+            value.boolean = m_text[m_position] == 't';
+            ok = consume(value.boolean ? "true" : "false") || fail("invalid literal");
+            break;
+        case 'n':
+            value.type = json_value::kind::null;
+            ok = consume("null") || fail("invalid literal");
+            break;
+        default:
+            value.type = json_value::kind::number;
+            ok = parse_number(value.number);
+            break;
+        }
+
+        value.source_end = m_position;
+        return ok;
+    }
+
+    bool parse_number(double& number)
+    {
+        const char* begin = m_text.data() + m_position;
+        const char* end = m_text.data() + m_text.size();
+        if (begin < end && *begin == '+')
+            ++begin;
+
+        auto result = std::from_chars(begin, end, number);
+        if (result.ec != std::errc())
+            return fail("invalid value");
+
+        m_position = result.ptr - m_text.data();
+        return true;
+    }
+
+    bool parse_string(std::string& out)
+    {
+        ++m_position;    // opening quote
+
+        while (m_position < m_text.size()) {
+            const char c = m_text[m_position++];
+            if (c == '"')
+                return true;
+            if (c == '\n')
+                return fail("unterminated string");
+            if (c != '\\') {
+                out.push_back(c);
+                continue;
+            }
+
+            if (m_position >= m_text.size())
+                break;
+
+            const char escaped = m_text[m_position++];
+            switch (escaped) {
+            case 'n': out.push_back('\n'); break;
+            case 't': out.push_back('\t'); break;
+            case 'r': out.push_back('\r'); break;
+            case 'b': out.push_back('\b'); break;
+            case 'f': out.push_back('\f'); break;
+            case '"': case '\\': case '/': out.push_back(escaped); break;
+            case 'u': {
+                // NOTE: encoded as UTF-8, surrogate pairs are not combined
+                unsigned code = 0;
+                auto result = std::from_chars(m_text.data() + m_position, m_text.data() + std::min(m_position + 4, m_text.size()), code, 16);
+                if (result.ec != std::errc() || result.ptr != m_text.data() + m_position + 4)
+                    return fail("invalid \\u escape");
+                m_position += 4;
+
+                if (code < 0x80) {
+                    out.push_back(static_cast<char>(code));
+                }
+                else if (code < 0x800) {
+                    out.push_back(static_cast<char>(0xc0 | (code >> 6)));
+                    out.push_back(static_cast<char>(0x80 | (code & 0x3f)));
+                }
+                else {
+                    out.push_back(static_cast<char>(0xe0 | (code >> 12)));
+                    out.push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3f)));
+                    out.push_back(static_cast<char>(0x80 | (code & 0x3f)));
+                }
+                break;
+            }
+            default:
+                return fail("invalid escape sequence");
+            }
+        }
+
+        return fail("unterminated string");
+    }
+
+    bool parse_array(json_value& value, int depth)
+    {
+        value.type = json_value::kind::array;
+        ++m_position;
+
+        while (true) {
+            skip_whitespace();
+            if (m_position < m_text.size() && m_text[m_position] == ']') {
+                ++m_position;
+                return true;
+            }
+
+            value.elements.emplace_back();
+            if (parse_value(value.elements.back(), depth + 1) == false)
+                return false;
+
+            skip_whitespace();
+            if (m_position < m_text.size() && m_text[m_position] == ',')
+                ++m_position;
+            else if (m_position >= m_text.size() || m_text[m_position] != ']')
+                return fail("expected ',' or ']'");
+        }
+    }
+
+    bool parse_object(json_value& value, int depth)
+    {
+        value.type = json_value::kind::object;
+        ++m_position;
+
+        while (true) {
+            skip_whitespace();
+            if (m_position < m_text.size() && m_text[m_position] == '}') {
+                ++m_position;
+                return true;
+            }
+
+            if (m_position >= m_text.size() || m_text[m_position] != '"')
+                return fail("expected a member name");
+
+            value.members.emplace_back();
+            auto& member = value.members.back();
+            if (parse_string(member.first) == false)
+                return false;
+
+            skip_whitespace();
+            if (m_position >= m_text.size() || m_text[m_position] != ':')
+                return fail("expected ':'");
+            ++m_position;
+
+            if (parse_value(member.second, depth + 1) == false)
+                return false;
+
+            skip_whitespace();
+            if (m_position < m_text.size() && m_text[m_position] == ',')
+                ++m_position;
+            else if (m_position >= m_text.size() || m_text[m_position] != '}')
+                return fail("expected ',' or '}'");
+        }
+    }
+
+    std::string_view m_text;
+    size_t m_position = 0;
+    std::string m_error;
+};
+
+} // namespace detail
+
+
+// `text` quoted and escaped, for writing JSON
+inline std::string json_quote(std::string_view text)
+{
+    std::string out = "\"";
+    for (const char c : text) {
+        switch (c) {
+        case '"': out += "\\\""; break;
+        case '\\': out += "\\\\"; break;
+        case '\n': out += "\\n"; break;
+        case '\r': out += "\\r"; break;
+        case '\t': out += "\\t"; break;
+        default:
+            if (static_cast<unsigned char>(c) < 0x20) {
+                char escaped[8];
+                std::snprintf(escaped, sizeof(escaped), "\\u%04x", static_cast<unsigned>(c));
+                out += escaped;
+            }
+            else {
+                out += c;
+            }
+        }
+    }
+    return out + '"';
+}
+
+// On failure `error` holds the line and column of the problem
+inline bool parse_json(std::string_view text, json_value& root, std::string& error)
+{
+    root = json_value();
+    return detail::json_parser(text).parse(root, error);
+}
+
+} // namespace rt
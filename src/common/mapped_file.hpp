@@ -0,0 +1,142 @@
+#pragma once
+
+#include <cstddef>
+#include <utility>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+namespace rt
+{
+
+// Read-only memory mapping of a whole file. Loaders parse straight out of the mapping, so
+// large assets are never copied into an intermediate buffer; pages are faulted in by the
+// threads that read them.
+class mapped_file
+{
+public:
+    mapped_file() = default;
+
+    explicit mapped_file(const char* path)
+    {
+        open(path);
+    }
+
+    mapped_file(const mapped_file&) = delete;
+    mapped_file& operator=(const mapped_file&) = delete;
+
+    mapped_file(mapped_file&& other) noexcept
+        : m_data(std::exchange(other.m_data, nullptr))
+        , m_size(std::exchange(other.m_size, 0))
+        , m_is_open(std::exchange(other.m_is_open, false))
+    {}
+
+    ~mapped_file()
+    {
+        close();
+    }
+
+    // NOTE: an empty file opens fine, with data() == nullptr and size() == 0
+    bool open(const char* path)
+    {
+        close();
+
+#if defined(_WIN32)
+        HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                                  FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+            return false;
+
+        LARGE_INTEGER size;
+        if (GetFileSizeEx(file, &size) == FALSE) {
+            CloseHandle(file);
+            return false;
+        }
+
+        if (size.QuadPart > 0) {
+            HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            if (mapping != nullptr) {
+                m_data = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+                CloseHandle(mapping);    // the view keeps the mapping alive
+            }
+            if (m_data == nullptr) {
+                CloseHandle(file);
+                return false;
+            }
+        }
+        CloseHandle(file);
+        m_size = static_cast<size_t>(size.QuadPart);
+#else
+        int fd = ::open(path, O_RDONLY);
+        if (fd < 0)
+            return false;
+
+        struct stat info;
+        if (::fstat(fd, &info) != 0) {
+            ::close(fd);
+            return false;
+        }
+
+        if (info.st_size > 0) {
+            void* memory = ::mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            if (memory == MAP_FAILED) {
+                ::close(fd);
+                return false;
+            }
+            ::madvise(memory, static_cast<size_t>(info.st_size), MADV_SEQUENTIAL);
+            m_data = static_cast<const char*>(memory);
+        }
+        ::close(fd);    // the mapping keeps the file alive
+        m_size = static_cast<size_t>(info.st_size);
+#endif
+
+        m_is_open = true;
+        return true;
+    }
+
+    void close()
+    {
+        if (m_data != nullptr) {
+#if defined(_WIN32)
+            UnmapViewOfFile(m_data);
+#else
+            ::munmap(const_cast<char*>(m_data), m_size);
+#endif
+        }
+
+        m_data = nullptr;
+        m_size = 0;
+        m_is_open = false;
+    }
+
+    bool is_open() const
+    {
+        return m_is_open;
+    }
+
+    const char* data() const
+    {
+        return m_data;
+    }
+
+    size_t size() const
+    {
+        return m_size;
+    }
+
+private:
+    const char* m_data = nullptr;
+    size_t m_size = 0;
+    bool m_is_open = false;
+};
+
+} // namespace rt
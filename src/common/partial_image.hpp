@@ -0,0 +1,195 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+
+namespace rt
+{
+
+// Partial image of a sample-range render: for every pixel the sum of samples [sample_begin,
+// sample_end) in 32.32 fixed point. Integer sums don't depend on the order they are added in,
+// so partial images of adjacent ranges merge to exactly the sums of one render of the whole
+// range, however the samples were split across nodes. Pixels are row-major, rows from the bottom
+// like the frame.
+struct partial_image
+{
+    static constexpr int fraction_bits = 32;
+
+    int width = 0;
+    int height = 0;
+    uint64_t scene_key = 0;
+    uint32_t sample_begin = 0;
+    uint32_t sample_end = 0;
+    std::vector<uint64_t> sums;    // three per pixel
+
+    void reset(int width_, int height_, uint64_t scene_key_, uint32_t sample_begin_, uint32_t sample_end_)
+    {
+        width = width_;
+        height = height_;
+        scene_key = scene_key_;
+        sample_begin = sample_begin_;
+        sample_end = sample_end_;
+        sums.assign(size_t(width) * height * 3, 0);
+    }
+
+    uint32_t sample_count() const
+    {
+        return sample_end - sample_begin;
+    }
+
+    void add_sample(size_t pixel, float r, float g, float b)
+    {
+        uint64_t* sum = sums.data() + pixel * 3;
+        sum[0] += quantize(r);
+        sum[1] += quantize(g);
+        sum[2] += quantize(b);
+    }
+
+    // Averaged linear color of `pixel`
+    void resolve(size_t pixel, float* rgb) const
+    {
+        const double scale = 1.0 / (double(sample_count()) * double(uint64_t(1) << fraction_bits));
+        for (int c = 0; c < 3; ++c)
+            rgb[c] = static_cast<float>(double(sums[pixel * 3 + c]) * scale);
+    }
+
+    // Gamma 2 and 8-bit quantization of the whole image, the one conversion the renderer and
+    // tools/merge_samples share so that their images match to the bit
+    void resolve_rgb8(std::vector<uint8_t>& rgb) const
+    {
+        rgb.resize(sums.size());
+        for (size_t pixel = 0; pixel < sums.size() / 3; ++pixel) {
+            float color[3];
+            resolve(pixel, color);
+            for (int c = 0; c < 3; ++c)
+                rgb[pixel * 3 + c] = static_cast<uint8_t>(std::sqrt(color[c]) * 255.999f);
+        }
+    }
+
+private:
+    static uint64_t quantize(float value)
+    {
+        // NOTE: radiance is in [0, 1] here, the clamp only keeps NaNs and outliers from
+        // overflowing the sums; 2^16 per sample leaves room for 2^16 samples
+        if ((value > 0) == false)
+            return 0;
+        const double clamped = value < 65536.0f ? double(value) : 65536.0;
+        return static_cast<uint64_t>(clamped * double(uint64_t(1) << fraction_bits) + 0.5);
+    }
+};
+
+
+namespace detail
+{
+
+inline constexpr char partial_image_magic[8] = { 'R', 'T', 'P', 'A', 'R', 'T', '\0', '\0' };
+inline constexpr uint32_t partial_image_version = 1;
+inline constexpr uint32_t partial_image_byte_order = 0x01020304;
+
+struct partial_image_header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t fraction_bits;
+    int32_t width;
+    int32_t height;
+    uint32_t sample_begin;
+    uint32_t sample_end;
+    uint32_t reserved;
+    uint64_t scene_key;
+};
+
+} // namespace detail
+
+
+inline bool write_partial_image(const char* path, const partial_image& image, std::string& error)
+{
+    detail::partial_image_header header{};
+    std::memcpy(header.magic, detail::partial_image_magic, sizeof(header.magic));
+    header.version = detail::partial_image_version;
+    header.byte_order = detail::partial_image_byte_order;
+    header.fraction_bits = partial_image::fraction_bits;
+    header.width = image.width;
+    header.height = image.height;
+    header.sample_begin = image.sample_begin;
+    header.sample_end = image.sample_end;
+    header.scene_key = image.scene_key;
+
+    std::FILE* file = std::fopen(path, "wb");
+    if (file == nullptr) {
+        error = std::string("can't write ") + path;
+        return false;
+    }
+
+    bool ok = std::fwrite(&header, sizeof(header), 1, file) == 1
+        && std::fwrite(image.sums.data(), sizeof(uint64_t), image.sums.size(), file) == image.sums.size();
+    ok = std::fclose(file) == 0 && ok;
+
+    if (ok == false) {
+        std::remove(path);
+        error = std::string("can't write ") + path;
+    }
+    return ok;
+}
+
+inline bool read_partial_image(const char* path, partial_image& image, std::string& error)
+{
+    std::FILE* file = std::fopen(path, "rb");
+    if (file == nullptr) {
+        error = std::string("can't open ") + path;
+        return false;
+    }
+
+    detail::partial_image_header header;
+    bool ok = std::fread(&header, sizeof(header), 1, file) == 1
+        && std::memcmp(header.magic, detail::partial_image_magic, sizeof(header.magic)) == 0;
+    if (ok == false)
+        error = "not a partial image";
+    else if (header.version != detail::partial_image_version || header.byte_order != detail::partial_image_byte_order
+             || header.fraction_bits != partial_image::fraction_bits) {
+        error = "partial image of another version or byte order";
+        ok = false;
+    }
+    else if (header.width <= 0 || header.height <= 0 || header.sample_end <= header.sample_begin) {
+        error = "partial image has an invalid size or sample range";
+        ok = false;
+    }
+
+    if (ok) {
+        image.reset(header.width, header.height, header.scene_key, header.sample_begin, header.sample_end);
+        ok = std::fread(image.sums.data(), sizeof(uint64_t), image.sums.size(), file) == image.sums.size();
+        if (ok == false)
+            error = "partial image is truncated";
+    }
+
+    std::fclose(file);
+    return ok;
+}
+
+// Adds `part` to `image`, its samples must follow on directly: merging in range order makes a
+// gap or an overlap an error instead of a silently biased average
+inline bool merge_partial_image(partial_image& image, const partial_image& part, std::string& error)
+{
+    if (part.width != image.width || part.height != image.height || part.scene_key != image.scene_key) {
+        error = "partial images of different scenes or sizes";
+        return false;
+    }
+    if (part.sample_begin != image.sample_end) {
+        error = "samples " + std::to_string(image.sample_end) + " to " + std::to_string(part.sample_begin) + " are "
+              + (part.sample_begin > image.sample_end ? "missing" : "rendered twice");
+        return false;
+    }
+
+    for (size_t i = 0; i < image.sums.size(); ++i)
+        image.sums[i] += part.sums[i];
+    image.sample_end = part.sample_end;
+    return true;
+}
+
+} // namespace rt
@@ -0,0 +1,210 @@
+#pragma once
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#if defined(__linux__)
+    #include <linux/perf_event.h>
+    #include <sys/ioctl.h>
+    #include <sys/syscall.h>
+    #include <unistd.h>
+#endif
+
+
+// Hardware performance counters around a region of code, Linux perf_event_open only. Counts
+// the calling thread and the threads it starts while counting (they must have ended before
+// stop(), as render threads are joined), in user space only, so perf_event_paranoid <= 2 is
+// enough. Events the CPU or a virtual machine doesn't offer are left out; the kernel
+// multiplexes the others if there are more than counters, and the values are scaled for that.
+namespace rt
+{
+
+enum class perf_event { cycles, instructions, l1d_misses, llc_misses, branch_misses, count };
+
+inline const char* to_string(perf_event event)
+{
+    switch (event) {
+    case perf_event::cycles: return "cycles";
+    case perf_event::instructions: return "instructions";
+    case perf_event::l1d_misses: return "l1d_misses";
+    case perf_event::llc_misses: return "llc_misses";
+    case perf_event::branch_misses: return "branch_misses";
+    default: return "unknown";
+    }
+}
+
+struct perf_sample
+{
+    static constexpr int event_count = int(perf_event::count);
+
+    bool valid[event_count] = {};
+    double value[event_count] = {};
+
+    bool has(perf_event event) const
+    {
+        return valid[int(event)];
+    }
+
+    double operator[](perf_event event) const
+    {
+        return value[int(event)];
+    }
+};
+
+
+// JSON object of the events per `divisor` (ops, rays), null for the events that weren't counted
+inline std::string perf_json(const perf_sample& sample, double divisor)
+{
+    std::string json = "{ ";
+    for (int i = 0; i < perf_sample::event_count; ++i) {
+        json += std::string(i > 0 ? ", \"" : "\"") + to_string(perf_event(i)) + "\": "
+              + (sample.valid[i] ? std::to_string(sample.value[i] / divisor) : "null");
+    }
+    return json + " }";
+}
+
+
+class perf_counters
+{
+public:
+    perf_counters()
+    {
+        for (int& fd : m_fds)
+            fd = -1;
+    }
+
+    ~perf_counters()
+    {
+        close();
+    }
+
+    perf_counters(const perf_counters&) = delete;
+    perf_counters& operator=(const perf_counters&) = delete;
+
+    // Fails with a reason in `error` if no event could be opened
+    bool open(std::string& error)
+    {
+        close();
+
+#if defined(__linux__)
+        int opened = 0;
+        for (int i = 0; i < perf_sample::event_count; ++i) {
+            perf_event_attr attr;
+            std::memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.disabled = 1;
+            attr.inherit = 1;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+            set_event(perf_event(i), attr);
+
+            m_fds[i] = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+            if (m_fds[i] >= 0)
+                ++opened;
+        }
+
+        if (opened == 0) {
+            error = std::string("perf_event_open failed, ") + std::strerror(errno)
+                  + " (see /proc/sys/kernel/perf_event_paranoid)";
+            return false;
+        }
+        return true;
+#else
+        error = "hardware counters need Linux perf_event_open";
+        return false;
+#endif
+    }
+
+    void close()
+    {
+#if defined(__linux__)
+        for (int& fd : m_fds) {
+            if (fd >= 0)
+                ::close(fd);
+            fd = -1;
+        }
+#endif
+    }
+
+    bool is_open() const
+    {
+        for (int fd : m_fds) {
+            if (fd >= 0)
+                return true;
+        }
+        return false;
+    }
+
+    void start()
+    {
+#if defined(__linux__)
+        for (int fd : m_fds) {
+            if (fd >= 0) {
+                ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+                ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+            }
+        }
+#endif
+    }
+
+    perf_sample stop()
+    {
+        perf_sample sample;
+
+#if defined(__linux__)
+        for (int fd : m_fds) {
+            if (fd >= 0)
+                ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+        }
+
+        for (int i = 0; i < perf_sample::event_count; ++i) {
+            // NOTE: value, time enabled, time running; running < enabled when multiplexed
+            uint64_t values[3];
+            if (m_fds[i] < 0 || ::read(m_fds[i], values, sizeof(values)) != sizeof(values) || values[2] == 0)
+                continue;
+            sample.valid[i] = true;
+            sample.value[i] = double(values[0]) * double(values[1]) / double(values[2]);
+        }
+#endif
+
+        return sample;
+    }
+
+private:
+#if defined(__linux__)
+    static void set_event(perf_event event, perf_event_attr& attr)
+    {
+        constexpr uint64_t read_miss = PERF_COUNT_HW_CACHE_OP_READ << 8 | PERF_COUNT_HW_CACHE_RESULT_MISS << 16;
+
+        switch (event) {
+        case perf_event::cycles:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_CPU_CYCLES;
+            break;
+        case perf_event::instructions:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+            break;
+        case perf_event::l1d_misses:
+            attr.type = PERF_TYPE_HW_CACHE;
+            attr.config = PERF_COUNT_HW_CACHE_L1D | read_miss;
+            break;
+        case perf_event::llc_misses:
+            attr.type = PERF_TYPE_HW_CACHE;
+            attr.config = PERF_COUNT_HW_CACHE_LL | read_miss;
+            break;
+        default:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+            break;
+        }
+    }
+#endif
+
+    int m_fds[perf_sample::event_count];
+};
+
+} // namespace rt
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <spawn.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+extern char** environ;
+#endif
+
+
+namespace rt
+{
+
+// Path of the running executable, for starting more instances of it; `argv0` is the fallback
+inline std::string executable_path(const char* argv0)
+{
+    char path[4096];
+#if defined(_WIN32)
+    const DWORD length = GetModuleFileNameA(nullptr, path, sizeof(path));
+    if (length > 0 && length < sizeof(path))
+        return std::string(path, length);
+#elif defined(__linux__)
+    const ssize_t length = readlink("/proc/self/exe", path, sizeof(path));
+    if (length > 0 && static_cast<size_t>(length) < sizeof(path))
+        return std::string(path, static_cast<size_t>(length));
+#endif
+    return argv0;
+}
+
+
+// A child process started from an argument list, inheriting the console and environment.
+// The destructor waits for it, so a child never outlives its owner unnoticed.
+class child_process
+{
+public:
+    child_process() = default;
+
+    child_process(const child_process&) = delete;
+    child_process& operator=(const child_process&) = delete;
+
+    child_process(child_process&& other) noexcept
+#if defined(_WIN32)
+        : m_process(std::exchange(other.m_process, nullptr))
+#else
+        : m_pid(std::exchange(other.m_pid, -1))
+#endif
+    {}
+
+    ~child_process()
+    {
+        wait();
+    }
+
+    // args[0] is the executable
+    bool start(const std::vector<std::string>& args)
+    {
+        wait();
+        if (args.empty())
+            return false;
+
+#if defined(_WIN32)
+        std::string command_line;
+        for (const auto& arg : args)
+            command_line += (command_line.empty() ? "\"" : " \"") + arg + "\"";
+
+        STARTUPINFOA startup{};
+        startup.cb = sizeof(startup);
+        PROCESS_INFORMATION info{};
+        if (CreateProcessA(nullptr, command_line.data(), nullptr, nullptr, FALSE, 0, nullptr, nullptr, &startup, &info) == FALSE)
+            return false;
+
+        CloseHandle(info.hThread);
+        m_process = info.hProcess;
+#else
+        std::vector<char*> argv;
+        for (const auto& arg : args)
+            argv.push_back(const_cast<char*>(arg.c_str()));
+        argv.push_back(nullptr);
+
+        if (posix_spawn(&m_pid, argv[0], nullptr, nullptr, argv.data(), environ) != 0) {
+            m_pid = -1;
+            return false;
+        }
+#endif
+        return true;
+    }
+
+    // Exit code of the child, -1 if it was not started or did not exit normally
+    int wait()
+    {
+        int code = -1;
+#if defined(_WIN32)
+        if (m_process != nullptr) {
+            DWORD exit_code;
+            WaitForSingleObject(m_process, INFINITE);
+            if (GetExitCodeProcess(m_process, &exit_code))
+                code = static_cast<int>(exit_code);
+            CloseHandle(m_process);
+            m_process = nullptr;
+        }
+#else
+        if (m_pid > 0) {
+            int status;
+            if (waitpid(m_pid, &status, 0) == m_pid && WIFEXITED(status))
+                code = WEXITSTATUS(status);
+            m_pid = -1;
+        }
+#endif
+        return code;
+    }
+
+private:
+#if defined(_WIN32)
+    HANDLE m_process = nullptr;
+#else
+    pid_t m_pid = -1;
+#endif
+};
+
+} // namespace rt
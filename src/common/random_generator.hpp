@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstdint>
 #include <random>
 
 #include "common/rt_math.hpp"
@@ -9,6 +10,21 @@
 namespace rt
 {
 
+// Seed of a counter-based stream: a pure function of (stream, counter), so that e.g. sample
+// `counter` of pixel `stream` draws the same numbers whichever node, thread or order renders it.
+// The splitmix64 finalizer spreads neighbouring indices over the whole range of minstd_rand.
+inline uint32_t counter_seed(uint64_t stream, uint64_t counter)
+{
+    uint64_t z = (stream << 32 | (counter & 0xffffffff)) + 0x9e3779b97f4a7c15;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+    z ^= z >> 31;
+
+    // NOTE: [1, 2^31 - 2], the seeds minstd_rand uses as they are
+    return static_cast<uint32_t>(1 + z % 2147483646);
+}
+
+
 template<typename FloatType = float,
     class Generator = std::mt19937,
     class = std::enable_if_t<std::is_floating_point<FloatType>::value>
@@ -57,6 +73,13 @@ public:
         m_distribution.reset();
     }
 
+    // Restarts the sequence, e.g. per tile so that a tile renders the same on any thread or process
+    // NOTE: the distributions keep no state, the engine is all there is to reset
+    void seed(typename Generator::result_type value)
+    {
+        m_engine.seed(value);
+    }
+
     vec3<FloatType> random_vec3()
     {
         return vec3<FloatType>(random_number(),
@@ -85,9 +108,11 @@ public:
         FloatType a = random_number(m_dist_0_2pi);
         FloatType z = random_number(m_dist_minus1_1);
         FloatType r = rt::sqrt(1 - z * z);
+        FloatType sin_a, cos_a;
+        rt::sincos(a, sin_a, cos_a);
 
-        return vec3<FloatType>(r * rt::cos(a),
-                               r * rt::sin(a),
+        return vec3<FloatType>(r * cos_a,
+                               r * sin_a,
                                z);
     }
 
@@ -95,9 +120,11 @@ public:
     {
         auto r = rt::sqrt(random_number());
         auto theta = random_number(m_dist_0_2pi);
+        FloatType sin_theta, cos_theta;
+        rt::sincos(theta, sin_theta, cos_theta);
 
-        return vec3<FloatType>(rt::cos(theta),
-                               rt::sin(theta),
+        return vec3<FloatType>(cos_theta,
+                               sin_theta,
                                0);
     }
 
@@ -125,10 +152,12 @@ public:
 private:
     inline FloatType random_number()
     {
-        return m_distribution(m_engine);
+        return random_number(m_distribution);
     }
 
-    inline FloatType random_number(const fp_distribution& dist)
+    // NOTE: by value, operator() of the standard distributions isn't const (MSVC's is); the
+    // copy is two bounds and folds away
+    inline FloatType random_number(fp_distribution dist)
     {
         return dist(m_engine);
     }
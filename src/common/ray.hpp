@@ -6,27 +6,67 @@
 namespace rt
 {
 
+namespace detail
+{
+
+// Where a ray keeps its time. The scalar vec3 is 3 values, so the time gets a member of its own
+// in the 4 bytes the two vectors leave of a 32-byte ray. The SIMD vec3s are 4 lanes and leave
+// nothing, so the time goes into the w lane of the origin.
+template<typename FloatType, typename Vec3, bool SpareLane = sizeof(Vec3) == 4 * sizeof(FloatType)>
+struct ray_time
+{
+    FloatType get(const Vec3&) const { return m_time; }
+    void set(Vec3&, FloatType time) { m_time = time; }
+
+    FloatType m_time = 0;
+};
+
+template<typename FloatType, typename Vec3>
+struct ray_time<FloatType, Vec3, true>
+{
+    static FloatType get(const Vec3& origin) { return origin.getW(); }
+    static void set(Vec3& origin, FloatType time) { origin.setW(time); }
+};
+
+} // namespace detail
+
+
+// NOTE: aligned to its (padded) size so that a ray never straddles a cache line
 template<typename FloatType,
     typename = std::enable_if_t<std::is_floating_point<FloatType>::value>
 >
-class ray
+class alignas(8 * sizeof(FloatType)) ray : private detail::ray_time<FloatType, vec3<FloatType>>
 {
     using vec3_fp = vec3<FloatType>;
+    using time_storage = detail::ray_time<FloatType, vec3<FloatType>>;
 
 public:
-    ray() {}
-    ray(const vec3_fp& origin, const vec3_fp& direction)
+    ray()
+    {
+        time_storage::set(origin, 0);
+    }
+    ray(const vec3_fp& origin, const vec3_fp& direction, FloatType time = 0)
         : origin(origin), direction(direction)
-    {}
+    {
+        time_storage::set(this->origin, time);
+    }
 
     vec3_fp at(FloatType t) const
     {
         return origin + t * direction;
     }
 
+    // When during the frame the ray was sent, in [0, 1)
+    FloatType time() const
+    {
+        return time_storage::get(origin);
+    }
+
 public:
     vec3_fp origin;
     vec3_fp direction;
 };
 
+static_assert(sizeof(ray<float>) == 32);
+
 } // namespace rt
@@ -1,10 +1,43 @@
 #pragma once
 
 #include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <limits>
 #include <numbers>
 
 
+// RT_FAST_MATH selects the approximations from rt::fastmath for the sampling kernels
+// (rt::sincos, rt::cbrt, rt::rsqrt) instead of libm. Set it from the build (-DRT_FAST_MATH=1).
+#ifndef RT_FAST_MATH
+    #define RT_FAST_MATH 0
+#endif
+
+// Instruction set level the build targets (the RT_ARCH build option), for benchmark reports
+#ifndef RT_ARCH_NAME
+    #define RT_ARCH_NAME "default"
+#endif
+
+// SSE intrinsics where the target has them, scalar code elsewhere (-DRT_X86=0 forces that,
+// e.g. to check the fallbacks on an x86 machine)
+#ifndef RT_X86
+    #if defined(__x86_64__) || defined(_M_X64) || defined(__SSE2__)
+        #define RT_X86 1
+    #else
+        #define RT_X86 0
+    #endif
+#endif
+
+#if RT_X86
+    #include <immintrin.h>
+#endif
+#if RT_X86 && defined(_MSC_VER)
+    #include <intrin.h>
+#endif
+
+
 namespace rt
 {
 
@@ -13,32 +46,19 @@ inline T sqrt(const T v)
 {
     static_assert(std::numeric_limits<T>::is_iec559);
 
-    if constexpr (std::is_same<T, float>())
-        return std::sqrtf(v);
-    else
-        return std::sqrt(v);
+    // NOTE: the float overload, std::sqrtf is a C name only some standard libraries put into std
+    return std::sqrt(v);
 }
 
 template<typename T>
-inline T cbrt(const T v)
-{
-    static_assert(std::numeric_limits<T>::is_iec559);
-
-    if constexpr (std::is_same<T, float>())
-        return std::cbrtf(v);
-    else
-        return std::cbrt(v);
-}
+inline T cbrt(const T v);
 
 template<typename T>
 inline T sin(const T v)
 {
     static_assert(std::numeric_limits<T>::is_iec559);
 
-    if constexpr (std::is_same<T, float>())
-        return std::sinf(v);
-    else
-        return std::sin(v);
+    return std::sin(v);
 }
 
 template<typename T>
@@ -46,10 +66,7 @@ inline T cos(const T v)
 {
     static_assert(std::numeric_limits<T>::is_iec559);
 
-    if constexpr (std::is_same<T, float>())
-        return std::cosf(v);
-    else
-        return std::cos(v);
+    return std::cos(v);
 }
 
 template<typename T>
@@ -57,10 +74,7 @@ inline T tan(const T v)
 {
     static_assert(std::numeric_limits<T>::is_iec559);
 
-    if constexpr (std::is_same<T, float>())
-        return std::tanf(v);
-    else
-        return std::tan(v);
+    return std::tan(v);
 }
 
 
@@ -69,10 +83,24 @@ inline T pow(const T value, const T power)
 {
     static_assert(std::numeric_limits<T>::is_iec559);
 
-    if constexpr (std::is_same<T, float>())
-        return std::powf(value, power);
+    return std::pow(value, power);
+}
+
+
+// Integer power by repeated squaring, unrolled at compile time: pow<5>(x) is x2 * x2 * x.
+template<int N, typename T>
+inline constexpr T pow(const T value)
+{
+    static_assert(N >= 0);
+
+    if constexpr (N == 0)
+        return T(1);
+    else if constexpr (N == 1)
+        return value;
+    else if constexpr (N % 2 == 0)
+        return rt::pow<N / 2>(value * value);
     else
-        return std::pow(value, power);
+        return value * rt::pow<N / 2>(value * value);
 }
 
 
@@ -84,4 +112,332 @@ inline constexpr T radians(T degrees)
     return degrees * std::numbers::pi_v<T> / 180;
 }
 
+
+// -------------------------------------
+// ------------- FAST MATH -------------
+// -------------------------------------
+
+// Polynomial approximations for the float hot paths. Errors below are the maximum
+// measured by bench_fastmath against libm (double precision reference):
+//   sincos   |x| <= 8192     abs error <= 8e-8 (sin and cos)
+//   cbrt     finite x        rel error <= 2.5e-7
+//   rsqrt    normal x > 0    rel error <= 2.6e-7 (rsqrtps + one Newton step)
+// rt::pow<N> is repeated multiplication, no approximation of its own but rounded once per
+// product, at most about N/2 times (3 times for N = 5): rel error <= 2.2e-7 for N = 5.
+// The _ps variants compute the same expressions on four lanes and have the same error, they
+// are x86 only. Without RT_X86 rsqrt is 1 / sqrt, correctly rounded.
+namespace fastmath
+{
+
+namespace detail
+{
+
+// Cody-Waite split of pi/2, so that x - q * pi/2 is exact for |q| < 2^12
+inline constexpr float pio2_1 = 1.5703125f;
+inline constexpr float pio2_2 = 4.837512969970703125e-4f;
+inline constexpr float pio2_3 = 7.54978995489188216e-8f;
+inline constexpr float two_over_pi = 0.636619772367581343f;
+
+// minimax on [-pi/4, pi/4] (cephes)
+inline constexpr float sin_c0 = -1.9515295891e-4f;
+inline constexpr float sin_c1 = 8.3321608736e-3f;
+inline constexpr float sin_c2 = -1.6666654611e-1f;
+inline constexpr float cos_c0 = 2.443315711809948e-5f;
+inline constexpr float cos_c1 = -1.388731625493765e-3f;
+inline constexpr float cos_c2 = 4.166664568298827e-2f;
+
+// bit pattern of 2^(127 * 2/3), the exponent bias correction for the cbrt estimate
+inline constexpr uint32_t cbrt_magic = 709921077u;
+
+} // namespace detail
+
+
+inline void sincos(const float v, float& s, float& c)
+{
+#if RT_X86
+    const int quadrant = _mm_cvtss_si32(_mm_set_ss(v * detail::two_over_pi));
+#else
+    // NOTE: round to nearest like cvtss2si
+    const int quadrant = static_cast<int>(std::lrint(v * detail::two_over_pi));
+#endif
+    const float q = static_cast<float>(quadrant);
+
+    float x = v - q * detail::pio2_1;
+    x -= q * detail::pio2_2;
+    x -= q * detail::pio2_3;
+
+    const float z = x * x;
+    const float sin_x = ((detail::sin_c0 * z + detail::sin_c1) * z + detail::sin_c2) * z * x + x;
+    const float cos_x = ((detail::cos_c0 * z + detail::cos_c1) * z + detail::cos_c2) * z * z - 0.5f * z + 1;
+
+    // branchless quadrant fix-up on the bit patterns, the quadrant of a random angle is unpredictable
+    uint32_t sin_bits, cos_bits;
+    std::memcpy(&sin_bits, &sin_x, sizeof(sin_bits));
+    std::memcpy(&cos_bits, &cos_x, sizeof(cos_bits));
+
+    const uint32_t swap = 0u - static_cast<uint32_t>(quadrant & 1);
+    const uint32_t sin_sign = static_cast<uint32_t>(quadrant & 2) << 30;
+    const uint32_t cos_sign = static_cast<uint32_t>((quadrant + 1) & 2) << 30;
+
+    const uint32_t s_bits = ((sin_bits & ~swap) | (cos_bits & swap)) ^ sin_sign;
+    const uint32_t c_bits = ((cos_bits & ~swap) | (sin_bits & swap)) ^ cos_sign;
+    std::memcpy(&s, &s_bits, sizeof(s));
+    std::memcpy(&c, &c_bits, sizeof(c));
+}
+
+inline float cbrt(const float v)
+{
+    uint32_t bits;
+    std::memcpy(&bits, &v, sizeof(bits));
+
+    const uint32_t sign = bits & 0x80000000u;
+    bits = (bits & 0x7fffffffu) / 3 + detail::cbrt_magic;
+
+    float y;
+    std::memcpy(&y, &bits, sizeof(y));
+
+    // two Halley steps: 5 bits -> 15 bits -> full precision
+    const float x = std::abs(v);
+    float y3 = y * y * y;
+    y *= (y3 + 2 * x) / (2 * y3 + x);
+    y3 = y * y * y;
+    y *= (y3 + 2 * x) / (2 * y3 + x);
+
+    std::memcpy(&bits, &y, sizeof(bits));
+    bits |= sign;
+    std::memcpy(&y, &bits, sizeof(y));
+
+    return x == 0 ? v : y;
+}
+
+inline float rsqrt(const float v)
+{
+#if RT_X86
+    const float y = _mm_cvtss_f32(_mm_rsqrt_ss(_mm_set_ss(v)));
+
+    return y * (1.5f - 0.5f * v * y * y);
+#else
+    return 1 / std::sqrt(v);
+#endif
+}
+
+
+#if RT_X86
+
+inline __m128 sincos_ps(const __m128 v, __m128& c)
+{
+    const __m128i quadrant = _mm_cvtps_epi32(_mm_mul_ps(v, _mm_set1_ps(detail::two_over_pi)));
+    const __m128 q = _mm_cvtepi32_ps(quadrant);
+
+    __m128 x = _mm_sub_ps(v, _mm_mul_ps(q, _mm_set1_ps(detail::pio2_1)));
+    x = _mm_sub_ps(x, _mm_mul_ps(q, _mm_set1_ps(detail::pio2_2)));
+    x = _mm_sub_ps(x, _mm_mul_ps(q, _mm_set1_ps(detail::pio2_3)));
+
+    const __m128 z = _mm_mul_ps(x, x);
+
+    __m128 sin_x = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(detail::sin_c0), z), _mm_set1_ps(detail::sin_c1));
+    sin_x = _mm_add_ps(_mm_mul_ps(sin_x, z), _mm_set1_ps(detail::sin_c2));
+    sin_x = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(sin_x, z), x), x);
+
+    __m128 cos_x = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(detail::cos_c0), z), _mm_set1_ps(detail::cos_c1));
+    cos_x = _mm_add_ps(_mm_mul_ps(cos_x, z), _mm_set1_ps(detail::cos_c2));
+    cos_x = _mm_mul_ps(_mm_mul_ps(cos_x, z), z);
+    cos_x = _mm_add_ps(_mm_sub_ps(cos_x, _mm_mul_ps(_mm_set1_ps(0.5f), z)), _mm_set1_ps(1));
+
+    const __m128i one = _mm_set1_epi32(1);
+    const __m128i two = _mm_set1_epi32(2);
+    const __m128 swap = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(quadrant, one), one));
+    const __m128 sin_sign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(quadrant, two), 30));
+    const __m128 cos_sign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(_mm_add_epi32(quadrant, one), two), 30));
+
+    const __m128 s = _mm_or_ps(_mm_and_ps(swap, cos_x), _mm_andnot_ps(swap, sin_x));
+    c = _mm_or_ps(_mm_and_ps(swap, sin_x), _mm_andnot_ps(swap, cos_x));
+    c = _mm_xor_ps(c, cos_sign);
+
+    return _mm_xor_ps(s, sin_sign);
+}
+
+inline __m128 cbrt_ps(const __m128 v)
+{
+    const __m128 sign_mask = _mm_set1_ps(-0.0f);
+    const __m128 sign = _mm_and_ps(v, sign_mask);
+    const __m128 x = _mm_andnot_ps(sign_mask, v);
+
+    // bits / 3 only seeds the iteration, so dividing in float precision is good enough
+    const __m128i bits = _mm_castps_si128(x);
+    const __m128 third = _mm_mul_ps(_mm_cvtepi32_ps(bits), _mm_set1_ps(1.0f / 3));
+    __m128 y = _mm_castsi128_ps(_mm_add_epi32(_mm_cvttps_epi32(third), _mm_set1_epi32(detail::cbrt_magic)));
+
+    for (int i = 0; i < 2; ++i) {
+        const __m128 y3 = _mm_mul_ps(_mm_mul_ps(y, y), y);
+        const __m128 x2 = _mm_add_ps(x, x);
+        y = _mm_mul_ps(y, _mm_div_ps(_mm_add_ps(y3, x2), _mm_add_ps(_mm_add_ps(y3, y3), x)));
+    }
+
+    const __m128 is_zero = _mm_cmpeq_ps(x, _mm_setzero_ps());
+    y = _mm_andnot_ps(is_zero, y);
+
+    return _mm_or_ps(y, sign);
+}
+
+inline __m128 rsqrt_ps(const __m128 v)
+{
+    const __m128 y = _mm_rsqrt_ps(v);
+    const __m128 vyy = _mm_mul_ps(_mm_mul_ps(v, y), y);
+
+    return _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(0.5f), y), _mm_sub_ps(_mm_set1_ps(3), vyy));
+}
+
+#endif // RT_X86
+
+} // namespace fastmath
+
+
+// ---------------------------------------
+// ---- SAMPLING KERNELS (RT_FAST_MATH) ---
+// ---------------------------------------
+
+template<typename T>
+inline T cbrt(const T v)
+{
+    static_assert(std::numeric_limits<T>::is_iec559);
+
+    if constexpr (std::is_same<T, float>()) {
+#if RT_FAST_MATH
+        return fastmath::cbrt(v);
+#else
+        return std::cbrt(v);
+#endif
+    }
+    else
+        return std::cbrt(v);
+}
+
+template<typename T>
+inline void sincos(const T v, T& s, T& c)
+{
+    static_assert(std::numeric_limits<T>::is_iec559);
+
+#if RT_FAST_MATH
+    if constexpr (std::is_same<T, float>()) {
+        fastmath::sincos(v, s, c);
+        return;
+    }
+#endif
+    s = rt::sin(v);
+    c = rt::cos(v);
+}
+
+template<typename T>
+inline T rsqrt(const T v)
+{
+    static_assert(std::numeric_limits<T>::is_iec559);
+
+#if RT_FAST_MATH
+    if constexpr (std::is_same<T, float>())
+        return fastmath::rsqrt(v);
+#endif
+    return 1 / rt::sqrt(v);
+}
+
+
+// -------------------------------------
+// -------------- CPU CHECK ------------
+// -------------------------------------
+
+// A build for an x86-64 level (RT_ARCH, x86-64-v3 by default) dies with SIGILL on an older CPU
+// at its first AVX2 instruction, without a word. Every program that includes this header checks
+// the features the compiler was allowed to use against the CPU at startup instead, and exits
+// with the name of the first one missing.
+// NOTE: the check is compiled for the x86-64 baseline; MSVC has no per-function target, and
+// runs it before the program's static initializers only as far as the include order goes.
+#if RT_X86 && (defined(__GNUC__) || defined(__clang__))
+    #define RT_BASELINE_ISA [[gnu::target("arch=x86-64")]]
+#else
+    #define RT_BASELINE_ISA
+#endif
+
+namespace detail
+{
+
+#if RT_X86 && defined(_MSC_VER)
+// cpuid leaf 1 ecx, leaf 7 ebx bits and the XCR0 state the OS enables for AVX and AVX-512
+inline bool cpu_has(int leaf, int reg, int bit)
+{
+    int info[4];
+    __cpuidex(info, leaf, 0);
+    const bool os_avx = leaf == 1 && bit == 28 ? (_xgetbv(0) & 0x6) == 0x6 : true;
+    const bool os_avx512 = leaf == 7 && bit >= 16 ? (_xgetbv(0) & 0xe6) == 0xe6 : true;
+    return (info[reg] >> bit & 1) != 0 && os_avx && os_avx512;
+}
+
+    #define RT_CPU_HAS(gnu_name, leaf, reg, bit) rt::detail::cpu_has(leaf, reg, bit)
+#else
+    #define RT_CPU_HAS(gnu_name, leaf, reg, bit) (__builtin_cpu_supports(gnu_name) != 0)
+#endif
+
+// The feature the build requires and the CPU lacks, nullptr if there is none
+RT_BASELINE_ISA inline const char* missing_cpu_feature()
+{
+#if RT_X86 && (defined(__GNUC__) || defined(__clang__))
+    // NOTE: may run before the runtime's own constructor has filled in the CPU model
+    __builtin_cpu_init();
+#endif
+#if RT_X86
+    struct feature { bool present; const char* name; };
+    const feature features[] = {
+    #if defined(__SSSE3__)
+        { RT_CPU_HAS("ssse3", 1, 2, 9), "SSSE3" },
+    #endif
+    #if defined(__SSE4_2__)
+        { RT_CPU_HAS("sse4.2", 1, 2, 20), "SSE4.2" },
+    #endif
+    #if defined(__AVX__)
+        { RT_CPU_HAS("avx", 1, 2, 28), "AVX" },
+    #endif
+    #if defined(__FMA__)
+        { RT_CPU_HAS("fma", 1, 2, 12), "FMA" },
+    #endif
+    #if defined(__AVX2__)
+        { RT_CPU_HAS("avx2", 7, 1, 5), "AVX2" },
+    #endif
+    #if defined(__AVX512F__)
+        { RT_CPU_HAS("avx512f", 7, 1, 16), "AVX-512F" },
+    #endif
+    #if defined(__AVX512BW__)
+        { RT_CPU_HAS("avx512bw", 7, 1, 30), "AVX-512BW" },
+    #endif
+        { true, nullptr },
+    };
+    for (const auto& f : features) {
+        if (f.present == false)
+            return f.name;
+    }
+#endif
+    return nullptr;
+}
+
+RT_BASELINE_ISA inline void require_cpu_features()
+{
+    if (const char* missing = missing_cpu_feature()) {
+        std::fprintf(stderr, "This build targets %s, but the CPU has no %s. Rebuild with a lower RT_ARCH "
+                             "(x86-64-v2, or empty for any x86-64 CPU), see README.md.\n", RT_ARCH_NAME, missing);
+        // NOTE: no exit handlers, they are compiled for the level the CPU lacks
+        std::_Exit(1);
+    }
+}
+
+#if RT_X86 && (defined(__GNUC__) || defined(__clang__))
+// NOTE: ahead of the C++ static initializers, which may use the instructions already; one
+// copy per translation unit, the first one that runs reports
+[[gnu::constructor(101)]] RT_BASELINE_ISA static void check_cpu_at_startup()
+{
+    require_cpu_features();
+}
+#elif RT_X86
+inline const bool s_cpu_checked = (require_cpu_features(), true);
+#endif
+
+} // namespace detail
+
 } // namespace rt
@@ -0,0 +1,294 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <WinSock2.h>
+#include <WS2tcpip.h>
+#pragma comment(lib, "Ws2_32.lib")
+#else
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+
+namespace rt
+{
+
+namespace detail
+{
+
+#if defined(_WIN32)
+using socket_handle = SOCKET;
+inline constexpr socket_handle invalid_socket = INVALID_SOCKET;
+
+inline bool init_sockets()
+{
+    // NOTE: never cleaned up, the process exit does that
+    static const bool initialized = [] {
+        WSADATA data;
+        return WSAStartup(MAKEWORD(2, 2), &data) == 0;
+    }();
+    return initialized;
+}
+
+inline void close_socket(socket_handle handle)
+{
+    closesocket(handle);
+}
+#else
+using socket_handle = int;
+inline constexpr socket_handle invalid_socket = -1;
+
+inline bool init_sockets()
+{
+    return true;
+}
+
+inline void close_socket(socket_handle handle)
+{
+    ::close(handle);
+}
+#endif
+
+} // namespace detail
+
+
+// Connected TCP stream with whole-buffer send and receive, for the message based protocols of
+// distributed rendering. Blocking; a failed call means the peer is gone.
+class socket_stream
+{
+public:
+    socket_stream() = default;
+
+    explicit socket_stream(detail::socket_handle handle)
+        : m_handle(handle)
+    {
+        set_no_delay();
+    }
+
+    socket_stream(const socket_stream&) = delete;
+    socket_stream& operator=(const socket_stream&) = delete;
+
+    socket_stream(socket_stream&& other) noexcept
+        : m_handle(std::exchange(other.m_handle, detail::invalid_socket))
+    {}
+
+    socket_stream& operator=(socket_stream&& other) noexcept
+    {
+        if (this != &other) {
+            close();
+            m_handle = std::exchange(other.m_handle, detail::invalid_socket);
+        }
+        return *this;
+    }
+
+    ~socket_stream()
+    {
+        close();
+    }
+
+    // `address` is a numeric IPv4 address, e.g. 127.0.0.1
+    bool connect(const char* address, uint16_t port)
+    {
+        close();
+        if (detail::init_sockets() == false)
+            return false;
+
+        sockaddr_in peer{};
+        peer.sin_family = AF_INET;
+        peer.sin_port = htons(port);
+        if (inet_pton(AF_INET, address, &peer.sin_addr) != 1)
+            return false;
+
+        m_handle = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        if (m_handle == detail::invalid_socket)
+            return false;
+
+        if (::connect(m_handle, reinterpret_cast<const sockaddr*>(&peer), sizeof(peer)) != 0) {
+            close();
+            return false;
+        }
+
+        set_no_delay();
+        return true;
+    }
+
+    void close()
+    {
+        if (m_handle != detail::invalid_socket) {
+            detail::close_socket(m_handle);
+            m_handle = detail::invalid_socket;
+        }
+    }
+
+    bool is_open() const
+    {
+        return m_handle != detail::invalid_socket;
+    }
+
+    // Ends both directions but keeps the handle: a receive blocked on another thread returns
+    void shutdown()
+    {
+        if (m_handle != detail::invalid_socket) {
+#if defined(_WIN32)
+            ::shutdown(m_handle, SD_BOTH);
+#else
+            ::shutdown(m_handle, SHUT_RDWR);
+#endif
+        }
+    }
+
+    bool send_all(const void* data, size_t size)
+    {
+        const char* bytes = static_cast<const char*>(data);
+        while (size > 0) {
+            // NOTE: no SIGPIPE for a vanished peer, the failed send reports it
+#if defined(_WIN32)
+            const int sent = ::send(m_handle, bytes, static_cast<int>(size < (1u << 30) ? size : (1u << 30)), 0);
+#elif defined(MSG_NOSIGNAL)
+            const ssize_t sent = ::send(m_handle, bytes, size, MSG_NOSIGNAL);
+#else
+            const ssize_t sent = ::send(m_handle, bytes, size, 0);
+#endif
+            if (sent <= 0)
+                return false;
+            bytes += sent;
+            size -= static_cast<size_t>(sent);
+        }
+        return true;
+    }
+
+    bool receive_all(void* data, size_t size)
+    {
+        char* bytes = static_cast<char*>(data);
+        while (size > 0) {
+#if defined(_WIN32)
+            const int received = ::recv(m_handle, bytes, static_cast<int>(size < (1u << 30) ? size : (1u << 30)), 0);
+#else
+            const ssize_t received = ::recv(m_handle, bytes, size, 0);
+#endif
+            if (received <= 0)
+                return false;
+            bytes += received;
+            size -= static_cast<size_t>(received);
+        }
+        return true;
+    }
+
+    // Whatever arrived, at most `size` bytes; 0 once the peer is gone, for streams without framing
+    size_t receive_some(void* data, size_t size)
+    {
+#if defined(_WIN32)
+        const int received = ::recv(m_handle, static_cast<char*>(data), static_cast<int>(size < (1u << 30) ? size : (1u << 30)), 0);
+#else
+        const ssize_t received = ::recv(m_handle, data, size, 0);
+#endif
+        return received > 0 ? static_cast<size_t>(received) : 0;
+    }
+
+private:
+    void set_no_delay()
+    {
+        // NOTE: messages are written header first, don't let Nagle hold the header back
+        int enable = 1;
+        setsockopt(m_handle, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&enable), sizeof(enable));
+    }
+
+    detail::socket_handle m_handle = detail::invalid_socket;
+};
+
+
+// Listening TCP socket on the loopback interface
+class socket_listener
+{
+public:
+    socket_listener() = default;
+
+    socket_listener(const socket_listener&) = delete;
+    socket_listener& operator=(const socket_listener&) = delete;
+
+    ~socket_listener()
+    {
+        close();
+    }
+
+    // port 0 picks a free port, see port()
+    bool listen(uint16_t port)
+    {
+        close();
+        if (detail::init_sockets() == false)
+            return false;
+
+        m_handle = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        if (m_handle == detail::invalid_socket)
+            return false;
+
+        int enable = 1;
+        setsockopt(m_handle, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&enable), sizeof(enable));
+
+        sockaddr_in local{};
+        local.sin_family = AF_INET;
+        local.sin_port = htons(port);
+        local.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+        socklen_t length = sizeof(local);
+        if (::bind(m_handle, reinterpret_cast<const sockaddr*>(&local), sizeof(local)) != 0
+            || ::listen(m_handle, SOMAXCONN) != 0
+            || getsockname(m_handle, reinterpret_cast<sockaddr*>(&local), &length) != 0) {
+            close();
+            return false;
+        }
+
+        m_port = ntohs(local.sin_port);
+        return true;
+    }
+
+    // false when nobody connected within `timeout_ms`
+    bool accept(socket_stream& stream, int timeout_ms)
+    {
+#if defined(_WIN32)
+        WSAPOLLFD request{ m_handle, POLLRDNORM, 0 };
+        if (WSAPoll(&request, 1, timeout_ms) <= 0)
+            return false;
+#else
+        pollfd request{ m_handle, POLLIN, 0 };
+        if (poll(&request, 1, timeout_ms) <= 0)
+            return false;
+#endif
+
+        const detail::socket_handle handle = ::accept(m_handle, nullptr, nullptr);
+        if (handle == detail::invalid_socket)
+            return false;
+
+        stream = socket_stream(handle);
+        return true;
+    }
+
+    void close()
+    {
+        if (m_handle != detail::invalid_socket) {
+            detail::close_socket(m_handle);
+            m_handle = detail::invalid_socket;
+        }
+    }
+
+    uint16_t port() const
+    {
+        return m_port;
+    }
+
+private:
+    detail::socket_handle m_handle = detail::invalid_socket;
+    uint16_t m_port = 0;
+};
+
+} // namespace rt
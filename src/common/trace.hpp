@@ -0,0 +1,198 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "json.hpp"
+
+
+// NOTE: tracing is compiled in with RT_TRACE=1 only (the RT_TRACE build option), otherwise the
+// macros below are empty and nothing is recorded
+#ifndef RT_TRACE
+    #define RT_TRACE 0
+#endif
+
+
+// Timeline of scoped events for finding scheduling gaps and stragglers. RT_TRACE_SCOPE("name")
+// records the time from there to the end of the scope into a ring buffer of the calling thread;
+// write_trace() dumps all of them as Chrome trace JSON, to be opened in Perfetto or
+// chrome://tracing. Names must be string literals, only their pointer is stored.
+//
+// Recording takes no lock: a buffer is written by one thread only, which publishes the event
+// count with a release store. Buffers outlive their threads and are handed to the next thread of
+// the same name, so the render threads of consecutive frames share a handful of timeline rows.
+namespace rt
+{
+
+namespace detail
+{
+
+struct trace_event
+{
+    const char* name;
+    uint64_t begin_ns;
+    uint64_t end_ns;
+};
+
+// NOTE: full buffers overwrite their oldest events
+struct trace_buffer
+{
+    static constexpr uint64_t capacity = 1 << 14;
+
+    uint32_t thread_id = 0;
+    std::string thread_name;    // under trace_registry::mutex
+    std::atomic<uint64_t> count{ 0 };
+    trace_event events[capacity];
+};
+
+struct trace_registry
+{
+    std::mutex mutex;
+    std::vector<std::unique_ptr<trace_buffer>> buffers;
+    std::vector<trace_buffer*> free_buffers;
+    const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+
+    static trace_registry& get()
+    {
+        static trace_registry registry;
+        return registry;
+    }
+};
+
+// The calling thread's buffer, taken from the registry on first use and given back when the
+// thread ends. A name given on first use picks a free buffer of that name.
+inline trace_buffer& thread_trace_buffer(const char* name = nullptr)
+{
+    struct owner
+    {
+        trace_buffer* buffer = nullptr;
+
+        ~owner()
+        {
+            if (buffer != nullptr) {
+                auto& registry = trace_registry::get();
+                std::lock_guard lock(registry.mutex);
+                registry.free_buffers.push_back(buffer);
+            }
+        }
+    };
+    thread_local owner t_owner;
+
+    if (t_owner.buffer == nullptr || name != nullptr) {
+        auto& registry = trace_registry::get();
+        std::lock_guard lock(registry.mutex);
+        const std::string_view wanted = name != nullptr ? name : "";
+
+        if (t_owner.buffer != nullptr) {
+            t_owner.buffer->thread_name = wanted;
+            return *t_owner.buffer;
+        }
+
+        auto free = std::find_if(registry.free_buffers.begin(), registry.free_buffers.end(),
+                                 [&](const trace_buffer* buffer) { return buffer->thread_name == wanted; });
+        if (free != registry.free_buffers.end()) {
+            t_owner.buffer = *free;
+            registry.free_buffers.erase(free);
+        }
+        else {
+            registry.buffers.push_back(std::make_unique<trace_buffer>());
+            t_owner.buffer = registry.buffers.back().get();
+            t_owner.buffer->thread_id = static_cast<uint32_t>(registry.buffers.size());
+            t_owner.buffer->thread_name = wanted;
+        }
+    }
+    return *t_owner.buffer;
+}
+
+inline uint64_t trace_now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - trace_registry::get().epoch).count();
+}
+
+} // namespace detail
+
+
+class trace_scope
+{
+public:
+    explicit trace_scope(const char* name)
+        : m_name(name)
+        , m_begin(detail::trace_now())
+    {}
+
+    ~trace_scope()
+    {
+        auto& buffer = detail::thread_trace_buffer();
+        const uint64_t index = buffer.count.load(std::memory_order_relaxed);
+        buffer.events[index % detail::trace_buffer::capacity] = { m_name, m_begin, detail::trace_now() };
+        buffer.count.store(index + 1, std::memory_order_release);
+    }
+
+    trace_scope(const trace_scope&) = delete;
+    trace_scope& operator=(const trace_scope&) = delete;
+
+private:
+    const char* m_name;
+    uint64_t m_begin;
+};
+
+// Names the calling thread's timeline row, best called before its first event
+inline void trace_thread_name(const char* name)
+{
+    detail::thread_trace_buffer(name);
+}
+
+// Chrome trace JSON of everything recorded so far. Meant for when the traced work is done: the
+// events of threads still running are read while they may be overwritten.
+inline bool write_trace(const char* path)
+{
+    auto& registry = detail::trace_registry::get();
+    std::lock_guard lock(registry.mutex);
+
+    // NOTE: timestamps are in microseconds, fixed point keeps the nanoseconds of long runs
+    std::ofstream out(path);
+    out << std::fixed << std::setprecision(3) << "{\"traceEvents\":[\n";
+
+    bool first = true;
+    for (const auto& buffer : registry.buffers) {
+        if (buffer->thread_name.empty() == false) {
+            out << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->thread_id
+                << ",\"args\":{\"name\":" << json_quote(buffer->thread_name) << "}}";
+            first = false;
+        }
+
+        const uint64_t count = buffer->count.load(std::memory_order_acquire);
+        const uint64_t begin = count > detail::trace_buffer::capacity ? count - detail::trace_buffer::capacity : 0;
+        for (uint64_t i = begin; i < count; ++i) {
+            const auto& event = buffer->events[i % detail::trace_buffer::capacity];
+            out << (first ? "" : ",\n") << "{\"name\":" << json_quote(event.name) << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->thread_id
+                << ",\"ts\":" << event.begin_ns / 1000.0 << ",\"dur\":" << (event.end_ns - event.begin_ns) / 1000.0 << '}';
+            first = false;
+        }
+    }
+
+    out << "\n],\"displayTimeUnit\":\"ms\"}\n";
+    return out.good();
+}
+
+} // namespace rt
+
+
+#if RT_TRACE
+    #define RT_TRACE_CONCAT_IMPL(a, b) a##b
+    #define RT_TRACE_CONCAT(a, b) RT_TRACE_CONCAT_IMPL(a, b)
+    #define RT_TRACE_SCOPE(name) rt::trace_scope RT_TRACE_CONCAT(rt_trace_scope_, __LINE__)(name)
+    #define RT_TRACE_THREAD(name) rt::trace_thread_name(name)
+#else
+    #define RT_TRACE_SCOPE(name) ((void)0)
+    #define RT_TRACE_THREAD(name) ((void)0)
+#endif
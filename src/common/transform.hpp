@@ -0,0 +1,130 @@
+#pragma once
+
+#include "common/rt_math.hpp"
+#include "common/vec3.hpp"
+#include "common/ray.hpp"
+#include "common/aabb.hpp"
+
+
+namespace rt
+{
+
+// Affine transform as a row-major 3x4 matrix, the last column is the translation.
+// Plain data (no vec3 inside) so that it can be stored as is in scene caches.
+template<typename FloatType,
+    typename = std::enable_if_t<std::is_floating_point<FloatType>::value>
+>
+struct affine_transform
+{
+    using vec3_fp = vec3<FloatType>;
+    using ray_type = ray<FloatType>;
+
+    static affine_transform identity()
+    {
+        return { { { 1, 0, 0, 0 }, { 0, 1, 0, 0 }, { 0, 0, 1, 0 } } };
+    }
+
+    static affine_transform translation(const vec3_fp& offset)
+    {
+        return { { { 1, 0, 0, offset.getX() }, { 0, 1, 0, offset.getY() }, { 0, 0, 1, offset.getZ() } } };
+    }
+
+    static affine_transform scaling(const vec3_fp& scale)
+    {
+        return { { { scale.getX(), 0, 0, 0 }, { 0, scale.getY(), 0, 0 }, { 0, 0, scale.getZ(), 0 } } };
+    }
+
+    // Rotation by `degrees` around `axis` (Rodrigues' formula), counter-clockwise looking down the axis
+    static affine_transform rotation(const vec3_fp& axis, FloatType degrees)
+    {
+        const vec3_fp a = unit_vector(axis);
+        const FloatType x = a.getX(), y = a.getY(), z = a.getZ();
+        const FloatType s = rt::sin(rt::radians(degrees));
+        const FloatType c = rt::cos(rt::radians(degrees));
+        const FloatType t = 1 - c;
+
+        return { { { t * x * x + c,     t * x * y - s * z, t * x * z + s * y, 0 },
+                   { t * x * y + s * z, t * y * y + c,     t * y * z - s * x, 0 },
+                   { t * x * z - s * y, t * y * z + s * x, t * z * z + c,     0 } } };
+    }
+
+    // (a * b) applies b first
+    friend affine_transform operator*(const affine_transform& a, const affine_transform& b)
+    {
+        affine_transform result;
+        for (int i = 0; i < 3; ++i) {
+            for (int j = 0; j < 4; ++j) {
+                result.m[i][j] = a.m[i][0] * b.m[0][j] + a.m[i][1] * b.m[1][j] + a.m[i][2] * b.m[2][j];
+            }
+            result.m[i][3] += a.m[i][3];
+        }
+        return result;
+    }
+
+    affine_transform inverse() const
+    {
+        // inverse of the linear part by cofactors, then the translation is moved through it
+        const FloatType c00 = m[1][1] * m[2][2] - m[1][2] * m[2][1];
+        const FloatType c01 = m[1][2] * m[2][0] - m[1][0] * m[2][2];
+        const FloatType c02 = m[1][0] * m[2][1] - m[1][1] * m[2][0];
+        const FloatType inv_det = 1 / (m[0][0] * c00 + m[0][1] * c01 + m[0][2] * c02);
+
+        affine_transform result;
+        result.m[0][0] = c00 * inv_det;
+        result.m[0][1] = (m[0][2] * m[2][1] - m[0][1] * m[2][2]) * inv_det;
+        result.m[0][2] = (m[0][1] * m[1][2] - m[0][2] * m[1][1]) * inv_det;
+        result.m[1][0] = c01 * inv_det;
+        result.m[1][1] = (m[0][0] * m[2][2] - m[0][2] * m[2][0]) * inv_det;
+        result.m[1][2] = (m[0][2] * m[1][0] - m[0][0] * m[1][2]) * inv_det;
+        result.m[2][0] = c02 * inv_det;
+        result.m[2][1] = (m[0][1] * m[2][0] - m[0][0] * m[2][1]) * inv_det;
+        result.m[2][2] = (m[0][0] * m[1][1] - m[0][1] * m[1][0]) * inv_det;
+
+        for (int i = 0; i < 3; ++i)
+            result.m[i][3] = -(result.m[i][0] * m[0][3] + result.m[i][1] * m[1][3] + result.m[i][2] * m[2][3]);
+
+        return result;
+    }
+
+    vec3_fp point(const vec3_fp& p) const
+    {
+        return vector(p) + vec3_fp(m[0][3], m[1][3], m[2][3]);
+    }
+
+    vec3_fp vector(const vec3_fp& v) const
+    {
+        return vec3_fp(m[0][0] * v.getX() + m[0][1] * v.getY() + m[0][2] * v.getZ(),
+                       m[1][0] * v.getX() + m[1][1] * v.getY() + m[1][2] * v.getZ(),
+                       m[2][0] * v.getX() + m[2][1] * v.getY() + m[2][2] * v.getZ());
+    }
+
+    // Transposed linear part: called on the inverse transform it maps normals (unnormalized)
+    vec3_fp transposed_vector(const vec3_fp& v) const
+    {
+        return vec3_fp(m[0][0] * v.getX() + m[1][0] * v.getY() + m[2][0] * v.getZ(),
+                       m[0][1] * v.getX() + m[1][1] * v.getY() + m[2][1] * v.getZ(),
+                       m[0][2] * v.getX() + m[1][2] * v.getY() + m[2][2] * v.getZ());
+    }
+
+    // NOTE: the direction is not renormalized, so the ray parameter t is the same in both spaces
+    ray_type apply(const ray_type& r) const
+    {
+        return ray_type(point(r.origin), vector(r.direction), r.time());
+    }
+
+    aabb<FloatType> apply(const aabb<FloatType>& box) const
+    {
+        aabb<FloatType> result;
+        for (int corner = 0; corner < 8; ++corner) {
+            result.expand(point(vec3_fp(corner & 1 ? box.max.getX() : box.min.getX(),
+                                        corner & 2 ? box.max.getY() : box.min.getY(),
+                                        corner & 4 ? box.max.getZ() : box.min.getZ())));
+        }
+        return result;
+    }
+
+public:
+    FloatType m[3][4];
+};
+
+} // namespace rt
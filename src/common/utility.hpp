@@ -11,7 +11,9 @@
 namespace rt
 {
 
-static thread_local rt::random_generator<float, std::minstd_rand> s_random_gen;
+// NOTE: inline, so there is one generator per thread in the whole program, the rtcore library
+// and the executables linking it draw from the same one
+inline thread_local rt::random_generator<float, std::minstd_rand> s_random_gen;
 
 
 
@@ -1,6 +1,9 @@
 #pragma once
 
-#define VEC3_SIMD 0
+// NOTE: the backend can be chosen by the build (-DVEC3_SIMD=1), scalar by default
+#ifndef VEC3_SIMD
+    #define VEC3_SIMD 0
+#endif
 
 #if VEC3_SIMD==0
     #include "vec3_t.hpp"
@@ -8,4 +11,10 @@
     #include "vec3_avx.hpp"
 #endif
 
+namespace rt
+{
+// Name of the backend above, for benchmark reports
+inline constexpr const char* vec3_backend = VEC3_SIMD == 0 ? "scalar" : "avx";
+}
+
 #undef VEC3_SIMD
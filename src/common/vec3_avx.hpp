@@ -1,16 +1,25 @@
 #pragma once
 
 #include <algorithm>
-#include <immintrin.h>
 
 #include "rt_math.hpp"
 
+#if RT_X86 == 0
+    #error "the AVX backend of vec3 (RT_VEC3_AVX) is x86-64 only"
+#endif
+#include <immintrin.h>
+
 
 // http://www.codersnotes.com/notes/maths-lib-2016/
 
 
-#define VM_INLINE //  __forceinline
-#define VEC_CALL __vectorcall
+#define VM_INLINE inline //  __forceinline
+// NOTE: __vectorcall is MSVC's, elsewhere the x86-64 SysV convention passes __m128 in registers anyway
+#if defined(_MSC_VER)
+    #define VEC_CALL __vectorcall
+#else
+    #define VEC_CALL
+#endif
 //#define M_PI        3.14159265358979323846f
 //#define DEG2RAD(_a) ((_a)*M_PI/180.0f)
 //#define RAD2DEG(_a) ((_a)*180.0f/M_PI)
@@ -55,6 +64,10 @@ struct vec3<float>
 
     VM_INLINE void VEC_CALL store(float* p) const { p[0] = getX(); p[1] = getY(); p[2] = getZ(); }
 
+    // NOTE: w is padding to every operation (dot products mask it out), ray keeps its time there
+    VM_INLINE float VEC_CALL getW() const { return _mm_cvtss_f32(_mm_shuffle_ps(m, m, _MM_SHUFFLE(3, 3, 3, 3))); }
+    VM_INLINE void VEC_CALL setW(float w) { m = _mm_insert_ps(m, _mm_set_ss(w), 0x30); }
+
 
     void VEC_CALL setX(float x)
     {
@@ -126,7 +139,11 @@ VM_INLINE vec3f VEC_CALL cross(vec3f a, vec3f b)
 
 VM_INLINE float VEC_CALL dot(vec3f a, vec3f b) { return _mm_cvtss_f32(_mm_dp_ps(a.m, b.m, 0x71)); }
 
+#if RT_FAST_MATH
+VM_INLINE vec3f VEC_CALL unit_vector(vec3f v) { return vec3f(_mm_mul_ps(v.m, fastmath::rsqrt_ps(_mm_dp_ps(v.m, v.m, 0x7F)))); }
+#else
 VM_INLINE vec3f VEC_CALL unit_vector(vec3f v) { return v * (1.0f / v.length()); }
+#endif
 VM_INLINE vec3f VEC_CALL lerp(vec3f a, vec3f b, float t) { return a + (b - a) * t; }
 
 VM_INLINE vec3f VEC_CALL vector_sqrt(vec3f v) { return vec3f(_mm_sqrt_ps(v.m)); }
@@ -164,27 +181,41 @@ struct vec3<double>
 
     VM_INLINE void VEC_CALL store(double* p) const { p[0] = x(); p[1] = y(); p[2] = z(); }
 
+    VM_INLINE double VEC_CALL getW() const { return _mm256_cvtsd_f64(_mm256_permute4x64_pd(m, _MM_SHUFFLE(3, 3, 3, 3))); }
+    VM_INLINE void VEC_CALL setW(double w) { set_lane(3, w); }
+
 
     void VEC_CALL setX(double x)
     {
-        m.m256d_f64[0] = x;
+        set_lane(0, x);
         //m = _mm256_set_m128d(_mm_setzero_pd(), _mm_set_sd(x));
         //m = _mm256_move_ss(m, _mm256_set_ss(x));
     }
     void VEC_CALL setY(double y)
     {
-        m.m256d_f64[1] = y;
+        set_lane(1, y);
         /*__m256d t = _mm_move_ss(m, _mm_set_ss(y));
         t = _mm_shuffle_ps(t, t, _MM_SHUFFLE(3, 2, 0, 0));
         m = _mm_move_ss(t, m);*/
     }
     void VEC_CALL setZ(double z)
     {
-        m.m256d_f64[2] = z;
+        set_lane(2, z);
         /*__m256d t = _mm_move_ss(m, _mm_set_ss(z));
         t = _mm_shuffle_ps(t, t, _MM_SHUFFLE(3, 0, 1, 0));
         m = _mm_move_ss(t, m);*/
     }
+
+private:
+    // NOTE: through memory rather than MSVC's m256d_f64 member, which GCC and Clang don't have;
+    // compilers turn it into a blend
+    void set_lane(int lane, double value)
+    {
+        alignas(32) double lanes[4];
+        _mm256_store_pd(lanes, m);
+        lanes[lane] = value;
+        m = _mm256_load_pd(lanes);
+    }
 };
 
 
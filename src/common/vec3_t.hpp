@@ -133,7 +133,11 @@ constexpr inline vec3<T> unit_vector(const VEC3_T v)
 {
     static_assert(std::numeric_limits<T>::is_iec559);
 
+#if RT_FAST_MATH
+    return v * rt::rsqrt(v.length_squared());
+#else
     return v / v.length();
+#endif
 }
 
 template<typename T>
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+
+namespace rt
+{
+
+// 8-bit RGB image of a render: gamma corrected, three bytes per pixel, rows from the bottom
+// like the camera's v (write_image() flips them)
+struct framebuffer
+{
+    static constexpr int channels = 3;
+
+    int width = 0;
+    int height = 0;
+    std::vector<uint8_t> rgb;
+
+    framebuffer() = default;
+
+    framebuffer(int width_, int height_)
+        : width(width_)
+        , height(height_)
+        , rgb(size_t(width_) * height_ * channels)
+    {}
+
+    uint8_t* pixel(int x, int y)
+    {
+        return rgb.data() + (size_t(y) * width + x) * channels;
+    }
+};
+
+} // namespace rt
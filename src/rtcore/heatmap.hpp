@@ -0,0 +1,104 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iterator>
+#include <string_view>
+#include <vector>
+
+#include "common/rt_math.hpp"
+
+#if RT_X86 && defined(_WIN32)
+    #include <intrin.h>
+#elif RT_X86
+    #include <x86intrin.h>
+#endif
+
+
+// Per-pixel cost of a render, for finding the expensive parts of a scene (glass, deep bounces)
+// when tuning it, its sample count or tile sizes. The render loops are instantiated per metric,
+// so a render without a heatmap runs exactly the loop it did before.
+namespace rt
+{
+
+enum class heatmap_metric { none, rays, cycles };
+
+inline bool parse_heatmap_metric(std::string_view text, heatmap_metric& metric)
+{
+    if (text == "rays")
+        metric = heatmap_metric::rays;
+    else if (text == "cycles")
+        metric = heatmap_metric::cycles;
+    else
+        return false;
+    return true;
+}
+
+inline const char* to_string(heatmap_metric metric)
+{
+    switch (metric) {
+    case heatmap_metric::rays: return "rays";
+    case heatmap_metric::cycles: return "cycles";
+    default: return "none";
+    }
+}
+
+// NOTE: time stamp counter, wall time in reference cycles; cheap enough to read per pixel.
+// Other targets count nanoseconds, the heatmap is normalized anyway.
+inline uint64_t cycle_count()
+{
+#if RT_X86
+    return __rdtsc();
+#else
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+}
+
+
+struct heatmap
+{
+    heatmap_metric metric = heatmap_metric::none;
+    int width = 0;
+    int height = 0;
+    std::vector<float> cost;    // per pixel, rows from the bottom like framebuffer
+
+    heatmap() = default;
+
+    heatmap(heatmap_metric metric_, int width_, int height_)
+        : metric(metric_)
+        , width(width_)
+        , height(height_)
+        , cost(size_t(width_) * height_)
+    {}
+
+    // Cost of the 99th percentile pixel, a normalization that a few outliers don't wash out
+    float high_cost() const
+    {
+        if (cost.empty())
+            return 0;
+
+        std::vector<float> sorted(cost);
+        auto high = sorted.begin() + (sorted.size() - 1) * 99 / 100;
+        std::nth_element(sorted.begin(), high, sorted.end());
+        return *high;
+    }
+};
+
+
+// Dark blue through red and yellow to white for t in [0, 1]
+inline void false_colour(float t, uint8_t* rgb)
+{
+    static const float ramp[][3] = {
+        { 0.0f, 0.0f, 0.2f }, { 0.4f, 0.0f, 0.6f }, { 0.9f, 0.1f, 0.1f }, { 1.0f, 0.8f, 0.0f }, { 1.0f, 1.0f, 1.0f },
+    };
+    const int last = int(std::size(ramp)) - 1;
+
+    const float x = std::clamp(t, 0.0f, 1.0f) * last;
+    const int i = std::min(int(x), last - 1);
+    const float f = x - i;
+    for (int k = 0; k < 3; ++k)
+        rgb[k] = static_cast<uint8_t>((ramp[i][k] + (ramp[i + 1][k] - ramp[i][k]) * f) * 255.0f + 0.5f);
+}
+
+} // namespace rt
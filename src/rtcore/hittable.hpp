@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstdint>
+
+#include "common/vec3.hpp"
+#include "common/ray.hpp"
+
+
+namespace rt
+{
+
+template<typename FloatType,
+    typename = std::enable_if_t<std::is_floating_point<FloatType>::value>
+>
+class material;
+
+template<typename FloatType,
+    typename = std::enable_if_t<std::is_floating_point<FloatType>::value>
+>
+class hittable;
+
+
+// Result of the intersection test, rewritten on every closer hit during traversal, so it holds
+// only what is needed to find the closest one. Hit point, normal and material are reconstructed
+// once, for the closest hit, by object->surface().
+// hit() must leave the record untouched unless it reports a hit inside (t_min, t_max).
+template<typename FloatType,
+    typename = std::enable_if_t<std::is_floating_point<FloatType>::value>
+>
+struct hit_record
+{
+    FloatType t;                        // ray parameter of the hit
+    uint32_t primitive_id;              // primitive inside `object`, unused by single primitives
+    FloatType u, v;                     // surface coordinates, unused by spheres
+    const hittable<FloatType>* object;  // leaf that reported the hit, or the instance_set owning it
+    uint32_t instance_id;               // instance inside `object`, set by instance_set only
+};
+
+static_assert(sizeof(hit_record<float>) == 32);
+
+
+template<typename FloatType,
+    typename = std::enable_if_t<std::is_floating_point<FloatType>::value>
+>
+struct surface_interaction
+{
+    vec3<FloatType> p;    // hit point
+    vec3<FloatType> normal;
+    const material<FloatType>* material_ptr;
+    bool front_face;
+
+    inline void set_face_normal(const ray<FloatType>& r, const vec3<FloatType>& outward_normal)
+    {
+        front_face = dot(r.direction, outward_normal) < 0;
+        normal = front_face ? outward_normal : -outward_normal;
+    }
+};
+
+
+// NOTE: default template argument is given by the forward declaration above
+template<typename FloatType, typename>
+class hittable
+{
+public:
+    virtual bool hit(const ray<FloatType>& r, FloatType t_min, FloatType t_max, hit_record<FloatType>& rec) const = 0;
+
+    // Called only for the closest hit, with the record this object filled in hit()
+    virtual void surface(const ray<FloatType>& r, const hit_record<FloatType>& rec, surface_interaction<FloatType>& interaction) const = 0;
+};
+
+} // namespace rt
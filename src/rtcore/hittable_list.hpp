@@ -1,7 +1,6 @@
 #pragma once
 
 #include <vector>
-#include <memory>
 
 #include "hittable.hpp"
 
@@ -9,6 +8,7 @@
 namespace rt
 {
 
+// Non-owning: objects live in a scene_arena (common/arena.hpp) that outlives the list
 template<typename FloatType,
     typename = std::enable_if_t<std::is_floating_point<FloatType>::value>
 >
@@ -23,30 +23,40 @@ public:
         objects.clear();
     }
 
-    void add(std::shared_ptr<hittable> object)
+    void reserve(size_t count)
+    {
+        objects.reserve(count);
+    }
+
+    void add(const hittable<FloatType>* object)
     {
         objects.push_back(object);
     }
 
+    // NOTE: objects write `rec` only for a hit closer than closest_so_far, so it is passed down
+    // directly and traversal carries nothing but (t, object) of the closest hit
     virtual bool hit(const ray<FloatType>& r, FloatType t_min, FloatType t_max, hit_record<FloatType>& rec) const
     {
-        hit_record<FloatType> temp_rec;
         bool hit_anything = false;
         FloatType closest_so_far = t_max;
 
         for (const auto& object : objects) {
-            if (object->hit(r, t_min, closest_so_far, temp_rec)) {
+            if (object->hit(r, t_min, closest_so_far, rec)) {
                 hit_anything = true;
-                closest_so_far = temp_rec.time;
-                rec = temp_rec;
+                closest_so_far = rec.t;
             }
         }
 
         return hit_anything;
     }
 
+    virtual void surface(const ray<FloatType>& r, const hit_record<FloatType>& rec, surface_interaction<FloatType>& interaction) const
+    {
+        rec.object->surface(r, rec, interaction);
+    }
+
 public:
-    std::vector<std::shared_ptr<hittable<FloatType>>> objects;
+    std::vector<const hittable<FloatType>*> objects;
 };
 
 
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "common/vec3.hpp"
+#include "common/ray.hpp"
+#include "common/aabb.hpp"
+#include "common/bvh.hpp"
+#include "common/transform.hpp"
+
+#include "hittable.hpp"
+
+
+namespace rt
+{
+
+// One placement of a bottom-level object. Only the world to object transform is kept: rays
+// go through it on entry, and normals go back through its transpose.
+template<typename FloatType>
+struct instance_record
+{
+    affine_transform<FloatType> world_to_object;
+    uint32_t object;    // index into the instance_set's objects
+};
+
+static_assert(sizeof(instance_record<float>) == 52);
+
+
+// Top level of a two-level hierarchy: a BVH over instances, each referring to a bottom-level
+// object (sphere_bvh, triangle_mesh, ...) with its own acceleration structure. Geometry is
+// stored once per object, an instance costs one record and its share of the top-level BVH.
+// Like sphere_bvh the arrays are views, in leaf order, so they can be mapped from a scene cache.
+// NOTE: bottom-level objects must finish surface() from primitive_id/u/v alone, the record's
+// `object` names the instance_set
+template<typename FloatType,
+    typename = std::enable_if_t<std::is_floating_point<FloatType>::value>
+>
+class instance_set : public hittable<FloatType>
+{
+    using vec3_fp = vec3<FloatType>;
+    using ray_type = ray<FloatType>;
+    using bvh_type = bvh<FloatType>;
+    using record_type = instance_record<FloatType>;
+
+public:
+    instance_set(std::span<const bvh_node<FloatType>> nodes,
+                 std::span<const record_type> instances,
+                 std::vector<const hittable<FloatType>*> objects)
+        : m_nodes(nodes)
+        , m_instances(instances)
+        , m_objects(std::move(objects))
+    {}
+
+    size_t instance_count() const
+    {
+        return m_instances.size();
+    }
+
+    // Builds the top-level BVH over `instances` and reorders them into leaf order
+    static std::vector<bvh_node<FloatType>> build(std::vector<record_type>& instances,
+                                                  const std::vector<aabb<FloatType>>& object_bounds)
+    {
+        std::vector<aabb<FloatType>> bounds(instances.size());
+        for (size_t i = 0; i < instances.size(); ++i)
+            bounds[i] = instance_bounds(instances[i], object_bounds);
+
+        bvh_type hierarchy;
+        hierarchy.build(bounds, 2);
+
+        std::vector<record_type> ordered(instances.size());
+        for (size_t i = 0; i < instances.size(); ++i)
+            ordered[i] = instances[hierarchy.item_order[i]];
+        instances = std::move(ordered);
+
+        return std::move(hierarchy.nodes);
+    }
+
+    // Updates the top-level bounds after the objects changed, see bvh::refit()
+    static void refit(std::span<bvh_node<FloatType>> nodes, std::span<const record_type> instances,
+                      const std::vector<aabb<FloatType>>& object_bounds)
+    {
+        bvh_type::refit(nodes, [&](uint32_t first, uint32_t count) {
+            aabb<FloatType> box;
+            for (uint32_t i = first; i < first + count; ++i)
+                box.expand(instance_bounds(instances[i], object_bounds));
+            return box;
+        });
+    }
+
+    virtual bool hit(const ray_type& r, FloatType t_min, FloatType t_max, hit_record<FloatType>& rec) const override
+    {
+        return bvh_type::traverse(m_nodes, r, t_min, t_max, [&](uint32_t first, uint32_t count, FloatType& closest_so_far) {
+            bool hit_anything = false;
+            for (uint32_t i = first; i < first + count; ++i) {
+                const auto& instance = m_instances[i];
+                if (m_objects[instance.object]->hit(instance.world_to_object.apply(r), t_min, closest_so_far, rec)) {
+                    rec.object = this;
+                    rec.instance_id = i;
+                    closest_so_far = rec.t;
+                    hit_anything = true;
+                }
+            }
+            return hit_anything;
+        });
+    }
+
+    virtual void surface(const ray_type& r, const hit_record<FloatType>& rec, surface_interaction<FloatType>& interaction) const override
+    {
+        const auto& instance = m_instances[rec.instance_id];
+        m_objects[instance.object]->surface(instance.world_to_object.apply(r), rec, interaction);
+
+        // NOTE: t is the same in both spaces; the transpose of world_to_object is the normal
+        // transform, and it keeps the side of the normal relative to the ray (front_face holds)
+        interaction.p = r.at(rec.t);
+        interaction.normal = unit_vector(instance.world_to_object.transposed_vector(interaction.normal));
+    }
+
+private:
+    static aabb<FloatType> instance_bounds(const record_type& instance, const std::vector<aabb<FloatType>>& object_bounds)
+    {
+        return instance.world_to_object.inverse().apply(object_bounds[instance.object]);
+    }
+
+    std::span<const bvh_node<FloatType>> m_nodes;
+    std::span<const record_type> m_instances;
+    std::vector<const hittable<FloatType>*> m_objects;
+};
+
+} // namespace rt
@@ -0,0 +1,73 @@
+#include <limits>
+
+#include "common/utility.hpp"
+
+#include "material.hpp"
+#include "integrator.hpp"
+
+
+namespace rt
+{
+
+namespace
+{
+
+// `length` is the number of rays of the path before `r`
+vec3<fp_type> trace(const ray<fp_type>& r, const hittable<fp_type>& world, int depth, int length, render_stats& stats)
+{
+    if (depth <= 0) {
+        stats.add_path(length);
+        return vec3<fp_type>(0);
+    }
+
+    if (length == 0)
+        ++stats.primary_rays;
+    else
+        ++stats.secondary_rays;
+    ++length;
+
+    hit_record<fp_type> record;
+
+    // NOTE: 0.001 instead of 0.0, fixing "shadow acne" problem
+    if (world.hit(r, fp_type(0.001), std::numeric_limits<fp_type>::infinity(), record)) {
+        ray<fp_type> scattered;
+        vec3<fp_type> attenuation;
+
+        surface_interaction<fp_type> interaction;
+        record.object->surface(r, record, interaction);
+
+        ++stats.scatters[size_t(interaction.material_ptr->kind())];
+        if (interaction.material_ptr->scatter(r, interaction, attenuation, scattered))
+            return attenuation * trace(scattered, world, depth - 1, length, stats);
+
+        stats.add_path(length);
+        return vec3<fp_type>(0);
+    }
+
+    stats.add_path(length);
+
+    auto unit_direction = unit_vector(r.direction);
+    fp_type t = fp_type(0.5) * (unit_direction.getY() + 1);
+
+    //return (1 - t) * vec3<fp_type>(1, 1, 1) + t * vec3<fp_type>(0.5, 0.7, 1.0);
+
+    return lerp(vec3<fp_type>(1), vec3<fp_type>(0.5, 0.7, 1.0), t);
+}
+
+} // namespace
+
+
+vec3<fp_type> ray_color(const ray<fp_type>& r, const hittable<fp_type>& world, int depth, render_stats& stats)
+{
+    return trace(r, world, depth, 0, stats);
+}
+
+void store_color(const vec3<fp_type>& color, uint8_t* pixel)
+{
+    auto final_color = vector_sqrt(color) * static_cast<fp_type>(255.999);
+    pixel[0] = final_color.getX();
+    pixel[1] = final_color.getY();
+    pixel[2] = final_color.getZ();
+}
+
+} // namespace rt
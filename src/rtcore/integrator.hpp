@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstdint>
+
+#include "common/vec3.hpp"
+#include "common/ray.hpp"
+
+#include "hittable.hpp"
+#include "render_stats.hpp"
+
+
+namespace rt
+{
+
+// NOTE: the scene headers are templates (the benchmarks compare float and double), the compiled
+// part of rtcore is built for this type only
+using fp_type = float;
+
+// Radiance along `r`: the material scatters it up to `depth` bounces, what leaves the scene
+// sees the sky gradient. `r` is a primary ray, the path is counted into `stats`.
+vec3<fp_type> ray_color(const ray<fp_type>& r, const hittable<fp_type>& world, int depth, render_stats& stats);
+
+// Gamma 2 and quantization of an averaged linear color
+void store_color(const vec3<fp_type>& color, uint8_t* pixel);
+
+} // namespace rt
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <algorithm>
+#include <cstdint>
 
 #include "common/rt_math.hpp"
 #include "common/vec3.hpp"
@@ -13,17 +14,20 @@
 namespace rt
 {
 
-template<typename FloatType,
-    typename = std::enable_if_t<std::is_floating_point<FloatType>::value>
->
+enum class material_kind : uint32_t { lambertian, metal, dielectric, count };
+
+// NOTE: default template argument is given by the declaration in hittable.hpp
+template<typename FloatType, typename>
 class material
 {
     using vec3_fp = vec3<FloatType>;
     using ray_type = ray<FloatType>;
-    using hit_record_type = hit_record<FloatType>;
+    using surface_type = surface_interaction<FloatType>;
 
 public:
-    virtual bool scatter(const ray_type& ray_in, const hit_record_type& record, vec3_fp& attenuation, ray_type& scattered) const = 0;
+    virtual bool scatter(const ray_type& ray_in, const surface_type& interaction, vec3_fp& attenuation, ray_type& scattered) const = 0;
+
+    virtual material_kind kind() const = 0;
 
 //protected:
     
@@ -37,29 +41,34 @@ class lambertian : public material<FloatType>
 {
     using vec3_fp = vec3<FloatType>;
     using ray_type = ray<FloatType>;
-    using hit_record_type = hit_record<FloatType>;
+    using surface_type = surface_interaction<FloatType>;
 
 public:
     lambertian(const vec3_fp albedo)
         : albedo(albedo)
     {}
 
-    virtual bool scatter(const ray_type& ray_in, const hit_record_type& record, vec3_fp& attenuation, ray_type& scattered) const override
+    virtual bool scatter(const ray_type& ray_in, const surface_type& interaction, vec3_fp& attenuation, ray_type& scattered) const override
     {
         // NOTE: diffuse reflection
-        //auto scatter_direction = record.normal + s_random_gen.random_vec3_in_unit_sphere();
+        //auto scatter_direction = interaction.normal + s_random_gen.random_vec3_in_unit_sphere();
         // NOTE: hemispherical scattering
-        //auto scatter_direction = s_random_gen.random_vec3_in_hemisphere(record.normal);
+        //auto scatter_direction = s_random_gen.random_vec3_in_hemisphere(interaction.normal);
         // NOTE: lambertian reflection
-        //auto scatter_direction = record.p + record.normal + s_random_gen.random_vec3_lambertian();
+        //auto scatter_direction = interaction.p + interaction.normal + s_random_gen.random_vec3_lambertian();
 
-        auto scatter_direction = record.normal + s_random_gen.random_vec3_lambertian();
-        scattered = ray_type(record.p, scatter_direction);
+        auto scatter_direction = interaction.normal + s_random_gen.random_vec3_lambertian();
+        scattered = ray_type(interaction.p, scatter_direction, ray_in.time());
         attenuation = albedo;
 
         return true;
     }
 
+    virtual material_kind kind() const override
+    {
+        return material_kind::lambertian;
+    }
+
 public:
     vec3_fp albedo;
 };
@@ -72,7 +81,7 @@ class metal : public material<FloatType>
 {
     using vec3_fp = vec3<FloatType>;
     using ray_type = ray<FloatType>;
-    using hit_record_type = hit_record<FloatType>;
+    using surface_type = surface_interaction<FloatType>;
 
 public:
     metal(const vec3_fp albedo, FloatType fuzziness)
@@ -80,13 +89,18 @@ public:
         , fuzziness(std::clamp<FloatType>(fuzziness, 0, 1))
     {}
 
-    virtual bool scatter(const ray_type& ray_in, const hit_record_type& record, vec3_fp& attenuation, ray_type& scattered) const override
+    virtual bool scatter(const ray_type& ray_in, const surface_type& interaction, vec3_fp& attenuation, ray_type& scattered) const override
     {
-        auto reflected = reflect(unit_vector(ray_in.direction), record.normal);
-        scattered = ray_type(record.p, reflected + fuzziness * s_random_gen.random_vec3_in_unit_sphere());
+        auto reflected = reflect(unit_vector(ray_in.direction), interaction.normal);
+        scattered = ray_type(interaction.p, reflected + fuzziness * s_random_gen.random_vec3_in_unit_sphere(), ray_in.time());
         attenuation = albedo;
 
-        return dot(scattered.direction, record.normal) > 0;
+        return dot(scattered.direction, interaction.normal) > 0;
+    }
+
+    virtual material_kind kind() const override
+    {
+        return material_kind::metal;
     }
 
 public:
@@ -102,20 +116,20 @@ class dielectic : public material<FloatType>
 {
     using vec3_fp = vec3<FloatType>;
     using ray_type = ray<FloatType>;
-    using hit_record_type = hit_record<FloatType>;
+    using surface_type = surface_interaction<FloatType>;
 
 public:
     dielectic(FloatType refraction_index)
         : refraction_index(refraction_index)
     {}
 
-    virtual bool scatter(const ray_type& ray_in, const hit_record_type& record, vec3_fp& attenuation, ray_type& scattered) const override
+    virtual bool scatter(const ray_type& ray_in, const surface_type& interaction, vec3_fp& attenuation, ray_type& scattered) const override
     {
         attenuation = vec3_fp(1);  // glass surface absorbs nothing
-        FloatType etai_over_etat = record.front_face ? (1 / refraction_index) : refraction_index;
+        FloatType etai_over_etat = interaction.front_face ? (1 / refraction_index) : refraction_index;
 
         auto unit_direction = unit_vector(ray_in.direction);
-        FloatType cos_theta = std::min<FloatType>(dot(-unit_direction, record.normal), 1);
+        FloatType cos_theta = std::min<FloatType>(dot(-unit_direction, interaction.normal), 1);
         FloatType sin_theta = rt::sqrt(1 - cos_theta * cos_theta);
 
         vec3_fp reflect_or_refract;
@@ -123,15 +137,20 @@ public:
         if ((etai_over_etat * sin_theta > 1)
             || (s_random_gen() < schlick(cos_theta, etai_over_etat))
             )
-            reflect_or_refract = reflect(unit_direction, record.normal);
+            reflect_or_refract = reflect(unit_direction, interaction.normal);
         else
-            reflect_or_refract = refract(unit_direction, record.normal, etai_over_etat);
+            reflect_or_refract = refract(unit_direction, interaction.normal, etai_over_etat);
 
-        scattered = ray_type(record.p, reflect_or_refract);
+        scattered = ray_type(interaction.p, reflect_or_refract, ray_in.time());
 
         return true;
     }
 
+    virtual material_kind kind() const override
+    {
+        return material_kind::dielectric;
+    }
+
 public:
     FloatType refraction_index;
 
@@ -141,7 +160,7 @@ private:
         FloatType r0 = (1 - refraction_index) / (1 + refraction_index);
         r0 *= r0;
 
-        return r0 + (1 - r0) * rt::pow(1 - cosine, static_cast<FloatType>(5));
+        return r0 + (1 - r0) * rt::pow<5>(1 - cosine);
     }
 };
 
@@ -0,0 +1,664 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "common/mapped_file.hpp"
+
+#include "triangle_mesh.hpp"
+
+
+// Mesh loading straight into triangle_mesh's SoA buffers.
+// OBJ: the mapped file is cut into chunks at line boundaries and parsed in two parallel passes.
+// The first pass counts the vertices and triangles of every chunk. Their prefix sums give each
+// chunk its output offsets, so the buffers are sized exactly once. The second pass parses
+// with std::from_chars into those offsets. Only `v` and `f` records are read; polygons are fan
+// triangulated, negative (relative) indices are resolved against the chunk's vertex offset.
+// PLY: binary_little_endian only. Vertex properties are copied out of the mapping with a fixed
+// stride; triangle-only face lists are read in parallel, anything else falls back to one pass.
+namespace rt
+{
+
+namespace detail
+{
+
+// Splits [0, task_count) over threads, task 0 runs on the calling thread
+template<typename Func>
+void run_parallel(int task_count, const Func& func)
+{
+    std::vector<std::thread> threads;
+    threads.reserve(task_count > 1 ? task_count - 1 : 0);
+    for (int i = 1; i < task_count; ++i)
+        threads.emplace_back(std::cref(func), i);
+
+    if (task_count > 0)
+        func(0);
+
+    for (auto& t : threads)
+        t.join();
+}
+
+inline int loader_thread_count(size_t bytes, int requested)
+{
+    // NOTE: below a few MB the thread start-up costs more than the parse
+    const size_t min_chunk_size = size_t(4) << 20;
+
+    int count = requested > 0 ? requested : static_cast<int>(std::thread::hardware_concurrency());
+    count = std::max(count, 1);
+    return static_cast<int>(std::clamp<size_t>(bytes / min_chunk_size, 1, count));
+}
+
+inline bool is_blank(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+inline const char* skip_blanks(const char* p, const char* end)
+{
+    while (p < end && is_blank(*p))
+        ++p;
+    return p;
+}
+
+inline const char* skip_token(const char* p, const char* end)
+{
+    while (p < end && is_blank(*p) == false && *p != '\n')
+        ++p;
+    return p;
+}
+
+inline const char* line_end(const char* p, const char* end)
+{
+    auto* newline = static_cast<const char*>(std::memchr(p, '\n', end - p));
+    return newline != nullptr ? newline : end;
+}
+
+// from_chars does not take a leading '+', which some exporters write
+template<typename T>
+inline const char* parse_number(const char* p, const char* end, T& value)
+{
+    p = skip_blanks(p, end);
+    if (p < end && *p == '+')
+        ++p;
+
+    auto result = std::from_chars(p, end, value);
+    return result.ec == std::errc() ? result.ptr : nullptr;
+}
+
+
+struct obj_chunk
+{
+    const char* begin;
+    const char* end;
+    size_t vertex_count = 0;
+    size_t triangle_count = 0;
+    size_t vertex_offset = 0;
+    size_t triangle_offset = 0;
+    const char* error = nullptr;    // position of the first malformed record
+};
+
+inline bool is_record(const char* p, const char* end, char type)
+{
+    return p + 1 < end && p[0] == type && is_blank(p[1]);
+}
+
+inline void count_obj_chunk(obj_chunk& chunk)
+{
+    for (const char* p = chunk.begin; p < chunk.end; ) {
+        const char* eol = line_end(p, chunk.end);
+        p = skip_blanks(p, eol);
+
+        if (is_record(p, eol, 'v')) {
+            ++chunk.vertex_count;
+        }
+        else if (is_record(p, eol, 'f')) {
+            size_t corners = 0;
+            for (p = skip_blanks(p + 1, eol); p < eol && *p != '#'; p = skip_blanks(skip_token(p, eol), eol))
+                ++corners;
+            chunk.triangle_count += corners >= 3 ? corners - 2 : 0;
+        }
+
+        p = eol + 1;
+    }
+}
+
+template<typename FloatType>
+void parse_obj_chunk(obj_chunk& chunk, triangle_mesh<FloatType>& mesh)
+{
+    const int64_t vertex_total = static_cast<int64_t>(mesh.x.size());
+    size_t vertex = chunk.vertex_offset;
+    uint32_t* out = mesh.indices.data() + chunk.triangle_offset * 3;
+
+    for (const char* p = chunk.begin; p < chunk.end; ) {
+        const char* line = p;
+        const char* eol = line_end(p, chunk.end);
+        p = skip_blanks(p, eol);
+
+        if (is_record(p, eol, 'v')) {
+            p += 1;
+            if ((p = parse_number(p, eol, mesh.x[vertex])) == nullptr
+             || (p = parse_number(p, eol, mesh.y[vertex])) == nullptr
+             || (p = parse_number(p, eol, mesh.z[vertex])) == nullptr) {
+                chunk.error = line;
+                return;
+            }
+            ++vertex;
+        }
+        else if (is_record(p, eol, 'f')) {
+            uint32_t first = 0, previous = 0;
+            int corner = 0;
+
+            for (p = skip_blanks(p + 1, eol); p < eol && *p != '#'; p = skip_blanks(skip_token(p, eol), eol)) {
+                // NOTE: v, v/vt, v//vn and v/vt/vn all start with the position index
+                int64_t index;
+                auto result = std::from_chars(p, eol, index);
+                if (result.ec != std::errc())
+                    index = 0;
+                else if (index > 0)
+                    index -= 1;
+                else if (index < 0)
+                    index += static_cast<int64_t>(vertex);
+
+                if (result.ec != std::errc() || index < 0 || index >= vertex_total) {
+                    chunk.error = line;
+                    return;
+                }
+
+                const uint32_t current = static_cast<uint32_t>(index);
+                if (corner == 0)
+                    first = current;
+                else if (corner >= 2) {
+                    out[0] = first;
+                    out[1] = previous;
+                    out[2] = current;
+                    out += 3;
+                }
+                previous = current;
+                ++corner;
+            }
+        }
+
+        p = eol + 1;
+    }
+}
+
+
+enum class ply_type : uint8_t { none, int8, uint8, int16, uint16, int32, uint32, float32, float64 };
+
+inline ply_type parse_ply_type(std::string_view name)
+{
+    if (name == "char" || name == "int8") return ply_type::int8;
+    if (name == "uchar" || name == "uint8") return ply_type::uint8;
+    if (name == "short" || name == "int16") return ply_type::int16;
+    if (name == "ushort" || name == "uint16") return ply_type::uint16;
+    if (name == "int" || name == "int32") return ply_type::int32;
+    if (name == "uint" || name == "uint32") return ply_type::uint32;
+    if (name == "float" || name == "float32") return ply_type::float32;
+    if (name == "double" || name == "float64") return ply_type::float64;
+    return ply_type::none;
+}
+
+inline size_t ply_type_size(ply_type type)
+{
+    constexpr size_t sizes[] = { 0, 1, 1, 2, 2, 4, 4, 4, 8 };
+    return sizes[static_cast<int>(type)];
+}
+
+// PLY data is unaligned, every value goes through memcpy
+template<typename T>
+T read_ply_value(const char* p, ply_type type)
+{
+    auto load = [p](auto value) {
+        std::memcpy(&value, p, sizeof(value));
+        return static_cast<T>(value);
+    };
+
+    switch (type) {
+    case ply_type::int8:    return load(int8_t());
+    case ply_type::uint8:   return load(uint8_t());
+    case ply_type::int16:   return load(int16_t());
+    case ply_type::uint16:  return load(uint16_t());
+    case ply_type::int32:   return load(int32_t());
+    case ply_type::uint32:  return load(uint32_t());
+    case ply_type::float32: return load(float());
+    case ply_type::float64: return load(double());
+    default:                return T();
+    }
+}
+
+struct ply_property
+{
+    std::string name;
+    ply_type type = ply_type::none;
+    ply_type count_type = ply_type::none;    // set for list properties
+    size_t offset = 0;                        // within the element, valid up to the first list
+};
+
+struct ply_element
+{
+    std::string name;
+    size_t count = 0;
+    std::vector<ply_property> properties;
+    size_t fixed_size = 0;     // bytes of the properties in front of the first list
+    bool has_list = false;
+
+    const ply_property* find(std::string_view property_name) const
+    {
+        for (const auto& property : properties) {
+            if (property.name == property_name)
+                return &property;
+        }
+        return nullptr;
+    }
+
+    // size of one record starting at `p`, lists included
+    size_t record_size(const char* p) const
+    {
+        if (has_list == false)
+            return fixed_size;
+
+        size_t size = 0;
+        for (const auto& property : properties) {
+            if (property.count_type != ply_type::none) {
+                auto count = read_ply_value<size_t>(p + size, property.count_type);
+                size += ply_type_size(property.count_type) + count * ply_type_size(property.type);
+            }
+            else {
+                size += ply_type_size(property.type);
+            }
+        }
+        return size;
+    }
+};
+
+inline bool parse_ply_header(const char* data, size_t size, std::vector<ply_element>& elements,
+                             size_t& body_offset, std::string& error)
+{
+    std::string_view text(data, size);
+    if (text.starts_with("ply\n") == false && text.starts_with("ply\r\n") == false) {
+        error = "not a PLY file";
+        return false;
+    }
+
+    size_t position = 0;
+    while (true) {
+        const size_t eol = text.find('\n', position);
+        if (eol == std::string_view::npos) {
+            error = "PLY header has no end_header";
+            return false;
+        }
+
+        std::string_view line = text.substr(position, eol - position);
+        if (line.ends_with('\r'))
+            line.remove_suffix(1);
+        position = eol + 1;
+
+        std::vector<std::string_view> words;
+        for (size_t begin = 0; begin < line.size(); ) {
+            size_t end = line.find(' ', begin);
+            if (end == std::string_view::npos)
+                end = line.size();
+            if (end > begin)
+                words.push_back(line.substr(begin, end - begin));
+            begin = end + 1;
+        }
+
+        if (words.empty() || words[0] == "ply" || words[0] == "comment" || words[0] == "obj_info")
+            continue;
+
+        if (words[0] == "end_header")
+            break;
+
+        if (words[0] == "format") {
+            if (words.size() < 2 || words[1] != "binary_little_endian") {
+                error = "only binary_little_endian PLY is supported";
+                return false;
+            }
+        }
+        else if (words[0] == "element" && words.size() == 3) {
+            ply_element element;
+            element.name = words[1];
+            if (std::from_chars(words[2].data(), words[2].data() + words[2].size(), element.count).ec != std::errc()) {
+                error = "bad PLY element count";
+                return false;
+            }
+            elements.push_back(std::move(element));
+        }
+        else if (words[0] == "property" && elements.empty() == false) {
+            ply_element& element = elements.back();
+            ply_property property;
+
+            const bool is_list = words.size() > 1 && words[1] == "list";
+            if (is_list && words.size() == 5) {
+                property.count_type = parse_ply_type(words[2]);
+                property.type = parse_ply_type(words[3]);
+                property.name = words[4];
+            }
+            else if (words.size() == 3) {
+                property.type = parse_ply_type(words[1]);
+                property.name = words[2];
+            }
+
+            if (property.type == ply_type::none || (is_list && property.count_type == ply_type::none)) {
+                error = "bad PLY property: " + std::string(line);
+                return false;
+            }
+
+            property.offset = element.fixed_size;
+            if (element.has_list == false) {
+                if (property.count_type == ply_type::none)
+                    element.fixed_size += ply_type_size(property.type);
+                else
+                    element.has_list = true;
+            }
+            element.properties.push_back(std::move(property));
+        }
+        else {
+            error = "unexpected PLY header line: " + std::string(line);
+            return false;
+        }
+    }
+
+    body_offset = position;
+    return true;
+}
+
+} // namespace detail
+
+
+// thread_count 0 uses every hardware thread; on failure `error` says why and the mesh is left empty
+template<typename FloatType>
+bool load_obj(const char* path, triangle_mesh<FloatType>& mesh, std::string& error, int thread_count = 0)
+{
+    mesh.x.clear();
+    mesh.y.clear();
+    mesh.z.clear();
+    mesh.indices.clear();
+
+    mapped_file file;
+    if (file.open(path) == false) {
+        error = std::string("can't open ") + path;
+        return false;
+    }
+
+    const char* data = file.data();
+    const size_t size = file.size();
+    const int chunk_count = detail::loader_thread_count(size, thread_count);
+
+    std::vector<detail::obj_chunk> chunks(chunk_count);
+    for (int i = 0; i < chunk_count; ++i) {
+        // NOTE: every chunk but the first starts after the newline at or past its even split
+        const char* begin = data + size * i / chunk_count;
+        if (i > 0 && begin[-1] != '\n')
+            begin = std::min(detail::line_end(begin, data + size) + 1, data + size);
+
+        chunks[i].begin = begin;
+        if (i > 0)
+            chunks[i - 1].end = begin;
+    }
+    if (chunk_count > 0)
+        chunks.back().end = data + size;
+
+    detail::run_parallel(chunk_count, [&](int i) { detail::count_obj_chunk(chunks[i]); });
+
+    size_t vertex_count = 0, triangle_count = 0;
+    for (auto& chunk : chunks) {
+        chunk.vertex_offset = vertex_count;
+        chunk.triangle_offset = triangle_count;
+        vertex_count += chunk.vertex_count;
+        triangle_count += chunk.triangle_count;
+    }
+
+    if (vertex_count > std::numeric_limits<uint32_t>::max()) {
+        error = "too many vertices for 32-bit indices";
+        return false;
+    }
+
+    mesh.x.resize(vertex_count);
+    mesh.y.resize(vertex_count);
+    mesh.z.resize(vertex_count);
+    mesh.indices.resize(triangle_count * 3);
+
+    detail::run_parallel(chunk_count, [&](int i) { detail::parse_obj_chunk(chunks[i], mesh); });
+
+    for (const auto& chunk : chunks) {
+        if (chunk.error != nullptr) {
+            const char* eol = detail::line_end(chunk.error, data + size);
+            error = "malformed OBJ record at byte " + std::to_string(chunk.error - data) + ": "
+                  + std::string(chunk.error, std::min<size_t>(eol - chunk.error, 80));
+            mesh.x.clear();
+            mesh.y.clear();
+            mesh.z.clear();
+            mesh.indices.clear();
+            return false;
+        }
+    }
+
+    return true;
+}
+
+template<typename FloatType>
+bool load_ply(const char* path, triangle_mesh<FloatType>& mesh, std::string& error, int thread_count = 0)
+{
+    mesh.x.clear();
+    mesh.y.clear();
+    mesh.z.clear();
+    mesh.indices.clear();
+
+    mapped_file file;
+    if (file.open(path) == false) {
+        error = std::string("can't open ") + path;
+        return false;
+    }
+
+    std::vector<detail::ply_element> elements;
+    size_t body_offset = 0;
+    if (detail::parse_ply_header(file.data(), file.size(), elements, body_offset, error) == false)
+        return false;
+
+    const char* p = file.data() + body_offset;
+    const char* end = file.data() + file.size();
+
+    for (const auto& element : elements) {
+        const bool is_vertex = element.name == "vertex";
+        const bool is_face = element.name == "face";
+
+        const detail::ply_property* px = is_vertex ? element.find("x") : nullptr;
+        const detail::ply_property* py = is_vertex ? element.find("y") : nullptr;
+        const detail::ply_property* pz = is_vertex ? element.find("z") : nullptr;
+        const detail::ply_property* list = nullptr;
+        if (is_face) {
+            list = element.find("vertex_indices");
+            if (list == nullptr)
+                list = element.find("vertex_index");
+
+            // NOTE: offsets are only known up to the first list, the index list has to be it
+            auto first_list = std::find_if(element.properties.begin(), element.properties.end(),
+                                           [](const auto& property) { return property.count_type != detail::ply_type::none; });
+            if (list != nullptr && (first_list == element.properties.end() || &*first_list != list)) {
+                error = "PLY faces with lists in front of the vertex indices are not supported";
+                return false;
+            }
+        }
+
+        if (is_vertex) {
+            if (px == nullptr || py == nullptr || pz == nullptr || element.has_list) {
+                error = "PLY vertices need x, y and z and no list properties";
+                return false;
+            }
+            if (element.count > std::numeric_limits<uint32_t>::max()) {
+                error = "too many vertices for 32-bit indices";
+                return false;
+            }
+            if (size_t(end - p) / std::max<size_t>(element.fixed_size, 1) < element.count) {
+                error = "PLY vertex data is truncated";
+                return false;
+            }
+
+            mesh.x.resize(element.count);
+            mesh.y.resize(element.count);
+            mesh.z.resize(element.count);
+
+            // NOTE: a strided copy, the mesh is SoA and PLY is AoS, so the mapping can't be used in place
+            const size_t stride = element.fixed_size;
+            const int task_count = detail::loader_thread_count(element.count * stride, thread_count);
+            detail::run_parallel(task_count, [&](int task) {
+                const size_t first = element.count * task / task_count;
+                const size_t last = element.count * (task + 1) / task_count;
+                for (size_t i = first; i < last; ++i) {
+                    const char* record = p + i * stride;
+                    mesh.x[i] = detail::read_ply_value<FloatType>(record + px->offset, px->type);
+                    mesh.y[i] = detail::read_ply_value<FloatType>(record + py->offset, py->type);
+                    mesh.z[i] = detail::read_ply_value<FloatType>(record + pz->offset, pz->type);
+                }
+            });
+
+            p += element.count * stride;
+            continue;
+        }
+
+        if (is_face && list != nullptr && element.count > 0) {
+            const size_t vertex_count = mesh.x.size();
+            const size_t count_size = detail::ply_type_size(list->count_type);
+            const size_t index_size = detail::ply_type_size(list->type);
+
+            // the common case, a single list of triangles, has a fixed stride and is read in parallel
+            const bool single_list = element.properties.size() == 1;
+            const size_t stride = count_size + 3 * index_size;
+            bool is_fixed = single_list && size_t(end - p) / stride >= element.count;
+
+            if (is_fixed) {
+                mesh.indices.resize(element.count * 3);
+
+                std::atomic<bool> failed = false;
+                const int task_count = detail::loader_thread_count(element.count * stride, thread_count);
+                detail::run_parallel(task_count, [&](int task) {
+                    const size_t first = element.count * task / task_count;
+                    const size_t last = element.count * (task + 1) / task_count;
+                    for (size_t i = first; i < last; ++i) {
+                        const char* record = p + i * stride;
+                        const auto count = detail::read_ply_value<size_t>(record, list->count_type);
+                        for (int k = 0; k < 3; ++k)
+                            mesh.indices[i * 3 + k] = detail::read_ply_value<uint32_t>(record + count_size + k * index_size, list->type);
+                        if (count != 3) {
+                            failed.store(true, std::memory_order_relaxed);
+                            return;
+                        }
+                    }
+                });
+                is_fixed = failed.load() == false;
+            }
+
+            if (is_fixed) {
+                p += element.count * stride;
+            }
+            else {
+                // polygons or extra face properties: one pass to count, one to fan triangulate
+                size_t triangle_count = 0;
+                const char* record = p;
+                for (size_t i = 0; i < element.count; ++i) {
+                    if (record + element.record_size(record) > end) {
+                        error = "PLY face data is truncated";
+                        mesh.indices.clear();
+                        return false;
+                    }
+                    const char* list_data = record + list->offset;
+                    const auto corners = detail::read_ply_value<size_t>(list_data, list->count_type);
+                    triangle_count += corners >= 3 ? corners - 2 : 0;
+                    record += element.record_size(record);
+                }
+
+                mesh.indices.resize(triangle_count * 3);
+                uint32_t* out = mesh.indices.data();
+                for (size_t i = 0; i < element.count; ++i) {
+                    const char* list_data = p + list->offset;
+                    const auto corners = detail::read_ply_value<size_t>(list_data, list->count_type);
+                    const char* values = list_data + count_size;
+                    for (size_t k = 2; k < corners; ++k) {
+                        out[0] = detail::read_ply_value<uint32_t>(values, list->type);
+                        out[1] = detail::read_ply_value<uint32_t>(values + (k - 1) * index_size, list->type);
+                        out[2] = detail::read_ply_value<uint32_t>(values + k * index_size, list->type);
+                        out += 3;
+                    }
+                    p += element.record_size(p);
+                }
+            }
+
+            // NOTE: checked once at the end, out of range indices would crash build()
+            for (uint32_t index : mesh.indices) {
+                if (index >= vertex_count) {
+                    error = "PLY face index out of range";
+                    mesh.indices.clear();
+                    return false;
+                }
+            }
+            continue;
+        }
+
+        // any other element is skipped
+        for (size_t i = 0; i < element.count; ++i) {
+            if (p >= end) {
+                error = "PLY data is truncated";
+                return false;
+            }
+            p += element.record_size(p);
+        }
+    }
+
+    if (mesh.x.empty()) {
+        error = "PLY file has no vertex element";
+        return false;
+    }
+
+    return true;
+}
+
+template<typename FloatType>
+bool load_mesh(const char* path, triangle_mesh<FloatType>& mesh, std::string& error, int thread_count = 0)
+{
+    std::string_view name(path);
+    if (name.ends_with(".ply") || name.ends_with(".PLY"))
+        return load_ply(path, mesh, error, thread_count);
+    return load_obj(path, mesh, error, thread_count);
+}
+
+// Binary little-endian PLY with float positions and triangle lists, the layout load_ply reads fastest
+template<typename FloatType>
+bool write_ply(const char* path, const triangle_mesh<FloatType>& mesh)
+{
+    std::FILE* file = std::fopen(path, "wb");
+    if (file == nullptr)
+        return false;
+
+    std::fprintf(file, "ply\nformat binary_little_endian 1.0\n"
+                       "element vertex %zu\nproperty float x\nproperty float y\nproperty float z\n"
+                       "element face %zu\nproperty list uchar uint vertex_indices\nend_header\n",
+                 mesh.vertex_count(), mesh.triangle_count());
+
+    bool ok = true;
+    for (size_t i = 0; i < mesh.vertex_count() && ok; ++i) {
+        const float position[3] = { float(mesh.x[i]), float(mesh.y[i]), float(mesh.z[i]) };
+        ok = std::fwrite(position, sizeof(position), 1, file) == 1;
+    }
+
+    for (size_t i = 0; i < mesh.triangle_count() && ok; ++i) {
+        char record[13];
+        record[0] = 3;
+        std::memcpy(record + 1, mesh.indices.data() + i * 3, 12);
+        ok = std::fwrite(record, sizeof(record), 1, file) == 1;
+    }
+    std::fclose(file);
+
+    return ok;
+}
+
+} // namespace rt
@@ -0,0 +1,208 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "common/json.hpp"
+#include "common/trace.hpp"
+
+
+// Progress of a long render: work done (pixels or tiles), Mrays/s and ETA, printed and/or written
+// as a JSON status file by a monitor thread every `interval`. Render threads never wait for it:
+// each one publishes into a counter of its own with relaxed stores, a cache line per counter,
+// and the monitor only reads them. Nothing orders the counters against each other or the image,
+// a report is a snapshot that may be a row behind.
+namespace rt
+{
+
+// One writer only (a render thread, or a coordinator thread serving one worker)
+struct alignas(64) progress_counter
+{
+    std::atomic<uint64_t> done{ 0 };
+    std::atomic<uint64_t> rays{ 0 };
+
+    // NOTE: load and store rather than fetch_add, with a single writer there is no race to
+    // resolve and no locked instruction on the render path
+    void add(uint64_t done_, uint64_t rays_)
+    {
+        done.store(done.load(std::memory_order_relaxed) + done_, std::memory_order_relaxed);
+        rays.store(rays.load(std::memory_order_relaxed) + rays_, std::memory_order_relaxed);
+    }
+};
+
+
+class render_progress
+{
+    using clock_type = std::chrono::steady_clock;
+
+public:
+    // `total` units of work (e.g. "pixels") over `slots` writers. Reports go to stdout with
+    // `print`, to `status_path` if not empty.
+    render_progress(const char* unit, uint64_t total, int slots, bool print, std::string status_path,
+                    std::chrono::milliseconds interval = std::chrono::milliseconds(1000))
+        : m_unit(unit)
+        , m_total(std::max<uint64_t>(total, 1))
+        , m_counters(std::max(slots, 1))
+        , m_print(print)
+        , m_status_path(std::move(status_path))
+        , m_interval(interval)
+    {}
+
+    ~render_progress()
+    {
+        stop();
+    }
+
+    render_progress(const render_progress&) = delete;
+    render_progress& operator=(const render_progress&) = delete;
+
+    progress_counter& counter(int slot)
+    {
+        return m_counters[slot % m_counters.size()];
+    }
+
+    void start()
+    {
+        m_start_t = m_last_t = clock_type::now();
+        m_last_rays = 0;
+        m_stop = false;
+        m_monitor = std::thread(&render_progress::monitor, this);
+    }
+
+    // The final report, once the work is done
+    void stop()
+    {
+        if (m_monitor.joinable() == false)
+            return;
+
+        {
+            std::lock_guard lock(m_mutex);
+            m_stop = true;
+        }
+        m_wake.notify_one();
+        m_monitor.join();
+        report(true);
+    }
+
+private:
+    // NOTE: the mutex only serves the monitor's sleep, the render threads never touch it
+    void monitor()
+    {
+        RT_TRACE_THREAD("progress");
+        std::unique_lock lock(m_mutex);
+        while (m_wake.wait_for(lock, m_interval, [this] { return m_stop; }) == false) {
+            lock.unlock();
+            report(false);
+            lock.lock();
+        }
+    }
+
+    void report(bool finished)
+    {
+        uint64_t done = 0;
+        uint64_t rays = 0;
+        for (const auto& counter : m_counters) {
+            done += counter.done.load(std::memory_order_relaxed);
+            rays += counter.rays.load(std::memory_order_relaxed);
+        }
+        done = std::min(done, m_total);
+
+        const auto now = clock_type::now();
+        const double elapsed = std::chrono::duration<double>(now - m_start_t).count();
+        const double interval = std::chrono::duration<double>(now - m_last_t).count();
+
+        // NOTE: Mrays/s over the last interval, to see it change with the scene; the ETA from
+        // the average rate, which is steadier
+        const double mrays_per_second = interval > 0 ? (rays - m_last_rays) / (interval * 1e6) : 0;
+        const double fraction = double(done) / m_total;
+        const double eta = finished ? 0 : done > 0 ? elapsed * (m_total - done) / done : -1;
+        m_last_t = now;
+        m_last_rays = rays;
+
+        const double rate = finished ? rays / std::max(elapsed * 1e6, 1e-9) : mrays_per_second;
+
+        // NOTE: no rate without rays, e.g. tiles of remote workers, which count their rays themselves
+        if (m_print) {
+            char line[192];
+            int length = std::snprintf(line, sizeof(line), "Progress: %llu/%llu %s (%.1f%%)", (unsigned long long)done,
+                                       (unsigned long long)m_total, m_unit, 100 * fraction);
+            if (rays > 0)
+                length += std::snprintf(line + length, sizeof(line) - length, ", %.2f Mrays/s%s", rate, finished ? " average" : "");
+            if (finished)
+                std::snprintf(line + length, sizeof(line) - length, ", %.1fs\n", elapsed);
+            else
+                std::snprintf(line + length, sizeof(line) - length, ", ETA %s\n", format_duration(eta).c_str());
+
+            // NOTE: one write per line, so that it doesn't interleave with other output mid-line
+            std::cout << line << std::flush;
+        }
+
+        if (m_status_path.empty() == false)
+            write_status(finished, done, rays, fraction, rays > 0 ? rate : -1, elapsed, eta);
+    }
+
+    // Written next to the target and renamed over it, a reader never sees half a file. Unknown
+    // values (negative) are null.
+    void write_status(bool finished, uint64_t done, uint64_t rays, double fraction, double mrays_per_second,
+                      double elapsed, double eta) const
+    {
+        const std::string temp_path = m_status_path + ".tmp";
+        {
+            std::ofstream out(temp_path);
+            out << "{ \"unit\": " << json_quote(m_unit) << ", \"done\": " << done << ", \"total\": " << m_total
+                << ", \"fraction\": " << fraction << ", \"rays\": " << rays
+                << ", \"mrays_per_s\": " << (mrays_per_second >= 0 ? std::to_string(mrays_per_second) : "null")
+                << ", \"elapsed_s\": " << elapsed << ", \"eta_s\": " << (eta >= 0 ? std::to_string(eta) : "null")
+                << ", \"finished\": " << (finished ? "true" : "false") << " }\n";
+            if (out.good() == false)
+                return;
+        }
+
+        std::error_code error;
+        std::filesystem::rename(temp_path, m_status_path, error);
+    }
+
+    static std::string format_duration(double seconds)
+    {
+        if (seconds < 0)
+            return "unknown";
+
+        const long long s = static_cast<long long>(seconds + 0.5);
+        char text[32];
+        if (s >= 3600)
+            std::snprintf(text, sizeof(text), "%lld:%02lld:%02lld", s / 3600, s / 60 % 60, s % 60);
+        else
+            std::snprintf(text, sizeof(text), "%lld:%02lld", s / 60, s % 60);
+        return text;
+    }
+
+    const char* m_unit;
+    uint64_t m_total;
+    std::vector<progress_counter> m_counters;
+    bool m_print;
+    std::string m_status_path;
+    std::chrono::milliseconds m_interval;
+
+    std::thread m_monitor;
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    bool m_stop = false;
+
+    // monitor thread only, then stop()
+    clock_type::time_point m_start_t;
+    clock_type::time_point m_last_t;
+    uint64_t m_last_rays = 0;
+};
+
+} // namespace rt
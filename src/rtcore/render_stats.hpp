@@ -0,0 +1,121 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <iomanip>
+#include <ostream>
+#include <string>
+
+#include "common/bvh.hpp"
+
+#include "material.hpp"
+
+
+// Counters of a render. Every render thread fills a block of its own, aligned to a cache line
+// so that the blocks of neighbouring threads never share one, and the blocks are merged when
+// the render ends. The counters are 64-bit: an 8K frame at 1024 samples and depth 20 is far
+// past 2^31 rays.
+namespace rt
+{
+
+struct alignas(64) render_stats
+{
+    // Path lengths in rays, the last bin also counts the longer paths
+    static constexpr int path_length_bins = 65;
+    static constexpr size_t material_count = size_t(material_kind::count);
+
+    uint64_t primary_rays = 0;
+    uint64_t secondary_rays = 0;
+    uint64_t nodes_visited = 0;      // with RT_TRAVERSAL_STATS only
+    uint64_t primitive_tests = 0;    // with RT_TRAVERSAL_STATS only
+    uint64_t scatters[material_count] = {};
+    uint64_t path_length[path_length_bins] = {};
+
+    uint64_t rays() const
+    {
+        return primary_rays + secondary_rays;
+    }
+
+    void add_path(int length)
+    {
+        ++path_length[std::min(length, path_length_bins - 1)];
+    }
+
+    // Adds what this thread's traversals counted since `start`
+    void add_traversal(const traversal_counters& start)
+    {
+        nodes_visited += s_traversal_counters.nodes_visited - start.nodes_visited;
+        primitive_tests += s_traversal_counters.primitive_tests - start.primitive_tests;
+    }
+
+    render_stats& operator+=(const render_stats& other)
+    {
+        primary_rays += other.primary_rays;
+        secondary_rays += other.secondary_rays;
+        nodes_visited += other.nodes_visited;
+        primitive_tests += other.primitive_tests;
+        for (size_t i = 0; i < material_count; ++i)
+            scatters[i] += other.scatters[i];
+        for (int i = 0; i < path_length_bins; ++i)
+            path_length[i] += other.path_length[i];
+        return *this;
+    }
+};
+
+static_assert(sizeof(render_stats) % 64 == 0);
+
+
+inline const char* to_string(material_kind kind)
+{
+    switch (kind) {
+    case material_kind::lambertian: return "lambertian";
+    case material_kind::metal: return "metal";
+    case material_kind::dielectric: return "dielectric";
+    default: return "unknown";
+    }
+}
+
+inline void print_stats(std::ostream& out, const render_stats& stats)
+{
+    const double rays = std::max<double>(double(stats.rays()), 1);
+
+    out << "Primary rays: " << stats.primary_rays << "\nSecondary rays: " << stats.secondary_rays << '\n';
+    if (RT_TRAVERSAL_STATS) {
+        out << "BVH nodes: " << stats.nodes_visited << " (" << stats.nodes_visited / rays << " per ray)"
+            << "\nPrimitive tests: " << stats.primitive_tests << " (" << stats.primitive_tests / rays << " per ray)\n";
+    }
+    for (size_t i = 0; i < render_stats::material_count; ++i)
+        out << "Scatter " << to_string(material_kind(i)) << ": " << stats.scatters[i] << '\n';
+
+    uint64_t paths = 0;
+    for (uint64_t count : stats.path_length)
+        paths += count;
+    out << "Path lengths:\n";
+    for (int i = 0; i < render_stats::path_length_bins; ++i) {
+        if (stats.path_length[i] == 0)
+            continue;
+        out << std::setw(5) << i << (i == render_stats::path_length_bins - 1 ? "+" : " ") << std::setw(14) << stats.path_length[i]
+            << std::fixed << std::setprecision(2) << std::setw(8) << 100.0 * stats.path_length[i] / paths << " %\n";
+    }
+    out << std::defaultfloat;
+}
+
+// NOTE: the traversal counters are written as null unless they were counted
+inline std::string stats_json(const render_stats& stats)
+{
+    std::string json = "{ \"primary_rays\": " + std::to_string(stats.primary_rays)
+                     + ", \"secondary_rays\": " + std::to_string(stats.secondary_rays)
+                     + ", \"nodes_visited\": " + (RT_TRAVERSAL_STATS ? std::to_string(stats.nodes_visited) : "null")
+                     + ", \"primitive_tests\": " + (RT_TRAVERSAL_STATS ? std::to_string(stats.primitive_tests) : "null")
+                     + ", \"scatters\": { ";
+    for (size_t i = 0; i < render_stats::material_count; ++i)
+        json += std::string(i > 0 ? ", \"" : "\"") + to_string(material_kind(i)) + "\": " + std::to_string(stats.scatters[i]);
+
+    // NOTE: index = path length in rays, the last entry counts the longer ones too
+    json += " }, \"path_length\": [";
+    for (int i = 0; i < render_stats::path_length_bins; ++i)
+        json += (i > 0 ? ", " : "") + std::to_string(stats.path_length[i]);
+    return json + "] }";
+}
+
+} // namespace rt
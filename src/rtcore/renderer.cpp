@@ -0,0 +1,374 @@
+#include <atomic>
+#include <iostream>
+#include <limits>
+#include <thread>
+#include <vector>
+
+#include "common/stb_image_write.h"
+#include "common/image_io.hpp"
+#include "common/utility.hpp"
+#include "common/random_generator.hpp"
+#include "common/trace.hpp"
+
+#include "renderer.hpp"
+
+
+namespace rt
+{
+
+namespace
+{
+
+// Pixels first, first + step, .. of row j. Metric != none also writes the cost of every pixel
+// to `cost`.
+template<heatmap_metric Metric>
+void render_row(int j, int first, int step, uint8_t* __restrict img, const hittable<fp_type>& world, const camera<fp_type>& cam,
+                const render_settings<fp_type>& settings, render_stats& stats, float* cost)
+{
+    RT_TRACE_SCOPE("row");
+
+    const int width = settings.width;
+    const int height = settings.height;
+    const int samples_per_pixel = settings.samples_per_pixel;
+
+    // NOTE: from the row, a thread's last pixel of a row isn't `step` pixels before its first of
+    // the next one unless the width is a multiple of the step
+    uint8_t* img_ptr = img + (size_t(j) * width + first) * framebuffer::channels;
+
+    for (int i = first; i < width; i += step) {
+        vec3<fp_type> color(0, 0, 0);
+
+        [[maybe_unused]] uint64_t cost_start = 0;
+        if constexpr (Metric == heatmap_metric::rays)
+            cost_start = stats.rays();
+        else if constexpr (Metric == heatmap_metric::cycles)
+            cost_start = cycle_count();
+
+        for (int s = 0; s < samples_per_pixel; ++s) {
+            fp_type v = fp_type(j + s_random_gen()) / height;
+            fp_type u = fp_type(i + s_random_gen()) / width;
+
+            auto r = cam.get_ray(u, v);
+            color += ray_color(r, world, settings.max_depth, stats);
+        }
+
+        if constexpr (Metric == heatmap_metric::rays)
+            cost[size_t(j) * width + i] = float(stats.rays() - cost_start);
+        else if constexpr (Metric == heatmap_metric::cycles)
+            cost[size_t(j) * width + i] = float(cycle_count() - cost_start);
+
+        color /= samples_per_pixel;
+
+        store_color(color, img_ptr);
+        img_ptr += step * framebuffer::channels;
+    }
+}
+
+// TODO: random generator is not thread safe
+template<heatmap_metric Metric>
+void render_columns(int shift, uint8_t* __restrict img, const hittable<fp_type>& world, const camera<fp_type>& cam,
+                    const render_settings<fp_type>& settings, render_stats& stats, float* cost, progress_counter* progress)
+{
+    RT_TRACE_THREAD("render");
+    RT_TRACE_SCOPE("render frame");
+
+    const int width = settings.width;
+    const int thread_count = settings.thread_count;
+
+    const traversal_counters traversal_start = s_traversal_counters;
+    const uint64_t row_pixels = shift < width ? uint64_t(width - shift + thread_count - 1) / thread_count : 0;
+    uint64_t published_rays = 0;
+
+    for (int j = 0; j < settings.height; ++j) {
+        render_row<Metric>(j, shift, thread_count, img, world, cam, settings, stats, cost);
+
+        if (progress != nullptr) {
+            progress->add(row_pixels, stats.rays() - published_rays);
+            published_rays = stats.rays();
+        }
+    }
+
+    stats.add_traversal(traversal_start);
+}
+
+// Pixels first, first + step, .. of row j, samples [image.sample_begin, image.sample_end) each
+void render_sample_row(int j, int first, int step, partial_image& image, const hittable<fp_type>& world,
+                       const camera<fp_type>& cam, const render_settings<fp_type>& settings, render_stats& stats)
+{
+    for (int i = first; i < settings.width; i += step) {
+        const size_t pixel = size_t(j) * settings.width + i;
+
+        for (uint32_t s = image.sample_begin; s < image.sample_end; ++s) {
+            s_random_gen.seed(counter_seed(pixel, s));
+
+            fp_type v = fp_type(j + s_random_gen()) / settings.height;
+            fp_type u = fp_type(i + s_random_gen()) / settings.width;
+
+            auto r = cam.get_ray(u, v);
+            const auto color = ray_color(r, world, settings.max_depth, stats);
+            image.add_sample(pixel, color.getX(), color.getY(), color.getZ());
+        }
+    }
+}
+
+void render_sample_columns(int shift, partial_image& image, const hittable<fp_type>& world, const camera<fp_type>& cam,
+                           const render_settings<fp_type>& settings, render_stats& stats, progress_counter* progress)
+{
+    RT_TRACE_THREAD("render");
+    RT_TRACE_SCOPE("render samples");
+
+    const traversal_counters traversal_start = s_traversal_counters;
+    const int width = settings.width;
+    const uint64_t row_pixels = shift < width ? uint64_t(width - shift + settings.thread_count - 1) / settings.thread_count : 0;
+    uint64_t published_rays = 0;
+
+    for (int j = 0; j < settings.height; ++j) {
+        render_sample_row(j, shift, settings.thread_count, image, world, cam, settings, stats);
+
+        if (progress != nullptr) {
+            progress->add(row_pixels, stats.rays() - published_rays);
+            published_rays = stats.rays();
+        }
+    }
+
+    stats.add_traversal(traversal_start);
+}
+
+// Runs render(thread index, stats block of the thread) on settings.thread_count threads and
+// returns the merged stats
+template<typename RenderFunc>
+render_stats run_threads(const render_settings<fp_type>& settings, RenderFunc&& render)
+{
+    std::vector<render_stats> thread_stats(settings.thread_count);
+    std::vector<std::thread> threads;
+
+    for (int i = 0; i < settings.thread_count; ++i)
+        threads.emplace_back(render, i, std::ref(thread_stats[i]));
+    for (auto& thread : threads)
+        thread.join();
+
+    render_stats stats;
+    for (const auto& block : thread_stats)
+        stats += block;
+    return stats;
+}
+
+// Background mode: throttle.max_workers() threads at idle priority take whole rows from a shared
+// counter, as many at a time as the throttle lets run, so that parked threads leave no columns
+// behind. render(row, stats block of the thread) renders a row.
+template<typename RenderRow>
+render_stats run_background(render_settings<fp_type> settings, worker_throttle& throttle, render_progress* progress,
+                            RenderRow&& render)
+{
+    settings.thread_count = throttle.max_workers();
+    std::atomic<int> next_row{ 0 };
+
+    return run_threads(settings, [&](int index, render_stats& stats) {
+        RT_TRACE_THREAD("render");
+        RT_TRACE_SCOPE("render background");
+
+        // NOTE: best effort, without idle priority the throttle still makes room
+        std::string error;
+        lower_thread_priority(error);
+
+        const traversal_counters traversal_start = s_traversal_counters;
+        progress_counter* counter = progress != nullptr ? &progress->counter(index) : nullptr;
+
+        // NOTE: the first thread to run out of rows wakes the parked ones, otherwise they would
+        // wait for the governor to raise the workers, which it won't while others need the CPU
+        const auto out_of_rows = [&] { return next_row.load(std::memory_order_relaxed) >= settings.height; };
+
+        while (true) {
+            throttle.wait_turn(index, out_of_rows);
+            const int j = next_row.fetch_add(1, std::memory_order_relaxed);
+            if (j >= settings.height) {
+                throttle.wake_all();
+                break;
+            }
+
+            const uint64_t rays = stats.rays();
+            render(j, stats);
+            if (counter != nullptr)
+                counter->add(uint64_t(settings.width), stats.rays() - rays);
+        }
+
+        stats.add_traversal(traversal_start);
+    });
+}
+
+} // namespace
+
+
+void random_scene(scene_builder<fp_type>& scene, int extent_a, int extent_b)
+{
+    scene.add_sphere(vec3<fp_type>(0.0, -1000.0, 0.0), 1000, scene.add_lambertian(vec3<fp_type>(0.5, 0.5, 0.5)));
+
+    add_random_spheres(scene, extent_a, extent_b);
+
+    scene.add_sphere(vec3<fp_type>(0.0, 1.0, 0.0), 1.0, scene.add_dielectric(1.5));
+    scene.add_sphere(vec3<fp_type>(-4.0, 1.0, 0.0), 1.0, scene.add_lambertian(vec3<fp_type>(0.4, 0.2, 0.1)));
+    scene.add_sphere(vec3<fp_type>(4.0, 1.0, 0.0), 1.0, scene.add_metal(vec3<fp_type>(0.7, 0.6, 0.5), 0.0));
+}
+
+uint64_t random_scene_key(int extent_a, int extent_b)
+{
+    // NOTE: bump the leading version whenever random_scene() changes, so that existing scene
+    // caches are rebuilt
+    return (uint64_t(1) << 32) | (uint64_t(extent_a) << 16) | uint64_t(extent_b);
+}
+
+bool load_scene(const char* scene_path, const scene_file& file, bool use_cache,
+                scene_builder<fp_type>& builder, scene_cache<fp_type>& cache, std::string& error)
+{
+    const std::string cache_path = scene_path != nullptr ? std::string(scene_path) + ".rtscene" : "random_scene.rtscene";
+    const uint64_t scene_key = scene_path != nullptr ? file.scene_key() : random_scene_key();
+
+    if (use_cache && cache.open(cache_path.c_str(), scene_key, error))
+        return true;
+
+    if (use_cache)
+        std::cout << "Scene cache: " << error << ", building the scene" << std::endl;
+
+    {
+        RT_TRACE_SCOPE("scene build");
+        if (scene_path == nullptr)
+            random_scene(builder);
+        else if (file.build_scene(builder, error) == false)
+            return false;
+    }
+    builder.build();
+
+    if (use_cache && write_scene_cache(cache_path.c_str(), scene_key, builder) == false)
+        std::cout << "Scene cache: can't write " << cache_path << std::endl;
+    return true;
+}
+
+
+render_stats render_frame(framebuffer& image, const hittable<fp_type>& world, const camera<fp_type>& cam,
+                          const render_settings<fp_type>& settings, heatmap* costs, render_progress* progress,
+                          worker_throttle* background)
+{
+    const heatmap_metric metric = costs != nullptr ? costs->metric : heatmap_metric::none;
+    float* cost = costs != nullptr ? costs->cost.data() : nullptr;
+
+    if (background != nullptr) {
+        // NOTE: seeded per row, the image doesn't depend on which thread took a row
+        return run_background(settings, *background, progress, [&](int j, render_stats& stats) {
+            s_random_gen.seed(counter_seed(uint64_t(j), 0));
+            switch (metric) {
+            case heatmap_metric::rays:
+                render_row<heatmap_metric::rays>(j, 0, 1, image.rgb.data(), world, cam, settings, stats, cost);
+                break;
+            case heatmap_metric::cycles:
+                render_row<heatmap_metric::cycles>(j, 0, 1, image.rgb.data(), world, cam, settings, stats, cost);
+                break;
+            default:
+                render_row<heatmap_metric::none>(j, 0, 1, image.rgb.data(), world, cam, settings, stats, nullptr);
+                break;
+            }
+        });
+    }
+
+    return run_threads(settings, [&](int shift, render_stats& stats) {
+        progress_counter* counter = progress != nullptr ? &progress->counter(shift) : nullptr;
+        switch (metric) {
+        case heatmap_metric::rays:
+            render_columns<heatmap_metric::rays>(shift, image.rgb.data(), world, cam, settings, stats, cost, counter);
+            break;
+        case heatmap_metric::cycles:
+            render_columns<heatmap_metric::cycles>(shift, image.rgb.data(), world, cam, settings, stats, cost, counter);
+            break;
+        default:
+            render_columns<heatmap_metric::none>(shift, image.rgb.data(), world, cam, settings, stats, nullptr, counter);
+            break;
+        }
+    });
+}
+
+void render_region(const render_tile& tile, float* pixels, const hittable<fp_type>& world, const camera<fp_type>& cam,
+                   const render_settings<fp_type>& settings, render_stats& stats)
+{
+    RT_TRACE_SCOPE("tile");
+    const traversal_counters traversal_start = s_traversal_counters;
+    s_random_gen.seed(static_cast<uint32_t>((tile.id + 1) * 2654435761u));
+
+    for (uint32_t j = tile.y; j < tile.y + tile.height; ++j) {
+        for (uint32_t i = tile.x; i < tile.x + tile.width; ++i) {
+            vec3<fp_type> color(0, 0, 0);
+
+            for (int s = 0; s < settings.samples_per_pixel; ++s) {
+                fp_type v = fp_type(j + s_random_gen()) / settings.height;
+                fp_type u = fp_type(i + s_random_gen()) / settings.width;
+
+                auto r = cam.get_ray(u, v);
+                color += ray_color(r, world, settings.max_depth, stats);
+            }
+
+            color /= settings.samples_per_pixel;
+
+            pixels[0] = color.getX();
+            pixels[1] = color.getY();
+            pixels[2] = color.getZ();
+            pixels += 3;
+        }
+    }
+
+    stats.add_traversal(traversal_start);
+}
+
+render_stats render_samples(partial_image& image, const hittable<fp_type>& world, const camera<fp_type>& cam,
+                            const render_settings<fp_type>& settings, render_progress* progress, worker_throttle* background)
+{
+    if (background != nullptr) {
+        return run_background(settings, *background, progress, [&](int j, render_stats& stats) {
+            render_sample_row(j, 0, 1, image, world, cam, settings, stats);
+        });
+    }
+
+    return run_threads(settings, [&](int shift, render_stats& stats) {
+        render_sample_columns(shift, image, world, cam, settings, stats, progress != nullptr ? &progress->counter(shift) : nullptr);
+    });
+}
+
+
+bool write_image(const std::string& stem, const std::string& extension, const framebuffer& image)
+{
+    RT_TRACE_SCOPE("encode");
+    stbi_flip_vertically_on_write(true);
+
+    const std::string png_path = stem + extension;
+    const bool ok = stbi_write_png(png_path.c_str(), image.width, image.height, framebuffer::channels,
+                                   image.rgb.data(), image.width * framebuffer::channels) != 0;
+    // NOTE: lossless copy for comparing builds with tools/image_diff
+    const std::string ppm_path = stem + ".ppm";
+    return write_ppm(ppm_path.c_str(), image.width, image.height, image.rgb.data(), true) && ok;
+}
+
+bool write_heatmap(const std::string& stem, const heatmap& costs)
+{
+    const float high = std::max(costs.high_cost(), std::numeric_limits<float>::min());
+
+    framebuffer colours(costs.width, costs.height);
+    std::vector<float> raw(costs.cost.size() * 3);
+
+    for (int j = 0; j < costs.height; ++j) {
+        for (int i = 0; i < costs.width; ++i) {
+            const float cost = costs.cost[size_t(j) * costs.width + i];
+            false_colour(cost / high, colours.pixel(i, j));
+
+            // NOTE: PFM wants the top row first
+            float* texel = raw.data() + (size_t(costs.height - 1 - j) * costs.width + i) * 3;
+            texel[0] = texel[1] = texel[2] = cost;
+        }
+    }
+
+    stbi_flip_vertically_on_write(true);
+
+    const std::string png_path = stem + ".png";
+    const bool ok = stbi_write_png(png_path.c_str(), colours.width, colours.height, framebuffer::channels,
+                                   colours.rgb.data(), colours.width * framebuffer::channels) != 0;
+    const std::string pfm_path = stem + ".pfm";
+    return write_pfm(pfm_path.c_str(), costs.width, costs.height, raw.data()) && ok;
+}
+
+} // namespace rt
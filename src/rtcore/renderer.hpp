@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "common/background.hpp"
+#include "common/camera.hpp"
+#include "common/partial_image.hpp"
+
+#include "framebuffer.hpp"
+#include "heatmap.hpp"
+#include "integrator.hpp"
+#include "progress.hpp"
+#include "render_stats.hpp"
+#include "scene_cache.hpp"
+#include "scene_file.hpp"
+
+
+// rtcore: the renderer shared by InOneWeekend, InOneWeekendAdvanced, the tools and benchmarks.
+// The scene headers next to this one stay templates; the loops below, the integrator and the
+// image output are compiled once into the rtcore library, for fp_type.
+namespace rt
+{
+
+// Part of a frame, rows count from the bottom like the frame
+struct render_tile
+{
+    uint32_t id;
+    uint32_t x, y;            // lower left pixel
+    uint32_t width, height;
+};
+
+
+// The book's final scene, random spheres on a (2 * extent_a) x (2 * extent_b) grid around three
+// big ones; used when no scene file is given
+void random_scene(scene_builder<fp_type>& scene, int extent_a = 11, int extent_b = 11);
+
+// Identifies the output of random_scene() in scene caches
+uint64_t random_scene_key(int extent_a = 11, int extent_b = 11);
+
+// Loads the scene of `scene_path` (nullptr: random_scene()) into `cache` if it has a valid one,
+// else builds it into `builder` and, with use_cache, writes the cache for the next run
+bool load_scene(const char* scene_path, const scene_file& file, bool use_cache,
+                scene_builder<fp_type>& builder, scene_cache<fp_type>& cache, std::string& error);
+
+
+// The whole frame on settings.thread_count threads, each taking every thread_count-th column.
+// `image` and `costs`, if given, must be settings.width x settings.height. Thread i adds its
+// pixels and rays to progress->counter(i) after every row. With `background` the frame renders in
+// background mode instead: background->max_workers() threads at idle priority, taking rows as
+// the throttle lets them, each row seeded by its index. Returns the stats of all threads merged.
+render_stats render_frame(framebuffer& image, const hittable<fp_type>& world, const camera<fp_type>& cam,
+                          const render_settings<fp_type>& settings, heatmap* costs = nullptr,
+                          render_progress* progress = nullptr, worker_throttle* background = nullptr);
+
+// One tile on the calling thread, `pixels` gets its averaged linear color, three floats per
+// pixel. The generator is seeded per tile, so a tile renders the same on any thread or process.
+// Counts into `stats`, which must be the calling thread's own.
+void render_region(const render_tile& tile, float* pixels, const hittable<fp_type>& world, const camera<fp_type>& cam,
+                   const render_settings<fp_type>& settings, render_stats& stats);
+
+// Samples [image.sample_begin, image.sample_end) of every pixel, summed into `image` on
+// settings.thread_count threads. The generator is seeded per pixel and sample, so a sample is
+// the same whichever node renders its range. Progress is counted like render_frame()'s, a pixel
+// being done with all samples of the range, and `background` selects background mode like there.
+// Returns the stats of all threads merged.
+render_stats render_samples(partial_image& image, const hittable<fp_type>& world, const camera<fp_type>& cam,
+                            const render_settings<fp_type>& settings, render_progress* progress = nullptr,
+                            worker_throttle* background = nullptr);
+
+
+// <stem><extension> as PNG plus a lossless <stem>.ppm copy for comparing builds with tools/image_diff
+bool write_image(const std::string& stem, const std::string& extension, const framebuffer& image);
+
+// <stem>.png in false colour, normalized to the 99th percentile cost, plus the raw costs as <stem>.pfm
+bool write_heatmap(const std::string& stem, const heatmap& costs);
+
+} // namespace rt
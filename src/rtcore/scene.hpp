@@ -0,0 +1,341 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <numeric>
+#include <span>
+#include <vector>
+
+#include "common/vec3.hpp"
+#include "common/aabb.hpp"
+#include "common/bvh.hpp"
+#include "common/arena.hpp"
+#include "common/transform.hpp"
+#include "common/trace.hpp"
+
+#include "material.hpp"
+#include "sphere_bvh.hpp"
+#include "instance_set.hpp"
+
+
+// A scene as plain arrays: spheres split into groups, each with its own BVH, and instances of
+// the groups under a top-level BVH. Group 0 is the world itself and is never instanced
+// explicitly; when a scene has instances, group 0 joins the top level as one identity instance.
+// The arrays are what the scene cache stores (scene_cache.hpp). For animation the builder
+// itself is kept: advance() and refit() update the arrays in place between frames.
+namespace rt
+{
+
+template<typename FloatType>
+struct material_record
+{
+    material_kind kind;
+    FloatType albedo[3];     // lambertian and metal
+    FloatType parameter;     // metal fuzziness or dielectric refraction index
+};
+
+// Ranges of one group in the node and sphere arrays, node offsets inside a group are relative
+struct sphere_group
+{
+    uint32_t first_node;
+    uint32_t node_count;
+    uint32_t first_sphere;
+    uint32_t sphere_count;
+};
+
+
+// Collects a scene and builds its acceleration structures, the input of write_scene_cache()
+template<typename FloatType,
+    typename = std::enable_if_t<std::is_floating_point<FloatType>::value>
+>
+class scene_builder
+{
+    using vec3_fp = vec3<FloatType>;
+    using record_type = material_record<FloatType>;
+    using transform_type = affine_transform<FloatType>;
+
+public:
+    uint32_t add_lambertian(const vec3_fp& albedo)
+    {
+        return add_material({ material_kind::lambertian, { albedo.getX(), albedo.getY(), albedo.getZ() }, 0 });
+    }
+
+    uint32_t add_metal(const vec3_fp& albedo, FloatType fuzziness)
+    {
+        return add_material({ material_kind::metal, { albedo.getX(), albedo.getY(), albedo.getZ() }, fuzziness });
+    }
+
+    uint32_t add_dielectric(FloatType refraction_index)
+    {
+        return add_material({ material_kind::dielectric, { 1, 1, 1 }, refraction_index });
+    }
+
+    uint32_t add_material(const record_type& record)
+    {
+        materials.push_back(record);
+        return static_cast<uint32_t>(materials.size() - 1);
+    }
+
+    // A new, empty group for instancing
+    uint32_t add_group()
+    {
+        return m_group_count++;
+    }
+
+    void add_sphere(const vec3_fp& center, FloatType radius, uint32_t material_id, uint32_t group = 0)
+    {
+        spheres.push_back({ { center.getX(), center.getY(), center.getZ() }, radius });
+        material_ids.push_back(material_id);
+        m_sphere_groups.push_back(group);
+        if (motions.empty() == false)
+            motions.push_back({});
+    }
+
+    // `velocity` is in units per frame. Still scenes keep `motions` empty.
+    void add_moving_sphere(const vec3_fp& center, const vec3_fp& velocity, FloatType radius, uint32_t material_id, uint32_t group = 0)
+    {
+        add_sphere(center, radius, material_id, group);
+        motions.resize(spheres.size());
+        motions.back() = { { velocity.getX(), velocity.getY(), velocity.getZ() } };
+    }
+
+    void add_instance(uint32_t group, const transform_type& object_to_world)
+    {
+        instances.push_back({ object_to_world.inverse(), group });
+    }
+
+    // Builds one BVH per group, with spheres sorted by group and into leaf order, and the top
+    // level over the instances. Call once, after everything is added.
+    void build()
+    {
+        RT_TRACE_SCOPE("BVH build");
+
+        std::vector<uint32_t> by_group(spheres.size());
+        std::iota(by_group.begin(), by_group.end(), 0);
+        std::stable_sort(by_group.begin(), by_group.end(), [this](uint32_t a, uint32_t b) { return m_sphere_groups[a] < m_sphere_groups[b]; });
+
+        std::vector<sphere_record<FloatType>> ordered_spheres;
+        std::vector<uint32_t> ordered_ids;
+        std::vector<sphere_motion<FloatType>> ordered_motions;
+        ordered_spheres.reserve(spheres.size());
+        ordered_ids.reserve(spheres.size());
+        ordered_motions.reserve(motions.size());
+
+        std::vector<aabb<FloatType>> group_bounds(m_group_count);
+        groups.assign(m_group_count, sphere_group{});
+        nodes.clear();
+
+        size_t begin = 0;
+        for (uint32_t group = 0; group < m_group_count; ++group) {
+            size_t end = begin;
+            while (end < by_group.size() && m_sphere_groups[by_group[end]] == group)
+                ++end;
+
+            std::vector<aabb<FloatType>> bounds(end - begin);
+            for (size_t i = begin; i < end; ++i)
+                bounds[i - begin] = sphere_bounds(by_group[i]);
+
+            bvh<FloatType> hierarchy;
+            hierarchy.build(bounds, 4);
+            group_bounds[group] = hierarchy.bounds();
+
+            groups[group] = { static_cast<uint32_t>(nodes.size()), static_cast<uint32_t>(hierarchy.nodes.size()),
+                              static_cast<uint32_t>(ordered_spheres.size()), static_cast<uint32_t>(end - begin) };
+
+            for (uint32_t item : hierarchy.item_order) {
+                ordered_spheres.push_back(spheres[by_group[begin + item]]);
+                ordered_ids.push_back(material_ids[by_group[begin + item]]);
+                if (motions.empty() == false)
+                    ordered_motions.push_back(motions[by_group[begin + item]]);
+            }
+            nodes.insert(nodes.end(), hierarchy.nodes.begin(), hierarchy.nodes.end());
+
+            begin = end;
+        }
+
+        spheres = std::move(ordered_spheres);
+        material_ids = std::move(ordered_ids);
+        motions = std::move(ordered_motions);
+        m_sphere_groups.clear();
+
+        // NOTE: instances of empty groups have nothing to hit and no bounds, they are dropped
+        std::erase_if(instances, [this](const instance_record<FloatType>& instance) { return groups[instance.object].sphere_count == 0; });
+
+        if (instances.empty() == false) {
+            if (groups[0].sphere_count > 0)
+                instances.push_back({ transform_type::identity(), 0 });
+            instance_nodes = instance_set<FloatType>::build(instances, group_bounds);
+        }
+    }
+
+    // Moves every sphere along its velocity by `frames`, the scene must have been built and
+    // refit() called before rendering again
+    void advance(FloatType frames)
+    {
+        for (size_t i = 0; i < motions.size(); ++i) {
+            for (int axis = 0; axis < 3; ++axis)
+                spheres[i].center[axis] += frames * motions[i].velocity[axis];
+        }
+    }
+
+    // Updates all bounds in place, bottom-level BVHs first, then the top level. The arrays
+    // keep their addresses, so a scene made from this builder sees the new state.
+    void refit()
+    {
+        std::vector<aabb<FloatType>> group_bounds(groups.size());
+        for (size_t g = 0; g < groups.size(); ++g) {
+            const sphere_group& group = groups[g];
+            auto group_nodes = std::span<bvh_node<FloatType>>(nodes).subspan(group.first_node, group.node_count);
+
+            bvh<FloatType>::refit(group_nodes, [&](uint32_t first, uint32_t count) {
+                aabb<FloatType> box;
+                for (uint32_t i = group.first_sphere + first; i < group.first_sphere + first + count; ++i)
+                    box.expand(sphere_bounds(i));
+                return box;
+            });
+
+            if (group_nodes.empty() == false)
+                group_bounds[g] = bvh<FloatType>::node_bounds(group_nodes[0]);
+        }
+
+        if (instances.empty() == false)
+            instance_set<FloatType>::refit(instance_nodes, instances, group_bounds);
+    }
+
+public:
+    std::vector<sphere_group> groups;
+    std::vector<bvh_node<FloatType>> nodes;
+    std::vector<sphere_record<FloatType>> spheres;
+    std::vector<uint32_t> material_ids;
+    std::vector<record_type> materials;
+    std::vector<instance_record<FloatType>> instances;
+    std::vector<bvh_node<FloatType>> instance_nodes;
+    std::vector<sphere_motion<FloatType>> motions;    // empty or parallel to `spheres`
+
+private:
+    aabb<FloatType> sphere_bounds(size_t i) const
+    {
+        return rt::sphere_bounds(spheres[i], motions.empty() ? nullptr : &motions[i]);
+    }
+
+    std::vector<uint32_t> m_sphere_groups;
+    uint32_t m_group_count = 1;
+};
+
+
+// The renderable scene over views of the arrays above (owned by a scene_builder or mapped by
+// a scene_cache, which must outlive it). Without instances it is group 0's sphere_bvh.
+template<typename FloatType,
+    typename = std::enable_if_t<std::is_floating_point<FloatType>::value>
+>
+class scene : public hittable<FloatType>
+{
+    using ray_type = ray<FloatType>;
+    using material_type = material<FloatType>;
+
+public:
+    scene(std::span<const sphere_group> groups,
+          std::span<const bvh_node<FloatType>> nodes,
+          std::span<const sphere_record<FloatType>> spheres,
+          std::span<const uint32_t> material_ids,
+          std::span<const instance_record<FloatType>> instances,
+          std::span<const bvh_node<FloatType>> instance_nodes,
+          std::span<const sphere_motion<FloatType>> motions,
+          std::vector<const material_type*> materials)
+        : m_materials(std::move(materials))
+        , m_sphere_count(spheres.size())
+    {
+        m_groups.reserve(groups.size());
+        for (const auto& group : groups) {
+            m_groups.emplace_back(nodes.subspan(group.first_node, group.node_count),
+                                  spheres.subspan(group.first_sphere, group.sphere_count),
+                                  material_ids.subspan(group.first_sphere, group.sphere_count),
+                                  std::span<const material_type* const>(m_materials),
+                                  motions.empty() ? motions : motions.subspan(group.first_sphere, group.sphere_count));
+        }
+
+        if (instances.empty() == false) {
+            std::vector<const hittable<FloatType>*> objects;
+            for (const auto& group : m_groups)
+                objects.push_back(&group);
+            m_instances = std::make_unique<instance_set<FloatType>>(instance_nodes, instances, std::move(objects));
+        }
+    }
+
+    scene(scene&&) = default;
+
+    size_t sphere_count() const
+    {
+        return m_sphere_count;
+    }
+
+    size_t instance_count() const
+    {
+        return m_instances != nullptr ? m_instances->instance_count() : 0;
+    }
+
+    virtual bool hit(const ray_type& r, FloatType t_min, FloatType t_max, hit_record<FloatType>& rec) const override
+    {
+        if (m_instances != nullptr)
+            return m_instances->hit(r, t_min, t_max, rec);
+        return m_groups.empty() == false && m_groups[0].hit(r, t_min, t_max, rec);
+    }
+
+    virtual void surface(const ray_type& r, const hit_record<FloatType>& rec, surface_interaction<FloatType>& interaction) const override
+    {
+        rec.object->surface(r, rec, interaction);
+    }
+
+private:
+    // NOTE: the groups and instance set refer to each other and to m_materials by address,
+    // moving the scene moves the vectors' buffers and keeps those addresses
+    std::vector<const material_type*> m_materials;
+    std::vector<sphere_bvh<FloatType>> m_groups;
+    std::unique_ptr<instance_set<FloatType>> m_instances;
+    size_t m_sphere_count;
+};
+
+
+namespace detail
+{
+
+template<typename FloatType>
+std::vector<const material<FloatType>*> make_materials(scene_arena& arena, std::span<const material_record<FloatType>> records)
+{
+    using vec3_fp = vec3<FloatType>;
+
+    std::vector<const material<FloatType>*> materials;
+    materials.reserve(records.size());
+
+    for (const auto& record : records) {
+        const vec3_fp albedo(record.albedo[0], record.albedo[1], record.albedo[2]);
+        switch (record.kind) {
+        case material_kind::lambertian:
+            materials.push_back(arena.make_material<lambertian<FloatType>>(albedo));
+            break;
+        case material_kind::metal:
+            materials.push_back(arena.make_material<metal<FloatType>>(albedo, record.parameter));
+            break;
+        default:
+            materials.push_back(arena.make_material<dielectic<FloatType>>(record.parameter));
+            break;
+        }
+    }
+
+    return materials;
+}
+
+} // namespace detail
+
+
+// `builder` must have been built and outlive the scene
+template<typename FloatType>
+scene<FloatType> make_world(const scene_builder<FloatType>& builder, scene_arena& arena)
+{
+    return scene<FloatType>(builder.groups, builder.nodes, builder.spheres, builder.material_ids,
+                            builder.instances, builder.instance_nodes, builder.motions,
+                            detail::make_materials<FloatType>(arena, builder.materials));
+}
+
+} // namespace rt
@@ -0,0 +1,316 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "common/vec3.hpp"
+#include "common/aabb.hpp"
+#include "common/bvh.hpp"
+#include "common/arena.hpp"
+#include "common/mapped_file.hpp"
+#include "common/trace.hpp"
+
+#include "scene.hpp"
+
+
+// Versioned binary scene format. The arrays of a built scene_builder (scene.hpp): groups,
+// spheres, material ids, material descriptions, instances, motions and the flattened BVHs are
+// stored at 64 byte aligned offsets from the start of the file, so a mapped file is used in place:
+// opening a cache checks the header and hands out views into the mapping, nothing is parsed
+// or copied. Only the (few) materials are instantiated, as they are polymorphic objects.
+namespace rt
+{
+
+namespace detail
+{
+
+inline constexpr char scene_cache_magic[8] = { 'R', 'T', 'S', 'C', 'E', 'N', 'E', '\0' };
+inline constexpr uint32_t scene_cache_version = 3;
+inline constexpr uint32_t scene_cache_byte_order = 0x01020304;
+inline constexpr uint64_t scene_cache_alignment = 64;
+
+struct scene_cache_section
+{
+    uint64_t offset;          // from the start of the file
+    uint64_t count;
+    uint64_t element_size;    // catches layout changes the version was not bumped for
+};
+
+struct scene_cache_header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint64_t key;             // identifies the scene source, a different key means a stale cache
+    uint64_t file_size;
+    scene_cache_section groups;
+    scene_cache_section nodes;
+    scene_cache_section spheres;
+    scene_cache_section material_ids;
+    scene_cache_section materials;
+    scene_cache_section instances;
+    scene_cache_section instance_nodes;
+    scene_cache_section motions;
+};
+
+template<typename T>
+bool read_section(const mapped_file& file, const scene_cache_section& section, std::span<const T>& view)
+{
+    if (section.element_size != sizeof(T) || section.offset % scene_cache_alignment != 0
+        || section.offset > file.size() || section.count > (file.size() - section.offset) / sizeof(T))
+        return false;
+
+    // NOTE: the mapping is page aligned and sections are 64 byte aligned, so the cast is safe
+    view = std::span<const T>(reinterpret_cast<const T*>(file.data() + section.offset), section.count);
+    return true;
+}
+
+// Every node must refer to children after it (the depth-first order the builder writes, so
+// traversal ends), leaves to items in [0, item_count), and the depth must fit the traversal stack
+template<typename FloatType>
+bool valid_bvh(std::span<const bvh_node<FloatType>> nodes, uint64_t item_count)
+{
+    std::vector<uint8_t> depth(nodes.size(), 0);
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        const auto& node = nodes[i];
+        if (node.is_leaf()) {
+            if (uint64_t(node.offset) + node.count > item_count)
+                return false;
+            continue;
+        }
+
+        if (node.axis > 2 || node.offset <= i + 1 || node.offset >= nodes.size()
+            || depth[i] + 1 >= bvh<FloatType>::stack_size)
+            return false;
+        depth[i + 1] = std::max<uint8_t>(depth[i + 1], depth[i] + 1);
+        depth[node.offset] = std::max<uint8_t>(depth[node.offset], depth[i] + 1);
+    }
+    return true;
+}
+
+} // namespace detail
+
+
+// `builder` must have been built
+template<typename FloatType>
+bool write_scene_cache(const char* path, uint64_t key, const scene_builder<FloatType>& builder)
+{
+    RT_TRACE_SCOPE("scene cache write");
+    using detail::scene_cache_alignment;
+
+    detail::scene_cache_header header{};
+    std::memcpy(header.magic, detail::scene_cache_magic, sizeof(header.magic));
+    header.version = detail::scene_cache_version;
+    header.byte_order = detail::scene_cache_byte_order;
+    header.key = key;
+
+    uint64_t offset = sizeof(header);
+    auto place = [&offset](detail::scene_cache_section& section, size_t count, size_t element_size) {
+        offset = (offset + scene_cache_alignment - 1) / scene_cache_alignment * scene_cache_alignment;
+        section = { offset, count, element_size };
+        offset += count * element_size;
+    };
+    place(header.groups, builder.groups.size(), sizeof(sphere_group));
+    place(header.nodes, builder.nodes.size(), sizeof(bvh_node<FloatType>));
+    place(header.spheres, builder.spheres.size(), sizeof(sphere_record<FloatType>));
+    place(header.material_ids, builder.material_ids.size(), sizeof(uint32_t));
+    place(header.materials, builder.materials.size(), sizeof(material_record<FloatType>));
+    place(header.instances, builder.instances.size(), sizeof(instance_record<FloatType>));
+    place(header.instance_nodes, builder.instance_nodes.size(), sizeof(bvh_node<FloatType>));
+    place(header.motions, builder.motions.size(), sizeof(sphere_motion<FloatType>));
+    header.file_size = offset;
+
+    // NOTE: written next to the cache and renamed over it, a render that has the old cache
+    // mapped keeps reading the old file instead of one truncated under it
+    const std::string temp_path = std::string(path) + ".tmp";
+    std::FILE* file = std::fopen(temp_path.c_str(), "wb");
+    if (file == nullptr)
+        return false;
+
+    uint64_t written = 0;
+    bool ok = true;
+    auto write = [&](const void* data, const detail::scene_cache_section& section) {
+        static const char padding[scene_cache_alignment] = {};
+        if (ok && section.offset > written)
+            ok = std::fwrite(padding, 1, section.offset - written, file) == section.offset - written;
+        if (ok && section.count > 0)
+            ok = std::fwrite(data, section.element_size, section.count, file) == section.count;
+        written = section.offset + section.count * section.element_size;
+    };
+
+    ok = std::fwrite(&header, sizeof(header), 1, file) == 1;
+    written = sizeof(header);
+    write(builder.groups.data(), header.groups);
+    write(builder.nodes.data(), header.nodes);
+    write(builder.spheres.data(), header.spheres);
+    write(builder.material_ids.data(), header.material_ids);
+    write(builder.materials.data(), header.materials);
+    write(builder.instances.data(), header.instances);
+    write(builder.instance_nodes.data(), header.instance_nodes);
+    write(builder.motions.data(), header.motions);
+
+    ok = std::fflush(file) == 0 && ok;
+    ok = std::fclose(file) == 0 && ok;
+    if (ok) {
+        std::error_code error;
+        std::filesystem::rename(temp_path, path, error);
+        ok = bool(error) == false;
+    }
+    if (ok == false)
+        std::remove(temp_path.c_str());    // NOTE: never leave a truncated cache behind
+
+    return ok;
+}
+
+
+// A mapped scene cache file. The views stay valid as long as the cache is open.
+template<typename FloatType,
+    typename = std::enable_if_t<std::is_floating_point<FloatType>::value>
+>
+class scene_cache
+{
+public:
+    // Fails with a reason in `error` if the file is missing, of another version or scene,
+    // or inconsistent: every index (groups, BVH nodes, material ids, instances) is checked
+    // against the arrays it refers to, a cache that fails is rebuilt like a stale one.
+    bool open(const char* path, uint64_t key, std::string& error)
+    {
+        RT_TRACE_SCOPE("scene cache open");
+        close();
+
+        if (m_file.open(path) == false) {
+            error = std::string("can't open ") + path;
+            return false;
+        }
+
+        detail::scene_cache_header header;
+        if (m_file.size() < sizeof(header)) {
+            error = "not a scene cache";
+            return fail();
+        }
+        std::memcpy(&header, m_file.data(), sizeof(header));
+
+        if (std::memcmp(header.magic, detail::scene_cache_magic, sizeof(header.magic)) != 0) {
+            error = "not a scene cache";
+            return fail();
+        }
+        if (header.version != detail::scene_cache_version || header.byte_order != detail::scene_cache_byte_order) {
+            error = "scene cache of another version or byte order";
+            return fail();
+        }
+        if (header.key != key) {
+            error = "scene cache is stale";
+            return fail();
+        }
+        if (header.file_size != m_file.size()
+            || detail::read_section(m_file, header.groups, m_groups) == false
+            || detail::read_section(m_file, header.nodes, m_nodes) == false
+            || detail::read_section(m_file, header.spheres, m_spheres) == false
+            || detail::read_section(m_file, header.material_ids, m_material_ids) == false
+            || detail::read_section(m_file, header.materials, m_materials) == false
+            || detail::read_section(m_file, header.instances, m_instances) == false
+            || detail::read_section(m_file, header.instance_nodes, m_instance_nodes) == false
+            || detail::read_section(m_file, header.motions, m_motions) == false
+            || m_spheres.size() != m_material_ids.size() || m_groups.empty()
+            || (m_motions.empty() == false && m_motions.size() != m_spheres.size())) {
+            error = "scene cache is truncated or was written with another FloatType";
+            return fail();
+        }
+
+        for (const auto& group : m_groups) {
+            if (uint64_t(group.first_node) + group.node_count > m_nodes.size()
+                || uint64_t(group.first_sphere) + group.sphere_count > m_spheres.size()
+                || detail::valid_bvh(m_nodes.subspan(group.first_node, group.node_count), group.sphere_count) == false) {
+                error = "scene cache has an invalid group";
+                return fail();
+            }
+        }
+
+        if (detail::valid_bvh(m_instance_nodes, m_instances.size()) == false) {
+            error = "scene cache has an invalid instance BVH";
+            return fail();
+        }
+        for (const auto& instance : m_instances) {
+            if (instance.object >= m_groups.size()) {
+                error = "scene cache has an instance of an unknown group";
+                return fail();
+            }
+        }
+
+        for (uint32_t id : m_material_ids) {
+            if (id >= m_materials.size()) {
+                error = "scene cache has an unknown material id";
+                return fail();
+            }
+        }
+
+        for (const auto& record : m_materials) {
+            if (record.kind >= material_kind::count) {
+                error = "scene cache has an unknown material";
+                return fail();
+            }
+        }
+
+        return true;
+    }
+
+    void close()
+    {
+        m_file.close();
+        m_groups = {};
+        m_nodes = {};
+        m_spheres = {};
+        m_material_ids = {};
+        m_materials = {};
+        m_instances = {};
+        m_instance_nodes = {};
+        m_motions = {};
+    }
+
+    bool is_open() const
+    {
+        return m_file.is_open();
+    }
+
+    // Materials are created in `arena`, the geometry stays in the mapping
+    scene<FloatType> make_world(scene_arena& arena) const
+    {
+        return scene<FloatType>(m_groups, m_nodes, m_spheres, m_material_ids, m_instances, m_instance_nodes, m_motions,
+                                detail::make_materials<FloatType>(arena, m_materials));
+    }
+
+    size_t sphere_count() const
+    {
+        return m_spheres.size();
+    }
+
+    size_t size() const
+    {
+        return m_file.size();
+    }
+
+private:
+    bool fail()
+    {
+        close();
+        return false;
+    }
+
+    mapped_file m_file;
+    std::span<const sphere_group> m_groups;
+    std::span<const bvh_node<FloatType>> m_nodes;
+    std::span<const sphere_record<FloatType>> m_spheres;
+    std::span<const uint32_t> m_material_ids;
+    std::span<const material_record<FloatType>> m_materials;
+    std::span<const instance_record<FloatType>> m_instances;
+    std::span<const bvh_node<FloatType>> m_instance_nodes;
+    std::span<const sphere_motion<FloatType>> m_motions;
+};
+
+} // namespace rt
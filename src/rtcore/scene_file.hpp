@@ -0,0 +1,640 @@
+#pragma once
+
+#include <cstdint>
+#include <initializer_list>
+#include <random>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "common/vec3.hpp"
+#include "common/camera.hpp"
+#include "common/json.hpp"
+#include "common/mapped_file.hpp"
+#include "common/random_generator.hpp"
+#include "common/transform.hpp"
+
+#include "scene_cache.hpp"
+
+
+// Scene and render settings files, JSON-like (see common/json.hpp):
+//
+// {
+//     "settings": { "width": 1000, "height": 500, "samples_per_pixel": 40, "max_depth": 20,
+//                   "threads": 2, "output": "image.png", "frames": 1, "shutter": 0 },
+//     "camera": { "look_from": [13, 2, 3], "look_at": [0, 0, 0], "up": [0, 1, 0],
+//                 "vfov": 20, "aperture": 0, "dist_to_focus": 10,
+//                 "end": { "look_from": [10, 4, 3] }, "orbit": 360 },
+//     "materials": {
+//         "ground": { "type": "lambertian", "albedo": [0.5, 0.5, 0.5] },
+//         "glass": { "type": "dielectric", "refraction_index": 1.5 }
+//     },
+//     "objects": [
+//         { "type": "sphere", "center": [0, -1000, 0], "radius": 1000, "material": "ground" },
+//         { "type": "sphere", "center": [0, 1, 0], "radius": 1, "velocity": [0, 0.1, 0],
+//           "material": { "type": "metal", "albedo": [0.7, 0.6, 0.5], "fuzziness": 0 } },
+//         { "type": "random_spheres", "extent": [11, 11], "seed": 456 },
+//         { "type": "instance", "group": "cluster", "translate": [0, 0, 4], "rotate": [0, 1, 0, 45] }
+//     ],
+//     "groups": {
+//         "cluster": [ { "type": "random_spheres", "extent": 2, "seed": 7 } ]
+//     }
+// }
+//
+// Every section and member is optional, missing ones keep the defaults of render_settings.
+// Velocities are in units per frame: a sphere moves by that much from one frame to the next,
+// and is blurred along it for the `shutter` part of the frame. Over a sequence of "frames"
+// the camera moves to "end" (members default to the start) and orbits by "orbit" degrees.
+// Unknown members are errors so that typos do not go unnoticed. Groups are named object arrays
+// that are only rendered through instances; their geometry is stored once however often they
+// are placed.
+namespace rt
+{
+
+template<typename FloatType>
+struct camera_settings
+{
+    using vec3_fp = vec3<FloatType>;
+
+    vec3_fp look_from = vec3_fp(13, 2, 3);
+    vec3_fp look_at = vec3_fp(0, 0, 0);
+    vec3_fp up = vec3_fp(0, 1, 0);
+    FloatType vfov = 20;
+    FloatType aperture = 0;
+    FloatType dist_to_focus = 10;
+
+    static camera_settings lerp(const camera_settings& a, const camera_settings& b, FloatType t)
+    {
+        camera_settings result;
+        result.look_from = rt::lerp(a.look_from, b.look_from, t);
+        result.look_at = rt::lerp(a.look_at, b.look_at, t);
+        result.up = rt::lerp(a.up, b.up, t);
+        result.vfov = a.vfov + (b.vfov - a.vfov) * t;
+        result.aperture = a.aperture + (b.aperture - a.aperture) * t;
+        result.dist_to_focus = a.dist_to_focus + (b.dist_to_focus - a.dist_to_focus) * t;
+        return result;
+    }
+};
+
+
+template<typename FloatType>
+struct render_settings
+{
+    using vec3_fp = vec3<FloatType>;
+
+    int width = 1000;
+    int height = 500;
+    int samples_per_pixel = 40;
+    int max_depth = 20;
+    int thread_count = 2;
+    std::string output = "image.png";
+    int frame_count = 1;       // frames > 1 render an animation, output gets a frame number
+    FloatType shutter = 0;     // open part of a frame, in [0, 1], 0 disables motion blur
+
+    // Sequences move the camera linearly from `camera` at the first frame to `camera_end` at
+    // the last, and turn it by `orbit` degrees around the up axis through look_at (turntables)
+    camera_settings<FloatType> camera_start;
+    camera_settings<FloatType> camera_end;
+    FloatType orbit = 0;
+
+    camera<FloatType> make_camera(int frame = 0) const
+    {
+        const FloatType t = frame_count > 1 ? FloatType(frame) / (frame_count - 1) : 0;
+        auto key = camera_settings<FloatType>::lerp(camera_start, camera_end, t);
+
+        if (orbit != 0) {
+            // NOTE: frame / frame_count, so that a 360 degree turntable loops without a repeated frame
+            const auto turn = affine_transform<FloatType>::rotation(key.up, orbit * frame / frame_count);
+            key.look_from = key.look_at + turn.vector(key.look_from - key.look_at);
+        }
+
+        return camera<FloatType>(key.look_from, key.look_at, key.up, key.vfov, FloatType(width) / height,
+                                 key.aperture, key.dist_to_focus, 0, shutter);
+    }
+};
+
+
+// The small spheres of the book's final scene, on a (2 * extent_a) x (2 * extent_b) grid
+template<typename FloatType>
+void add_random_spheres(scene_builder<FloatType>& scene, int extent_a, int extent_b, uint32_t seed = 456, uint32_t group = 0)
+{
+    using vec3_fp = vec3<FloatType>;
+
+    random_generator<FloatType, std::minstd_rand> random_gen{ std::minstd_rand(seed) };
+    std::uniform_real_distribution<FloatType> dist_0_05(0, 0.5);
+    std::uniform_real_distribution<FloatType> dist_05_1(0.5, 1);
+
+    for (int a = -extent_a; a < extent_a; ++a) {
+        for (int b = -extent_b; b < extent_b; ++b) {
+            FloatType choose_material = random_gen();
+            vec3_fp center(a + FloatType(0.9) * random_gen(), 0.2, b + FloatType(0.9) * random_gen());
+
+            if ((center - vec3_fp(4.0, 0.2, 0.0)).length() > FloatType(0.9)) {
+                // diffuse
+                if (choose_material < 0.5) {
+                    vec3_fp albedo = random_gen.random_vec3() * random_gen.random_vec3();
+                    scene.add_sphere(center, 0.2, scene.add_lambertian(albedo), group);
+                }
+                // metal
+                else if (choose_material < FloatType(0.75)) {
+                    vec3_fp albedo = random_gen.random_vec3(dist_05_1);
+                    FloatType fuzz = random_gen(dist_0_05);
+                    scene.add_sphere(center, 0.2, scene.add_metal(albedo, fuzz), group);
+                }
+                // glass
+                else {
+                    scene.add_sphere(center, 0.2, scene.add_dielectric(1.5), group);
+                }
+            }
+        }
+    }
+}
+
+
+namespace detail
+{
+
+// NOTE: bump when the meaning of a scene file changes, e.g. add_random_spheres(), so that
+// scene caches written from the old meaning are rebuilt
+inline constexpr uint64_t scene_file_version = 1;
+
+inline uint64_t fnv1a(std::string_view text, uint64_t hash = 14695981039346656037ull)
+{
+    for (char c : text)
+        hash = (hash ^ static_cast<unsigned char>(c)) * 1099511628211ull;
+    return hash;
+}
+
+inline bool check_members(const json_value& object, const std::string& context,
+                          std::initializer_list<std::string_view> allowed, std::string& error)
+{
+    if (object.is_object() == false) {
+        error = context + " must be an object";
+        return false;
+    }
+
+    for (const auto& member : object.members) {
+        bool known = false;
+        for (auto name : allowed)
+            known |= member.first == name;
+
+        if (known == false) {
+            error = context + ": unknown member \"" + member.first + "\"";
+            return false;
+        }
+    }
+    return true;
+}
+
+// Optional members: a missing member keeps `out`, one of the wrong type is an error
+template<typename T>
+bool read_number(const json_value& object, const char* name, const std::string& context, T& out, std::string& error)
+{
+    const json_value* value = object.find(name);
+    if (value == nullptr)
+        return true;
+
+    if (value->is_number() == false) {
+        error = context + "." + name + " must be a number";
+        return false;
+    }
+    if (value->get_number(out) == false) {
+        error = context + "." + name + " is out of range";
+        return false;
+    }
+    return true;
+}
+
+template<typename FloatType>
+bool read_vec3(const json_value& object, const char* name, const std::string& context, vec3<FloatType>& out, std::string& error)
+{
+    const json_value* value = object.find(name);
+    if (value == nullptr)
+        return true;
+
+    FloatType x, y, z;
+    if (value->is_array() == false || value->elements.size() != 3
+        || value->elements[0].get_number(x) == false || value->elements[1].get_number(y) == false
+        || value->elements[2].get_number(z) == false) {
+        error = context + "." + name + " must be an array of 3 numbers";
+        return false;
+    }
+    out = vec3<FloatType>(x, y, z);
+    return true;
+}
+
+template<typename FloatType>
+bool read_camera(const json_value& object, const std::string& context, camera_settings<FloatType>& camera, std::string& error)
+{
+    return read_vec3(object, "look_from", context, camera.look_from, error)
+        && read_vec3(object, "look_at", context, camera.look_at, error)
+        && read_vec3(object, "up", context, camera.up, error)
+        && read_number(object, "vfov", context, camera.vfov, error)
+        && read_number(object, "aperture", context, camera.aperture, error)
+        && read_number(object, "dist_to_focus", context, camera.dist_to_focus, error);
+}
+
+template<typename FloatType>
+bool read_material(const json_value& value, const std::string& context, scene_builder<FloatType>& scene,
+                   uint32_t& material_id, std::string& error)
+{
+    if (check_members(value, context, { "type", "albedo", "fuzziness", "refraction_index" }, error) == false)
+        return false;
+
+    const json_value* type = value.find("type");
+    vec3<FloatType> albedo(FloatType(0.5));
+    FloatType fuzziness = 0;
+    FloatType refraction_index = FloatType(1.5);
+
+    if (read_vec3(value, "albedo", context, albedo, error) == false
+        || read_number(value, "fuzziness", context, fuzziness, error) == false
+        || read_number(value, "refraction_index", context, refraction_index, error) == false)
+        return false;
+
+    if (type != nullptr && type->string == "lambertian")
+        material_id = scene.add_lambertian(albedo);
+    else if (type != nullptr && type->string == "metal")
+        material_id = scene.add_metal(albedo, fuzziness);
+    else if (type != nullptr && type->string == "dielectric")
+        material_id = scene.add_dielectric(refraction_index);
+    else {
+        error = context + ".type must be \"lambertian\", \"metal\" or \"dielectric\"";
+        return false;
+    }
+    return true;
+}
+
+} // namespace detail
+
+
+// A parsed scene file. Parsing is cheap; the scene itself is only built on demand, so that a
+// valid scene cache (keyed by scene_key()) can be used instead.
+class scene_file
+{
+public:
+    bool open(const char* path, std::string& error)
+    {
+        mapped_file file;
+        if (file.open(path) == false) {
+            error = "can't open the file";
+            return false;
+        }
+
+        const std::string_view text(file.data(), file.size());
+        if (parse_json(text, m_root, error) == false)
+            return false;
+
+        if (detail::check_members(m_root, "the scene", { "settings", "camera", "materials", "groups", "objects" }, error) == false)
+            return false;
+
+        // NOTE: only the text of the scene content is hashed, so editing settings or the
+        // camera keeps the cache
+        m_scene_key = detail::fnv1a(std::string_view(reinterpret_cast<const char*>(&detail::scene_file_version), sizeof(uint64_t)));
+        for (const char* section : { "materials", "groups", "objects" }) {
+            if (const json_value* value = m_root.find(section))
+                m_scene_key = detail::fnv1a(text.substr(value->source_begin, value->source_end - value->source_begin), m_scene_key);
+            m_scene_key = detail::fnv1a("|", m_scene_key);
+        }
+
+        return true;
+    }
+
+    uint64_t scene_key() const
+    {
+        return m_scene_key;
+    }
+
+    template<typename FloatType>
+    bool read_settings(render_settings<FloatType>& settings, std::string& error) const
+    {
+        if (const json_value* value = m_root.find("settings")) {
+            const std::string context = "settings";
+            if (detail::check_members(*value, context, { "width", "height", "samples_per_pixel", "max_depth", "threads", "output", "frames", "shutter" }, error) == false
+                || detail::read_number(*value, "width", context, settings.width, error) == false
+                || detail::read_number(*value, "height", context, settings.height, error) == false
+                || detail::read_number(*value, "samples_per_pixel", context, settings.samples_per_pixel, error) == false
+                || detail::read_number(*value, "max_depth", context, settings.max_depth, error) == false
+                || detail::read_number(*value, "threads", context, settings.thread_count, error) == false
+                || detail::read_number(*value, "frames", context, settings.frame_count, error) == false
+                || detail::read_number(*value, "shutter", context, settings.shutter, error) == false)
+                return false;
+
+            if (const json_value* output = value->find("output")) {
+                if (output->is_string() == false || output->string.empty()) {
+                    error = "settings.output must be a file name";
+                    return false;
+                }
+                settings.output = output->string;
+            }
+
+            if (settings.width <= 0 || settings.height <= 0 || settings.samples_per_pixel <= 0
+                || settings.max_depth <= 0 || settings.thread_count <= 0) {
+                error = "settings: width, height, samples_per_pixel, max_depth and threads must be positive";
+                return false;
+            }
+            if (settings.frame_count <= 0 || settings.shutter < 0 || settings.shutter > 1) {
+                error = "settings: frames must be positive and shutter in [0, 1]";
+                return false;
+            }
+        }
+
+        if (const json_value* value = m_root.find("camera")) {
+            if (detail::check_members(*value, "camera", { "look_from", "look_at", "up", "vfov", "aperture", "dist_to_focus", "end", "orbit" }, error) == false
+                || detail::read_camera(*value, "camera", settings.camera_start, error) == false
+                || detail::read_number(*value, "orbit", "camera", settings.orbit, error) == false)
+                return false;
+
+            // NOTE: the end of a sequence defaults to its start, members of "end" override it
+            settings.camera_end = settings.camera_start;
+            if (const json_value* end = value->find("end")) {
+                if (detail::check_members(*end, "camera.end", { "look_from", "look_at", "up", "vfov", "aperture", "dist_to_focus" }, error) == false
+                    || detail::read_camera(*end, "camera.end", settings.camera_end, error) == false)
+                    return false;
+            }
+        }
+
+        return true;
+    }
+
+    // Largest job read_job_settings() accepts: 8192x8192 pixels, 16k samples per pixel of 1080p
+    static constexpr uint64_t max_job_pixels = uint64_t(1) << 26;
+    static constexpr uint64_t max_job_samples = uint64_t(1) << 35;
+
+    // Largest grids "random_spheres" and "repeat" place, per axis and in the whole scene. The
+    // BVHs index with 32 bits, and a mistyped count must fail to parse, not exhaust memory.
+    static constexpr int max_grid_extent = 1024;
+    static constexpr uint64_t max_scene_spheres = uint64_t(1) << 24;
+    static constexpr uint64_t max_scene_instances = uint64_t(1) << 24;
+
+    // Overrides of a render server job (render_server.hpp) on top of the file's settings:
+    // "width", "height", "samples_per_pixel", "max_depth", "output" and a "camera" like the
+    // file's, without "end" and "orbit". A job renders one frame.
+    template<typename FloatType>
+    static bool read_job_settings(const json_value& job, render_settings<FloatType>& settings, std::string& error)
+    {
+        const std::string context = "the job";
+        if (detail::check_members(job, context, { "op", "priority", "scene", "width", "height", "samples_per_pixel", "max_depth", "output", "camera" }, error) == false
+            || detail::read_number(job, "width", context, settings.width, error) == false
+            || detail::read_number(job, "height", context, settings.height, error) == false
+            || detail::read_number(job, "samples_per_pixel", context, settings.samples_per_pixel, error) == false
+            || detail::read_number(job, "max_depth", context, settings.max_depth, error) == false)
+            return false;
+
+        if (const json_value* output = job.find("output")) {
+            if (output->is_string() == false || output->string.empty()) {
+                error = "output must be a file name";
+                return false;
+            }
+            settings.output = output->string;
+        }
+
+        if (const json_value* value = job.find("camera")) {
+            if (detail::check_members(*value, "camera", { "look_from", "look_at", "up", "vfov", "aperture", "dist_to_focus" }, error) == false
+                || detail::read_camera(*value, "camera", settings.camera_start, error) == false)
+                return false;
+        }
+
+        settings.frame_count = 1;
+        settings.camera_end = settings.camera_start;
+        settings.orbit = 0;
+
+        if (settings.width <= 0 || settings.height <= 0 || settings.samples_per_pixel <= 0 || settings.max_depth <= 0) {
+            error = "width, height, samples_per_pixel and max_depth must be positive";
+            return false;
+        }
+
+        // NOTE: a job's size comes from a client, the server holds its pixels as floats
+        const uint64_t pixels = uint64_t(settings.width) * uint64_t(settings.height);
+        if (pixels > max_job_pixels || pixels * uint64_t(settings.samples_per_pixel) > max_job_samples) {
+            error = "the job is too large, at most " + std::to_string(max_job_pixels) + " pixels and "
+                  + std::to_string(max_job_samples) + " samples";
+            return false;
+        }
+        return true;
+    }
+
+    template<typename FloatType>
+    bool build_scene(scene_builder<FloatType>& scene, std::string& error) const
+    {
+        std::unordered_map<std::string, uint32_t> named_materials;
+
+        if (const json_value* materials = m_root.find("materials")) {
+            if (materials->is_object() == false) {
+                error = "materials must be an object of named materials";
+                return false;
+            }
+            for (const auto& [name, value] : materials->members) {
+                uint32_t material_id;
+                if (detail::read_material(value, "materials." + name, scene, material_id, error) == false)
+                    return false;
+                named_materials[name] = material_id;
+            }
+        }
+
+        std::unordered_map<std::string, uint32_t> named_groups;
+
+        if (const json_value* groups = m_root.find("groups")) {
+            if (groups->is_object() == false) {
+                error = "groups must be an object of named object arrays";
+                return false;
+            }
+            for (const auto& [name, value] : groups->members) {
+                const uint32_t group = scene.add_group();
+                if (add_objects(value, "groups." + name, group, named_materials, named_groups, scene, error) == false)
+                    return false;
+                named_groups[name] = group;
+            }
+        }
+
+        if (const json_value* objects = m_root.find("objects"))
+            return add_objects(*objects, "objects", 0, named_materials, named_groups, scene, error);
+        return true;
+    }
+
+private:
+    // Adds `objects` to `group`; instances are only allowed at the top (group 0), and only
+    // of groups defined before, so the hierarchy stays two levels deep
+    template<typename FloatType>
+    static bool add_objects(const json_value& objects, const std::string& array_context, uint32_t group,
+                            const std::unordered_map<std::string, uint32_t>& named_materials,
+                            const std::unordered_map<std::string, uint32_t>& named_groups,
+                            scene_builder<FloatType>& scene, std::string& error)
+    {
+        if (objects.is_array() == false) {
+            error = array_context + " must be an array";
+            return false;
+        }
+
+        for (size_t i = 0; i < objects.elements.size(); ++i) {
+            const json_value& object = objects.elements[i];
+            const std::string context = array_context + "[" + std::to_string(i) + "]";
+            const json_value* type = object.is_object() ? object.find("type") : nullptr;
+
+            if (type != nullptr && type->string == "sphere") {
+                vec3<FloatType> center(0), velocity(0);
+                FloatType radius = 1;
+                uint32_t material_id = 0;
+
+                if (detail::check_members(object, context, { "type", "center", "radius", "velocity", "material" }, error) == false
+                    || detail::read_vec3(object, "center", context, center, error) == false
+                    || detail::read_vec3(object, "velocity", context, velocity, error) == false
+                    || detail::read_number(object, "radius", context, radius, error) == false)
+                    return false;
+
+                const json_value* material = object.find("material");
+                if (material != nullptr && material->is_string()) {
+                    auto it = named_materials.find(material->string);
+                    if (it == named_materials.end()) {
+                        error = context + ": unknown material \"" + material->string + "\"";
+                        return false;
+                    }
+                    material_id = it->second;
+                }
+                else if (material != nullptr) {
+                    if (detail::read_material(*material, context + ".material", scene, material_id, error) == false)
+                        return false;
+                }
+                else {
+                    error = context + ": a sphere needs a material";
+                    return false;
+                }
+
+                if (radius <= 0) {
+                    error = context + ".radius must be positive";
+                    return false;
+                }
+                if (object.find("velocity") != nullptr)
+                    scene.add_moving_sphere(center, velocity, radius, material_id, group);
+                else
+                    scene.add_sphere(center, radius, material_id, group);
+            }
+            else if (type != nullptr && type->string == "random_spheres") {
+                int extent[2] = { 11, 11 };
+                uint32_t seed = 456;
+
+                if (detail::check_members(object, context, { "type", "extent", "seed" }, error) == false
+                    || detail::read_number(object, "seed", context, seed, error) == false)
+                    return false;
+
+                if (const json_value* value = object.find("extent")) {
+                    if (value->get_number(extent[0])) {
+                        extent[1] = extent[0];
+                    }
+                    else if (value->is_array() == false || value->elements.size() != 2
+                             || value->elements[0].get_number(extent[0]) == false || value->elements[1].get_number(extent[1]) == false) {
+                        error = context + ".extent must be a number or an array of 2 numbers";
+                        return false;
+                    }
+                }
+                if (extent[0] < 1 || extent[0] > max_grid_extent || extent[1] < 1 || extent[1] > max_grid_extent) {
+                    error = context + ".extent must be between 1 and " + std::to_string(max_grid_extent);
+                    return false;
+                }
+                // NOTE: at most one sphere per cell of the 2a x 2b grid
+                if (scene.spheres.size() + 4 * uint64_t(extent[0]) * uint64_t(extent[1]) > max_scene_spheres) {
+                    error = context + ": the scene has too many spheres, at most " + std::to_string(max_scene_spheres);
+                    return false;
+                }
+
+                add_random_spheres(scene, extent[0], extent[1], seed, group);
+            }
+            else if (type != nullptr && type->string == "instance") {
+                if (add_instances(object, context, group, named_groups, scene, error) == false)
+                    return false;
+            }
+            else {
+                error = context + ".type must be \"sphere\", \"random_spheres\" or \"instance\"";
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    // { "type": "instance", "group": "name", "scale": [x, y, z], "rotate": [ax, ay, az, degrees],
+    //   "translate": [x, y, z], "repeat": [nx, ny, nz], "step": [x, y, z] }
+    // applied in the order scale, rotate, translate; `repeat` places a grid of copies `step` apart
+    template<typename FloatType>
+    static bool add_instances(const json_value& object, const std::string& context, uint32_t group,
+                              const std::unordered_map<std::string, uint32_t>& named_groups,
+                              scene_builder<FloatType>& scene, std::string& error)
+    {
+        using vec3_fp = vec3<FloatType>;
+        using transform_type = affine_transform<FloatType>;
+
+        if (detail::check_members(object, context, { "type", "group", "scale", "rotate", "translate", "repeat", "step" }, error) == false)
+            return false;
+
+        if (group != 0) {
+            error = context + ": instances can only be placed in \"objects\"";
+            return false;
+        }
+
+        const json_value* name = object.find("group");
+        auto it = name != nullptr && name->is_string() ? named_groups.find(name->string) : named_groups.end();
+        if (it == named_groups.end()) {
+            error = context + ".group must name one of \"groups\"";
+            return false;
+        }
+
+        vec3_fp scale(1), translate(0), step(0);
+        if (detail::read_vec3(object, "scale", context, scale, error) == false
+            || detail::read_vec3(object, "translate", context, translate, error) == false
+            || detail::read_vec3(object, "step", context, step, error) == false)
+            return false;
+
+        int repeat[3] = { 1, 1, 1 };
+        if (const json_value* value = object.find("repeat")) {
+            if (value->is_array() == false || value->elements.size() != 3
+                || value->elements[0].get_number(repeat[0]) == false || value->elements[1].get_number(repeat[1]) == false
+                || value->elements[2].get_number(repeat[2]) == false) {
+                error = context + ".repeat must be an array of 3 numbers";
+                return false;
+            }
+        }
+
+        auto object_to_world = transform_type::scaling(scale);
+        if (const json_value* rotate = object.find("rotate")) {
+            FloatType values[4];
+            if (rotate->is_array() == false || rotate->elements.size() != 4
+                || rotate->elements[0].get_number(values[0]) == false || rotate->elements[1].get_number(values[1]) == false
+                || rotate->elements[2].get_number(values[2]) == false || rotate->elements[3].get_number(values[3]) == false) {
+                error = context + ".rotate must be an array of 4 numbers, an axis and degrees";
+                return false;
+            }
+            const vec3_fp axis(values[0], values[1], values[2]);
+            object_to_world = transform_type::rotation(axis, values[3]) * object_to_world;
+        }
+
+        if (scale.getX() == 0 || scale.getY() == 0 || scale.getZ() == 0) {
+            error = context + ".scale must not be zero";
+            return false;
+        }
+        for (int count : repeat) {
+            if (count < 1 || count > max_grid_extent) {
+                error = context + ".repeat must be between 1 and " + std::to_string(max_grid_extent);
+                return false;
+            }
+        }
+        if (scene.instances.size() + uint64_t(repeat[0]) * repeat[1] * repeat[2] > max_scene_instances) {
+            error = context + ": the scene has too many instances, at most " + std::to_string(max_scene_instances);
+            return false;
+        }
+
+        const int nx = repeat[0], ny = repeat[1], nz = repeat[2];
+        for (int x = 0; x < nx; ++x) {
+            for (int y = 0; y < ny; ++y) {
+                for (int z = 0; z < nz; ++z) {
+                    const vec3_fp offset = translate + vec3_fp(x * step.getX(), y * step.getY(), z * step.getZ());
+                    scene.add_instance(it->second, transform_type::translation(offset) * object_to_world);
+                }
+            }
+        }
+        return true;
+    }
+
+    json_value m_root;
+    uint64_t m_scene_key = 0;
+};
+
+} // namespace rt
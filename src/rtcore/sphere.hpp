@@ -0,0 +1,89 @@
+#pragma once
+
+#include "common/rt_math.hpp"
+#include "common/vec3.hpp"
+#include "common/ray.hpp"
+
+#include "hittable.hpp"
+
+
+namespace rt
+{
+
+// Writes t and returns true for the nearest root inside (t_min, t_max), shared by sphere and sphere_bvh
+template<typename FloatType>
+inline bool intersect_sphere(const vec3<FloatType>& center, FloatType radius, const ray<FloatType>& r,
+                             FloatType t_min, FloatType t_max, FloatType& t)
+{
+    auto oc = r.origin - center;
+    auto a = r.direction.length_squared();
+    auto half_b = rt::dot(oc, r.direction);
+    auto c = oc.length_squared() - radius * radius;
+    auto discriminant = half_b * half_b - a * c;
+
+    if (discriminant > 0) {
+        auto root = rt::sqrt(discriminant);
+
+        // NOTE: a > 0, so the range test is done on the numerator and only an accepted root is divided
+        auto numerator = -half_b - root;
+        if (numerator < t_max * a && numerator > t_min * a) {
+            t = numerator / a;
+            return true;
+        }
+
+        numerator = -half_b + root;
+        if (numerator < t_max * a && numerator > t_min * a) {
+            t = numerator / a;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+template<typename FloatType,
+    typename = std::enable_if_t<std::is_floating_point<FloatType>::value>
+>
+class sphere : public hittable<FloatType>
+{
+    using vec3_fp = vec3<FloatType>;
+    using ray_type = ray<FloatType>;
+    using material_type = material<FloatType>;
+
+public:
+    sphere(vec3_fp center, FloatType radius, const material_type* material_ptr)
+        : center(center)
+        , radius(radius)
+        , material_ptr(material_ptr)
+    {}
+
+    virtual bool hit(const ray_type& r, FloatType t_min, FloatType t_max, hit_record<FloatType>& rec) const override
+    {
+        if (intersect_sphere(center, radius, r, t_min, t_max, rec.t)) {
+            rec.object = this;
+            return true;
+        }
+
+        return false;
+    }
+
+    virtual void surface(const ray_type& r, const hit_record<FloatType>& rec, surface_interaction<FloatType>& interaction) const override
+    {
+        interaction.p = r.at(rec.t);
+        auto outward_normal = (interaction.p - center) / radius;
+        interaction.set_face_normal(r, outward_normal);
+        interaction.material_ptr = material_ptr;
+    }
+
+public:
+    vec3_fp center;
+    FloatType radius;
+    const material_type* material_ptr;
+};
+
+
+// NOTE: scalar backend, center and radius share one 16 byte block behind the vtable pointer
+static_assert(sizeof(vec3<float>) != 12 || sizeof(sphere<float>) == 32);
+
+} // namespace rt
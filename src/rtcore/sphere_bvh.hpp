@@ -0,0 +1,126 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+
+#include "common/vec3.hpp"
+#include "common/ray.hpp"
+#include "common/aabb.hpp"
+#include "common/bvh.hpp"
+
+#include "hittable.hpp"
+#include "sphere.hpp"
+
+
+namespace rt
+{
+
+// Plain data sphere, the layout of the scene cache: no vtable and no pointers
+template<typename FloatType>
+struct sphere_record
+{
+    FloatType center[3];
+    FloatType radius;
+};
+
+static_assert(sizeof(sphere_record<float>) == 16);
+
+// Linear motion of a sphere: its center at ray time t (in frames) is center + t * velocity
+template<typename FloatType>
+struct sphere_motion
+{
+    FloatType velocity[3];
+};
+
+// Bounds over a whole frame, t in [0, 1]; `motion` is null for a still sphere
+template<typename FloatType>
+aabb<FloatType> sphere_bounds(const sphere_record<FloatType>& s, const sphere_motion<FloatType>* motion)
+{
+    using vec3_fp = vec3<FloatType>;
+
+    const vec3_fp center(s.center[0], s.center[1], s.center[2]);
+    aabb<FloatType> box(center - vec3_fp(s.radius), center + vec3_fp(s.radius));
+    if (motion != nullptr) {
+        const vec3_fp end = center + vec3_fp(motion->velocity[0], motion->velocity[1], motion->velocity[2]);
+        box.expand(aabb<FloatType>(end - vec3_fp(s.radius), end + vec3_fp(s.radius)));
+    }
+    return box;
+}
+
+
+// All spheres of a scene behind one BVH. The arrays are views, in leaf order, so they can
+// point into a scene_builder or straight into a mapped scene cache, and the material table is
+// owned by the scene. The hit sphere is reported through hit_record::primitive_id.
+// `motions` is empty when no sphere of the group moves, or parallel to `spheres`.
+template<typename FloatType,
+    typename = std::enable_if_t<std::is_floating_point<FloatType>::value>
+>
+class sphere_bvh : public hittable<FloatType>
+{
+    using vec3_fp = vec3<FloatType>;
+    using ray_type = ray<FloatType>;
+    using material_type = material<FloatType>;
+    using bvh_type = bvh<FloatType>;
+
+public:
+    sphere_bvh(std::span<const bvh_node<FloatType>> nodes,
+               std::span<const sphere_record<FloatType>> spheres,
+               std::span<const uint32_t> material_ids,
+               std::span<const material_type* const> materials,
+               std::span<const sphere_motion<FloatType>> motions = {})
+        : m_nodes(nodes)
+        , m_spheres(spheres)
+        , m_material_ids(material_ids)
+        , m_materials(materials)
+        , m_motions(motions)
+    {}
+
+    size_t sphere_count() const
+    {
+        return m_spheres.size();
+    }
+
+    virtual bool hit(const ray_type& r, FloatType t_min, FloatType t_max, hit_record<FloatType>& rec) const override
+    {
+        return bvh_type::traverse(m_nodes, r, t_min, t_max, [&](uint32_t first, uint32_t count, FloatType& closest_so_far) {
+            bool hit_anything = false;
+            for (uint32_t i = first; i < first + count; ++i) {
+                if (intersect_sphere(center(i, r.time()), m_spheres[i].radius, r, t_min, closest_so_far, rec.t)) {
+                    rec.primitive_id = i;
+                    rec.object = this;
+                    closest_so_far = rec.t;
+                    hit_anything = true;
+                }
+            }
+            return hit_anything;
+        });
+    }
+
+    virtual void surface(const ray_type& r, const hit_record<FloatType>& rec, surface_interaction<FloatType>& interaction) const override
+    {
+        interaction.p = r.at(rec.t);
+        auto outward_normal = (interaction.p - center(rec.primitive_id, r.time())) / m_spheres[rec.primitive_id].radius;
+        interaction.set_face_normal(r, outward_normal);
+        interaction.material_ptr = m_materials[m_material_ids[rec.primitive_id]];
+    }
+
+private:
+    vec3_fp center(uint32_t i, FloatType time) const
+    {
+        const auto& s = m_spheres[i];
+        vec3_fp c(s.center[0], s.center[1], s.center[2]);
+        if (m_motions.empty() == false) {
+            const auto& m = m_motions[i];
+            c += time * vec3_fp(m.velocity[0], m.velocity[1], m.velocity[2]);
+        }
+        return c;
+    }
+
+    std::span<const bvh_node<FloatType>> m_nodes;
+    std::span<const sphere_record<FloatType>> m_spheres;
+    std::span<const uint32_t> m_material_ids;
+    std::span<const material_type* const> m_materials;
+    std::span<const sphere_motion<FloatType>> m_motions;
+};
+
+} // namespace rt
@@ -0,0 +1,324 @@
+#pragma once
+
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#if defined(__AVX__)
+    #include <immintrin.h>
+#endif
+
+#include "common/rt_math.hpp"
+#include "common/vec3.hpp"
+#include "common/ray.hpp"
+#include "common/aabb.hpp"
+#include "common/bvh.hpp"
+
+#include "hittable.hpp"
+
+
+namespace rt
+{
+
+// Leaf of the mesh BVH: up to 8 triangles with their vertices gathered in SoA order,
+// v[vertex][axis][lane], so one AVX instruction works on the same value of all 8 triangles.
+// Unused lanes hold degenerate triangles that can't be hit.
+template<typename FloatType>
+struct alignas(32) triangle_packet
+{
+    static constexpr int width = 8;
+
+    FloatType v[3][3][width];
+    uint32_t id[width];    // triangle index in the mesh
+};
+
+
+// Ray constants of the watertight test (Woop, Benthin, Wald 2013): the ray is moved to the
+// origin and sheared so that it points along +z, which makes the edge tests exact in sign.
+template<typename FloatType>
+struct watertight_ray
+{
+    explicit watertight_ray(const ray<FloatType>& r)
+    {
+        const FloatType dir[3] = { r.direction.getX(), r.direction.getY(), r.direction.getZ() };
+        origin[0] = r.origin.getX();
+        origin[1] = r.origin.getY();
+        origin[2] = r.origin.getZ();
+
+        kz = 0;
+        if (std::abs(dir[1]) > std::abs(dir[kz]))
+            kz = 1;
+        if (std::abs(dir[2]) > std::abs(dir[kz]))
+            kz = 2;
+        kx = (kz + 1) % 3;
+        ky = (kx + 1) % 3;
+        if (dir[kz] < 0)
+            std::swap(kx, ky);
+
+        shear_x = dir[kx] / dir[kz];
+        shear_y = dir[ky] / dir[kz];
+        shear_z = 1 / dir[kz];
+    }
+
+    FloatType origin[3];
+    int kx, ky, kz;
+    FloatType shear_x, shear_y, shear_z;
+};
+
+
+// Indexed triangle mesh with shared vertex buffers in SoA layout. Fill the buffers, then call
+// build() once to create the BVH, whose leaves are triangle_packets.
+template<typename FloatType,
+    typename = std::enable_if_t<std::is_floating_point<FloatType>::value>
+>
+class triangle_mesh : public hittable<FloatType>
+{
+    using vec3_fp = vec3<FloatType>;
+    using ray_type = ray<FloatType>;
+    using material_type = material<FloatType>;
+    using packet_type = triangle_packet<FloatType>;
+
+    static constexpr int packet_width = packet_type::width;
+
+public:
+    explicit triangle_mesh(const material_type* material_ptr)
+        : material_ptr(material_ptr)
+    {}
+
+    size_t vertex_count() const
+    {
+        return x.size();
+    }
+
+    size_t triangle_count() const
+    {
+        return indices.size() / 3;
+    }
+
+    vec3_fp vertex(uint32_t index) const
+    {
+        return vec3_fp(x[index], y[index], z[index]);
+    }
+
+    aabb<FloatType> bounds() const
+    {
+        return m_bvh.bounds();
+    }
+
+    size_t acceleration_bytes() const
+    {
+        return m_bvh.nodes.size() * sizeof(bvh_node<FloatType>) + m_packets.size() * sizeof(packet_type);
+    }
+
+    void build()
+    {
+        const size_t count = triangle_count();
+
+        std::vector<aabb<FloatType>> triangle_bounds(count);
+        for (size_t i = 0; i < count; ++i) {
+            triangle_bounds[i].expand(vertex(indices[3 * i]));
+            triangle_bounds[i].expand(vertex(indices[3 * i + 1]));
+            triangle_bounds[i].expand(vertex(indices[3 * i + 2]));
+        }
+
+        m_bvh.build(triangle_bounds, packet_width, packet_width);
+
+        // one packet per leaf, leaf offsets are rewritten to packet indices
+        m_packets.clear();
+        for (auto& node : m_bvh.nodes) {
+            if (node.is_leaf() == false)
+                continue;
+
+            packet_type& packet = m_packets.emplace_back();
+            for (int lane = 0; lane < packet_width; ++lane) {
+                // NOTE: repeating a vertex gives a zero-area triangle, rejected by the det == 0 test
+                const uint32_t triangle = m_bvh.item_order[node.offset + std::min<int>(lane, node.count - 1)];
+                for (int k = 0; k < 3; ++k) {
+                    const uint32_t index = indices[3 * triangle + (lane < node.count ? k : 0)];
+                    packet.v[k][0][lane] = x[index];
+                    packet.v[k][1][lane] = y[index];
+                    packet.v[k][2][lane] = z[index];
+                }
+                packet.id[lane] = triangle;
+            }
+
+            node.offset = static_cast<uint32_t>(m_packets.size() - 1);
+        }
+
+        m_bvh.item_order.clear();
+        m_bvh.item_order.shrink_to_fit();
+    }
+
+    virtual bool hit(const ray_type& r, FloatType t_min, FloatType t_max, hit_record<FloatType>& rec) const override
+    {
+#if defined(__AVX__)
+        return intersect<std::is_same<FloatType, float>::value>(r, t_min, t_max, rec);
+#else
+        return intersect<false>(r, t_min, t_max, rec);
+#endif
+    }
+
+    // Wide = true tests the 8 triangles of a leaf with AVX, false one by one
+    template<bool Wide>
+    bool intersect(const ray_type& r, FloatType t_min, FloatType t_max, hit_record<FloatType>& rec) const
+    {
+        const watertight_ray<FloatType> wr(r);
+
+        return m_bvh.traverse(r, t_min, t_max, [&](uint32_t packet_index, uint32_t, FloatType& closest) {
+            const packet_type& packet = m_packets[packet_index];
+            int lane;
+            FloatType u, v;
+
+            if constexpr (Wide)
+                lane = intersect_packet_avx(packet, wr, t_min, closest, u, v);
+            else
+                lane = intersect_packet(packet, wr, t_min, closest, u, v);
+
+            if (lane < 0)
+                return false;
+
+            rec.t = closest;
+            rec.primitive_id = packet.id[lane];
+            rec.u = u;
+            rec.v = v;
+            rec.object = this;
+            return true;
+        });
+    }
+
+    virtual void surface(const ray_type& r, const hit_record<FloatType>& rec, surface_interaction<FloatType>& interaction) const override
+    {
+        const auto v0 = vertex(indices[3 * rec.primitive_id]);
+        const auto v1 = vertex(indices[3 * rec.primitive_id + 1]);
+        const auto v2 = vertex(indices[3 * rec.primitive_id + 2]);
+
+        // NOTE: barycentric position is exact on the triangle plane, r.at(t) drifts off it
+        interaction.p = (1 - rec.u - rec.v) * v0 + rec.u * v1 + rec.v * v2;
+        interaction.set_face_normal(r, unit_vector(cross(v1 - v0, v2 - v0)));
+        interaction.material_ptr = material_ptr;
+    }
+
+public:
+    std::vector<FloatType> x, y, z;
+    std::vector<uint32_t> indices;    // 3 per triangle
+    const material_type* material_ptr;
+
+private:
+    // Returns the lane of the closest hit in (t_min, t_max) and shrinks t_max, or -1
+    static int intersect_packet(const packet_type& packet, const watertight_ray<FloatType>& wr,
+                                FloatType t_min, FloatType& t_max, FloatType& u, FloatType& v)
+    {
+        int hit_lane = -1;
+
+        for (int lane = 0; lane < packet_width; ++lane) {
+            FloatType sx[3], sy[3], sz[3];
+            for (int k = 0; k < 3; ++k) {
+                const FloatType ax = packet.v[k][wr.kx][lane] - wr.origin[wr.kx];
+                const FloatType ay = packet.v[k][wr.ky][lane] - wr.origin[wr.ky];
+                const FloatType az = packet.v[k][wr.kz][lane] - wr.origin[wr.kz];
+                sx[k] = ax - wr.shear_x * az;
+                sy[k] = ay - wr.shear_y * az;
+                sz[k] = wr.shear_z * az;
+            }
+
+            const FloatType e0 = sx[2] * sy[1] - sy[2] * sx[1];
+            const FloatType e1 = sx[0] * sy[2] - sy[0] * sx[2];
+            const FloatType e2 = sx[1] * sy[0] - sy[1] * sx[0];
+
+            if ((e0 < 0 || e1 < 0 || e2 < 0) && (e0 > 0 || e1 > 0 || e2 > 0))
+                continue;
+
+            const FloatType det = e0 + e1 + e2;
+            if (det == 0)
+                continue;
+
+            const FloatType scaled_t = e0 * sz[0] + e1 * sz[1] + e2 * sz[2];
+            const FloatType t = scaled_t / det;
+            if (t <= t_min || t >= t_max)
+                continue;
+
+            t_max = t;
+            u = e1 / det;
+            v = e2 / det;
+            hit_lane = lane;
+        }
+
+        return hit_lane;
+    }
+
+#if defined(__AVX__)
+    static int intersect_packet_avx(const triangle_packet<float>& packet, const watertight_ray<float>& wr,
+                                    float t_min, float& t_max, float& u, float& v)
+    {
+        const __m256 shear_x = _mm256_set1_ps(wr.shear_x);
+        const __m256 shear_y = _mm256_set1_ps(wr.shear_y);
+        const __m256 shear_z = _mm256_set1_ps(wr.shear_z);
+        const __m256 origin_x = _mm256_set1_ps(wr.origin[wr.kx]);
+        const __m256 origin_y = _mm256_set1_ps(wr.origin[wr.ky]);
+        const __m256 origin_z = _mm256_set1_ps(wr.origin[wr.kz]);
+
+        __m256 sx[3], sy[3], sz[3];
+        for (int k = 0; k < 3; ++k) {
+            const __m256 ax = _mm256_sub_ps(_mm256_load_ps(packet.v[k][wr.kx]), origin_x);
+            const __m256 ay = _mm256_sub_ps(_mm256_load_ps(packet.v[k][wr.ky]), origin_y);
+            const __m256 az = _mm256_sub_ps(_mm256_load_ps(packet.v[k][wr.kz]), origin_z);
+            sx[k] = _mm256_sub_ps(ax, _mm256_mul_ps(shear_x, az));
+            sy[k] = _mm256_sub_ps(ay, _mm256_mul_ps(shear_y, az));
+            sz[k] = _mm256_mul_ps(shear_z, az);
+        }
+
+        const __m256 e0 = _mm256_sub_ps(_mm256_mul_ps(sx[2], sy[1]), _mm256_mul_ps(sy[2], sx[1]));
+        const __m256 e1 = _mm256_sub_ps(_mm256_mul_ps(sx[0], sy[2]), _mm256_mul_ps(sy[0], sx[2]));
+        const __m256 e2 = _mm256_sub_ps(_mm256_mul_ps(sx[1], sy[0]), _mm256_mul_ps(sy[1], sx[0]));
+
+        const __m256 zero = _mm256_setzero_ps();
+        const __m256 any_negative = _mm256_or_ps(_mm256_or_ps(_mm256_cmp_ps(e0, zero, _CMP_LT_OQ),
+                                                              _mm256_cmp_ps(e1, zero, _CMP_LT_OQ)),
+                                                 _mm256_cmp_ps(e2, zero, _CMP_LT_OQ));
+        const __m256 any_positive = _mm256_or_ps(_mm256_or_ps(_mm256_cmp_ps(e0, zero, _CMP_GT_OQ),
+                                                              _mm256_cmp_ps(e1, zero, _CMP_GT_OQ)),
+                                                 _mm256_cmp_ps(e2, zero, _CMP_GT_OQ));
+
+        const __m256 det = _mm256_add_ps(_mm256_add_ps(e0, e1), e2);
+        __m256 valid = _mm256_andnot_ps(_mm256_and_ps(any_negative, any_positive),
+                                        _mm256_cmp_ps(det, zero, _CMP_NEQ_OQ));
+        if (_mm256_movemask_ps(valid) == 0)
+            return -1;
+
+        const __m256 scaled_t = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e0, sz[0]), _mm256_mul_ps(e1, sz[1])),
+                                              _mm256_mul_ps(e2, sz[2]));
+        const __m256 inv_det = _mm256_div_ps(_mm256_set1_ps(1), det);
+        const __m256 t = _mm256_mul_ps(scaled_t, inv_det);
+
+        valid = _mm256_and_ps(valid, _mm256_cmp_ps(t, _mm256_set1_ps(t_min), _CMP_GT_OQ));
+        valid = _mm256_and_ps(valid, _mm256_cmp_ps(t, _mm256_set1_ps(t_max), _CMP_LT_OQ));
+        if (_mm256_movemask_ps(valid) == 0)
+            return -1;
+
+        // closest valid lane: horizontal min over t, invalid lanes set to +inf
+        const __m256 masked_t = _mm256_blendv_ps(_mm256_set1_ps(std::numeric_limits<float>::infinity()), t, valid);
+        __m256 min_t = _mm256_min_ps(masked_t, _mm256_permute_ps(masked_t, _MM_SHUFFLE(2, 3, 0, 1)));
+        min_t = _mm256_min_ps(min_t, _mm256_permute_ps(min_t, _MM_SHUFFLE(1, 0, 3, 2)));
+        min_t = _mm256_min_ps(min_t, _mm256_permute2f128_ps(min_t, min_t, 0x01));
+
+        const int lane_mask = _mm256_movemask_ps(_mm256_and_ps(valid, _mm256_cmp_ps(masked_t, min_t, _CMP_EQ_OQ)));
+        const int lane = std::countr_zero(static_cast<unsigned>(lane_mask));
+
+        alignas(32) float lanes[packet_width];
+        _mm256_store_ps(lanes, _mm256_mul_ps(e1, inv_det));
+        u = lanes[lane];
+        _mm256_store_ps(lanes, _mm256_mul_ps(e2, inv_det));
+        v = lanes[lane];
+        t_max = _mm256_cvtss_f32(min_t);
+
+        return lane;
+    }
+#endif
+
+    bvh<FloatType> m_bvh;
+    std::vector<packet_type> m_packets;
+};
+
+} // namespace rt
@@ -0,0 +1,197 @@
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <thread>
+
+#include "common/json.hpp"
+#include "common/process.hpp"
+#include "common/socket.hpp"
+
+#include "InOneWeekend/render_server.hpp"
+
+
+// The render server (InOneWeekend --serve) with a scene that is edited while a job renders it:
+// the job must finish with the scene it was submitted with, a job submitted after the edit must
+// see the edit, and the server must survive both.
+// usage: render_server_test <InOneWeekend executable>, run in a scratch directory
+namespace
+{
+
+const char* const g_ScenePath = "render_server_test.json";
+
+// The small spheres of the book's final scene on a grid, so that the scene has a cache; the test
+// edits the seed, which moves them: the geometry is what a job reads from the mapped cache
+bool write_scene(int seed)
+{
+    std::ofstream out(g_ScenePath);
+    out << "{\n"
+           "    \"camera\": { \"look_from\": [13, 2, 3], \"look_at\": [0, 0, 0], \"vfov\": 20, \"aperture\": 0, \"dist_to_focus\": 10 },\n"
+           "    \"objects\": [\n"
+           "        { \"type\": \"sphere\", \"center\": [0, -1000, 0], \"radius\": 1000,\n"
+           "          \"material\": { \"type\": \"lambertian\", \"albedo\": [0.5, 0.5, 0.5] } },\n"
+           "        { \"type\": \"random_spheres\", \"extent\": 5, \"seed\": " << seed << " },\n"
+           "        { \"type\": \"sphere\", \"center\": [0, 1, 0], \"radius\": 1,\n"
+           "          \"material\": { \"type\": \"lambertian\", \"albedo\": [0.9, 0.1, 0.1] } }\n"
+           "    ]\n"
+           "}\n";
+    return out.good();
+}
+
+std::string read_file(const std::string& path)
+{
+    std::ifstream in(path, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+
+class server_client
+{
+public:
+    bool connect(uint16_t port)
+    {
+        // NOTE: the server may not be listening yet
+        for (int attempt = 0; attempt < 100; ++attempt) {
+            if (m_stream.connect("127.0.0.1", port))
+                return true;
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+        return false;
+    }
+
+    bool request(const std::string& line, rt::json_value& response)
+    {
+        const std::string message = line + "\n";
+        std::string text, error;
+        if (m_stream.send_all(message.data(), message.size()) == false || m_reader.read_line(text) == false)
+            return false;
+        if (rt::parse_json(text, response, error) == false || response.is_object() == false) {
+            std::cerr << "bad response: " << text << '\n';
+            return false;
+        }
+        if (const rt::json_value* message_error = response.find("error")) {
+            std::cerr << "server error: " << message_error->string << '\n';
+            return false;
+        }
+        return true;
+    }
+
+    uint64_t submit(const std::string& output, int priority)
+    {
+        rt::json_value response;
+        uint64_t id = 0;
+        const std::string line = std::string("{ \"op\": \"submit\", \"scene\": \"") + g_ScenePath + "\", \"priority\": "
+            + std::to_string(priority) + ", \"width\": 400, \"height\": 200, \"samples_per_pixel\": 16, \"output\": \"" + output + "\" }";
+        if (request(line, response) == false || response.find("id") == nullptr || response.find("id")->get_number(id) == false)
+            return 0;
+        return id;
+    }
+
+    std::string state(uint64_t id)
+    {
+        rt::json_value response;
+        const rt::json_value* state = nullptr;
+        if (request("{ \"op\": \"status\", \"id\": " + std::to_string(id) + " }", response) == false
+            || (state = response.find("state")) == nullptr)
+            return "unknown";
+        return state->string;
+    }
+
+    // The final state of the job
+    std::string wait(uint64_t id)
+    {
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::minutes(5);
+        while (std::chrono::steady_clock::now() < deadline) {
+            const std::string current = state(id);
+            if (current != "queued" && current != "rendering")
+                return current;
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        }
+        return "timed out";
+    }
+
+private:
+    rt::socket_stream m_stream;
+    rt::detail::line_reader m_reader{ m_stream };
+};
+
+
+bool run(const char* executable)
+{
+    // NOTE: a free port is picked here rather than by the server, which only prints it
+    uint16_t port;
+    {
+        rt::socket_listener probe;
+        if (probe.listen(0) == false) {
+            std::cerr << "can't find a free port\n";
+            return false;
+        }
+        port = probe.port();
+    }
+
+    if (write_scene(11) == false) {
+        std::cerr << "can't write " << g_ScenePath << '\n';
+        return false;
+    }
+
+    rt::child_process server;
+    server_client client;
+    if (server.start({ executable, "--serve", std::to_string(port) }) == false || client.connect(port) == false) {
+        std::cerr << "can't start the server\n";
+        return false;
+    }
+
+    bool ok = true;
+    auto check = [&ok](bool condition, const char* what) {
+        if (condition == false) {
+            std::cerr << "FAILED: " << what << '\n';
+            ok = false;
+        }
+        return condition;
+    };
+
+    // A renders the first scene; the edit and B (urgent, so A waits for it) come while A renders
+    const uint64_t a = client.submit("render_server_test_a.png", 0);
+    const std::string a_state = client.state(a);
+    check(a != 0 && (a_state == "queued" || a_state == "rendering"), "job A is in flight when the scene is edited");
+
+    check(write_scene(12), "the scene is edited");
+    const uint64_t b = client.submit("render_server_test_b.png", 1);
+    check(b != 0, "job B is accepted");
+
+    check(client.wait(b) == "done", "job B renders the edited scene");
+    check(client.wait(a) == "done", "job A renders while the scene is edited");
+
+    // C renders the first scene again, from scratch or from the server's cache: A must match it
+    check(write_scene(11), "the scene is restored");
+    const uint64_t c = client.submit("render_server_test_c.png", 0);
+    check(c != 0 && client.wait(c) == "done", "job C renders the restored scene");
+
+    const std::string image_a = read_file("render_server_test_a.ppm");
+    const std::string image_b = read_file("render_server_test_b.ppm");
+    const std::string image_c = read_file("render_server_test_c.ppm");
+    check(image_a.empty() == false && image_a == image_c, "job A rendered the scene it was submitted with");
+    check(image_b.empty() == false && image_b != image_a, "job B rendered the edited scene");
+
+    rt::json_value response;
+    check(client.request("{ \"op\": \"shutdown\" }", response), "the server shuts down");
+    check(server.wait() == 0, "the server exits cleanly");
+    return ok;
+}
+
+} // namespace
+
+
+int main(int argc, char** argv)
+{
+    if (argc != 2) {
+        std::cerr << "usage: render_server_test <InOneWeekend executable>\n";
+        return 2;
+    }
+    if (run(argv[1]) == false)
+        return 1;
+
+    std::cout << "render server test passed\n";
+    return 0;
+}
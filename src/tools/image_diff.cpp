@@ -0,0 +1,56 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include "common/image_io.hpp"
+
+
+// Compares two images of the same size (PPM or PFM) and prints RMSE, PSNR and the largest
+// per-channel difference. Exits with 1 when RMSE is above --max-rmse (default 0.01).
+int main(int argc, char** argv)
+{
+    if (argc < 3) {
+        std::cerr << "usage: image_diff <a.ppm|a.pfm> <b.ppm|b.pfm> [--max-rmse value]\n";
+        return 2;
+    }
+
+    double max_rmse = 0.01;
+    for (int i = 3; i + 1 < argc; ++i) {
+        if (std::string(argv[i]) == "--max-rmse")
+            max_rmse = std::atof(argv[++i]);
+    }
+
+    rt::image a, b;
+    if (rt::read_image(argv[1], a) == false || rt::read_image(argv[2], b) == false) {
+        std::cerr << "can't read input images\n";
+        return 2;
+    }
+    if (a.width != b.width || a.height != b.height) {
+        std::cerr << "image sizes differ: " << a.width << 'x' << a.height
+                  << " vs " << b.width << 'x' << b.height << '\n';
+        return 2;
+    }
+
+    double squared_sum = 0;
+    double max_diff = 0;
+    size_t differing = 0;
+
+    for (size_t i = 0; i < a.data.size(); ++i) {
+        const double diff = std::abs(double(a.data[i]) - double(b.data[i]));
+        squared_sum += diff * diff;
+        max_diff = std::max(max_diff, diff);
+        differing += diff > 0;
+    }
+
+    const double rmse = std::sqrt(squared_sum / a.data.size());
+    const double psnr = rmse > 0 ? 20 * std::log10(1 / rmse) : INFINITY;
+
+    std::cout << "RMSE: " << rmse
+              << "\nPSNR: " << psnr << "dB"
+              << "\nMax diff: " << max_diff
+              << "\nDiffering channels: " << differing << '/' << a.data.size() << '\n';
+
+    return rmse > max_rmse ? 1 : 0;
+}
@@ -0,0 +1,54 @@
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "common/partial_image.hpp"
+
+#include "rtcore/renderer.hpp"
+
+
+// Merges the partial images of a sample-range render (InOneWeekend --samples A:B) into the final
+// image, written as PNG plus a PPM copy like the renderer's own output. The ranges may be given
+// in any order but must cover one range without gaps or overlaps; the result is then bitwise the
+// image of a single --samples render of that whole range.
+int main(int argc, char** argv)
+{
+    if (argc < 3) {
+        std::cerr << "usage: merge_samples <output.png> <part.rtpart>...\n";
+        return 2;
+    }
+
+    std::vector<rt::partial_image> parts(argc - 2);
+    std::string error;
+    for (int i = 2; i < argc; ++i) {
+        if (rt::read_partial_image(argv[i], parts[i - 2], error) == false) {
+            std::cerr << argv[i] << ", " << error << '\n';
+            return 2;
+        }
+    }
+
+    std::sort(parts.begin(), parts.end(), [](const auto& a, const auto& b) { return a.sample_begin < b.sample_begin; });
+
+    rt::partial_image& merged = parts.front();
+    for (size_t i = 1; i < parts.size(); ++i) {
+        if (rt::merge_partial_image(merged, parts[i], error) == false) {
+            std::cerr << error << '\n';
+            return 1;
+        }
+    }
+
+    rt::framebuffer image(merged.width, merged.height);
+    merged.resolve_rgb8(image.rgb);
+
+    const std::string output = argv[1];
+    const std::string stem = output.substr(0, output.find_last_of('.'));
+    if (rt::write_image(stem, output.substr(stem.size()), image) == false) {
+        std::cerr << "can't write " << output << '\n';
+        return 1;
+    }
+
+    std::cout << "Merged " << parts.size() << " partial images, samples " << merged.sample_begin
+              << " to " << merged.sample_end << '\n';
+    return 0;
+}
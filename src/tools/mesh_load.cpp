@@ -0,0 +1,91 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include "rtcore/triangle_mesh.hpp"
+#include "rtcore/mesh_io.hpp"
+
+
+// Loads an OBJ or binary PLY mesh and reports the load throughput, optionally builds the BVH
+// and converts the mesh to binary PLY.
+// usage: mesh_load <mesh.obj|mesh.ply> [--threads N] [--repeat N] [--build] [--write-ply out.ply]
+
+using fp_type = float;
+
+namespace
+{
+
+using clock_type = std::chrono::high_resolution_clock;
+
+double elapsed_ms(clock_type::time_point start_t)
+{
+    return std::chrono::duration<double, std::milli>(clock_type::now() - start_t).count();
+}
+
+} // namespace
+
+
+int main(int argc, char** argv)
+{
+    if (argc < 2) {
+        std::cerr << "usage: mesh_load <mesh.obj|mesh.ply> [--threads N] [--repeat N] [--build] [--write-ply out.ply]\n";
+        return 2;
+    }
+
+    const char* path = argv[1];
+    int thread_count = 0;
+    int repeat = 1;
+    bool build = false;
+    const char* ply_path = nullptr;
+
+    for (int i = 2; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--threads" && i + 1 < argc)
+            thread_count = std::atoi(argv[++i]);
+        else if (arg == "--repeat" && i + 1 < argc)
+            repeat = std::max(std::atoi(argv[++i]), 1);
+        else if (arg == "--build")
+            build = true;
+        else if (arg == "--write-ply" && i + 1 < argc)
+            ply_path = argv[++i];
+    }
+
+    const size_t file_size = rt::mapped_file(path).size();
+
+    rt::triangle_mesh<fp_type> mesh(nullptr);
+    std::string error;
+    double best_ms = 0;
+
+    // NOTE: the first run includes reading the file from disk, later ones hit the page cache
+    for (int run = 0; run < repeat; ++run) {
+        auto start_t = clock_type::now();
+        if (rt::load_mesh(path, mesh, error, thread_count) == false) {
+            std::cerr << error << '\n';
+            return 1;
+        }
+
+        const double ms = elapsed_ms(start_t);
+        best_ms = run == 0 ? ms : std::min(best_ms, ms);
+        std::cout << "load: " << ms << "ms  " << file_size / (1024.0 * 1024.0) / (ms / 1000) << " MB/s\n";
+    }
+
+    std::cout << "Vertices: " << mesh.vertex_count() << "\nTriangles: " << mesh.triangle_count()
+              << "\nFile: " << file_size / (1024.0 * 1024.0) << "MB, best " << best_ms << "ms, "
+              << file_size / (1024.0 * 1024.0) / (best_ms / 1000) << " MB/s\n";
+
+    if (build) {
+        auto start_t = clock_type::now();
+        mesh.build();
+        std::cout << "BVH build: " << elapsed_ms(start_t) << "ms, "
+                  << mesh.acceleration_bytes() / (1024 * 1024) << "MB\n";
+    }
+
+    if (ply_path != nullptr && rt::write_ply(ply_path, mesh) == false) {
+        std::cerr << "can't write " << ply_path << '\n';
+        return 1;
+    }
+
+    return 0;
+}